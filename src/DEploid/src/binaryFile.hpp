@@ -0,0 +1,143 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdint>
+#include <cstring>   // memcpy
+#include <fstream>
+#include <string>
+#include "exceptions.hpp"
+#include "mappedFile.hpp"
+
+#ifndef DEPLOID_SRC_BINARYFILE_HPP_
+#define DEPLOID_SRC_BINARYFILE_HPP_
+
+using std::string;
+
+
+struct InvalidBinaryFile : public InvalidInput{
+    explicit InvalidBinaryFile(string str):InvalidInput(str) {
+        this->reason = "Invalid or corrupted binary file: ";
+        throwMsg = this->reason + this->src;
+    }
+    ~InvalidBinaryFile() throw() {}
+};
+
+
+// Reads values, in the byte order of the machine, from a mapped file and
+// throws rather than reading past its end
+class BinaryFileReader {
+ public:
+    explicit BinaryFileReader(const string &fileName)
+        : file_(fileName), fileName_(fileName), pos_(0) {}
+
+    const char * take(size_t nBytes) {
+        if (nBytes > this->file_.size() - this->pos_) {
+            throw InvalidBinaryFile(this->fileName_);
+        }
+        const char * ret = this->file_.data() + this->pos_;
+        this->pos_ += nBytes;
+        return ret;
+    }
+    template <class T> T read() {
+        T ret;
+        memcpy(&ret, this->take(sizeof(T)), sizeof(T));
+        return ret;
+    }
+    template <class T> void readArray(T * values, size_t nValues) {
+        memcpy(values, this->take(nValues * sizeof(T)), nValues * sizeof(T));
+    }
+    string readString() {
+        uint32_t length = this->read<uint32_t>();
+        const char * chars = this->take(length);
+        return string(chars, length);
+    }
+    // Sections start on 8 byte boundaries
+    void align() {
+        this->take((8 - this->pos_ % 8) % 8);
+    }
+    void seek(size_t pos) {
+        if (pos > this->file_.size()) {
+            throw InvalidBinaryFile(this->fileName_);
+        }
+        this->pos_ = pos;
+    }
+    size_t remaining() const { return this->file_.size() - this->pos_; }
+    bool atEnd() const { return this->remaining() == 0; }
+
+ private:
+    BinaryFileReader(const BinaryFileReader &);
+    BinaryFileReader & operator=(const BinaryFileReader &);
+
+    MappedFile file_;
+    string fileName_;
+    size_t pos_;
+};
+
+
+class BinaryFileWriter {
+ public:
+    explicit BinaryFileWriter(const string &fileName)
+        : fileName_(fileName), pos_(0) {
+        this->out_.open(fileName.c_str(), std::ios::out | std::ios::binary);
+        if (!this->out_.good()) {
+            throw CannotWriteFile(fileName);
+        }
+    }
+
+    void write(const void * data, size_t nBytes) {
+        this->out_.write(static_cast<const char *>(data), nBytes);
+        this->pos_ += nBytes;
+    }
+    template <class T> void write(const T &value) {
+        this->write(&value, sizeof(T));
+    }
+    template <class T> void writeArray(const T * values, size_t nValues) {
+        this->write(values, nValues * sizeof(T));
+    }
+    void writeString(const string &str) {
+        this->write(static_cast<uint32_t>(str.size()));
+        this->write(str.data(), str.size());
+    }
+    void align() {
+        static const char zeros[8] = {0};
+        this->write(zeros, (8 - this->pos_ % 8) % 8);
+    }
+    void close() {
+        this->out_.close();
+        if (this->out_.fail()) {
+            throw CannotWriteFile(this->fileName_);
+        }
+    }
+
+ private:
+    BinaryFileWriter(const BinaryFileWriter &);
+    BinaryFileWriter & operator=(const BinaryFileWriter &);
+
+    std::ofstream out_;
+    string fileName_;
+    size_t pos_;
+};
+
+#endif  // DEPLOID_SRC_BINARYFILE_HPP_
@@ -0,0 +1,100 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdlib>   // EXIT_SUCCESS, EXIT_FAILURE
+#include <iostream>  // std::cout
+#include <string>
+#include <vector>
+#include "outputBundle.hpp"
+
+using std::string;
+using std::vector;
+
+static void printUsage(std::ostream &output) {
+    output << "Usage: bundleExtractor -bundle FILE [-list] [-section STR]... "
+           << "[-o DIR]" << std::endl
+           << "Lists the sections of a dEploid -bundle output, or extracts "
+           << "them, all by default, into files of the same names."
+           << std::endl;
+}
+
+
+static string nextArgument(int argc, char *argv[], int &i) {
+    string flag(argv[i]);
+    if (++i >= argc) {
+        throw NotEnoughArg(flag);
+    }
+    return string(argv[i]);
+}
+
+
+int main(int argc, char *argv[]) {
+    try {
+        string bundleFileName, outDir;
+        vector <string> sections;
+        bool list = false;
+
+        for (int i = 1; i < argc; i++) {
+            string flag(argv[i]);
+            if (flag == "-bundle") {
+                bundleFileName = nextArgument(argc, argv, i);
+            } else if (flag == "-list") {
+                list = true;
+            } else if (flag == "-section") {
+                sections.push_back(nextArgument(argc, argv, i));
+            } else if (flag == "-o") {
+                outDir = nextArgument(argc, argv, i);
+            } else if (flag == "-help" || flag == "-h") {
+                printUsage(std::cout);
+                return EXIT_SUCCESS;
+            } else {
+                throw UnknowArg(flag);
+            }
+        }
+        if (bundleFileName.size() == 0) {
+            printUsage(std::cerr);
+            return EXIT_FAILURE;
+        }
+
+        OutputBundleReader bundle(bundleFileName);
+        if (sections.size() == 0) {
+            sections = bundle.sections();
+        }
+        for (string const& section : sections) {
+            if (list) {
+                std::cout << section << "\t" << bundle.sectionSize(section)
+                          << std::endl;
+            } else {
+                bundle.extractSection(section, (outDir.size() > 0) ?
+                                      outDir + "/" + section : section);
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
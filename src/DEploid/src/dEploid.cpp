@@ -41,21 +41,13 @@ int main(int argc, char *argv[]) {
             return EXIT_SUCCESS;
         }
 
-        if (dEploidIO.doComputeLLK()) {
-            dEploidIO.computeLLKfromInitialHap();
-        } else if (dEploidIO.doLsPainting()) {
-            dEploidIO.operation_chromPainting();
-        } else if (dEploidIO.doIbdPainting()) {
-            dEploidIO.operation_paintIBD();
-        } else if (dEploidIO.doIbdViterbiPainting()) {
-            dEploidIO.operation_paintIBDviterbi();
-        } else if (dEploidIO.useLasso()) {  // DEploid-Lasso
-            dEploidIO.workflow_lasso();
-        } else if (dEploidIO.useBestPractice()) {  // best practice
-            dEploidIO.workflow_best();
-        } else {  // classic version, and DEploid-IBD
-            dEploidIO.workflow_ibd();
+        if (dEploidIO.doBatch()) {
+            // Each job writes its own log
+            dEploidIO.workflow_batch();
+            return EXIT_SUCCESS;
         }
+
+        dEploidIO.runWorkflow();
         // Finishing, write log
         dEploidIO.wrapUp();
     }
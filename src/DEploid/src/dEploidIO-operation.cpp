@@ -24,9 +24,11 @@
  */
 
 
+#include <algorithm>      // std::min, std::max
 #include <iomanip>        // std::setw
 #include "dEploidIO.hpp"
 #include "updateHap.hpp"  // chromPainting
+#include "parallel.hpp"
 
 
 void DEploidIO::operation_printVersion(std::ostream& out) {
@@ -52,6 +54,10 @@ void DEploidIO::operation_printHelp(std::ostream& out) {
         << "DEploid version." << endl;
     out << setw(20) << "-vcf STR"            << "  --  "
         << "VCF file path." << endl;
+    out << setw(20) << "-batch"              << "  --  "
+        << "Deconvolute every sample of the VCF." << endl;
+    out << setw(20) << "-batchSamples STR"   << "  --  "
+        << "Deconvolute the VCF samples listed in the file." << endl;
     out << setw(20) << "-ref STR"            << "  --  "
         << "File path of reference allele count." << endl;
     out << setw(20) << "-alt STR"            << "  --  "
@@ -59,17 +65,28 @@ void DEploidIO::operation_printHelp(std::ostream& out) {
     out << setw(20) << "-plaf STR"           << "  --  "
         << "File path of population level allele frequencies." << endl;
     out << setw(20) << "-panel STR"          << "  --  "
-        << "File path of the reference panel." << endl;
+        << "File path of the reference panel, text or binary." << endl;
     out << setw(20) << "-exclude STR"        << "  --  "
-        << "File path of sites to be excluded." << endl;
+        << "File path of sites to be excluded, or a BED mask." << endl;
+    out << setw(20) << "-region STR"         << "  --  "
+        << "Only use sites in CHROM:START-END, can be repeated." << endl;
+    out << setw(20) << "-siteCache STR"      << "  --  "
+        << "Cache of the parsed sites, reused by runs on the same inputs."
+        << endl;
     out << setw(20) << "-o STR"              << "  --  "
         << "Specify the file name prefix of the output." << endl;
+    out << setw(20) << "-bundle"             << "  --  "
+        << "Write all output files into one PREFIX.bundle file." << endl;
     out << setw(20) << "-p INT"              << "  --  "
-        << "Out put precision (default value 8)." << endl;
+        << "Output precision, 0 for exact (default value 6)." << endl;
+    out << setw(20) << "-postProbFormat STR" << "  --  "
+        << "Posterior probabilities as text, float32 or uint16." << endl;
     out << setw(20) << "-k INT"              << "  --  "
         << "Number of strain (default value 5)." << endl;
     out << setw(20) << "-seed INT"           << "  --  "
         << "Random seed." << endl;
+    out << setw(20) << "-nThreads INT"       << "  --  "
+        << "Number of threads (default value 1)." << endl;
     out << setw(20) << "-nSample INT"        << "  --  "
         << "Number of MCMC samples." << endl;
     out << setw(20) << "-rate INT"           << "  --  "
@@ -178,22 +195,26 @@ void DEploidIO::operation_chromPainting() {
 
     vector <double> expectedWsaf = computeExpectedWsafFromInitialHap();
 
-    MersenneTwister tmpRg(this->randomSeed_.getValue());
-
-    if (this->doAllowInbreeding() == true) {
-        this->panel->initializeUpdatePanel(
-            this->panel->truePanelSize()+kStrain_.getValue()-1);
-    }
-
-    for ( size_t tmpk = 0; tmpk < this->kStrain_.getValue(); tmpk++ ) {
-        if ( this->doAllowInbreeding() == true ) {
-            this->panel->updatePanelWithHaps(
-            this->panel->truePanelSize()+kStrain_.getValue()-1,
-                tmpk, this->initialHap);
-        }
-
-        for (size_t chromi = 0 ;
-             chromi < this->indexOfChromStarts_.size(); chromi++ ) {
+    bool inbreeding = this->doAllowInbreeding();
+    size_t inbreedingPanelSize =
+        this->panel->truePanelSize()+kStrain_.getValue()-1;
+
+    // Each (strain, chromosome) pair is painted independently. With
+    // inbreeding, a pair reads its own copy of the panel rows of its
+    // chromosome, with the strain columns added, so the shared panel is never
+    // written to. Pairs are painted in windows of nThreads and written in
+    // order.
+    size_t nChrom = this->indexOfChromStarts_.size();
+    size_t nTasks = this->kStrain_.getValue() * nChrom;
+    size_t nThreads = std::max(this->nThreads(), static_cast<size_t>(1));
+    vector < vector < vector <double> > > fwdBwdProbs(nThreads);
+
+    for (size_t task = 0; task < nTasks; ) {
+        size_t windowEnd = std::min(task + nThreads, nTasks);
+
+        runInParallel(windowEnd - task, nThreads, [&](size_t i) {
+            size_t tmpk = (task + i) / nChrom;
+            size_t chromi = (task + i) % nChrom;
             size_t start = this->indexOfChromStarts_[chromi];
             size_t length = this->position_[chromi].size();
             dout << "Painting Chrom "<< chromi
@@ -203,22 +224,29 @@ void DEploidIO::operation_chromPainting() {
                                       this->altCount_,
                                       this->plaf_,
                                       expectedWsaf,
-                                      this->finalProp, this->initialHap, &tmpRg,
+                                      this->finalProp, this->initialHap, NULL,
                                       start, length,
-                                      this->panel,
+                                      this->panel.get(),
                                       this->missCopyProb_.getValue(),
                                       this->scalingFactor(),
                                       tmpk);
 
-            if (this->doAllowInbreeding() == true) {
-                updatingSingle.setPanelSize(this->panel->inbreedingPanelSize());
+            vector < vector <double> > panelRows;
+            if (inbreeding == true) {
+                updatingSingle.setPanelSize(inbreedingPanelSize);
+                panelRows = this->panel->inbreedingRows(start, length,
+                    inbreedingPanelSize, tmpk, this->initialHap);
+                updatingSingle.setPanelRows(&panelRows);
             }
             updatingSingle.painting(refCount_, altCount_,
                 expectedWsaf, this->finalProp, this->initialHap);
-            // this->writeLastSingleFwdProb(updatingSingle.fwdProbs_,
-            //    chromi, tmpk, false );  // false as not using ibd
-            this->writeLastSingleFwdProb(updatingSingle.fwdBwdProbs_,
-                chromi, tmpk, false);  // false as not using ibd
+            fwdBwdProbs[i].swap(updatingSingle.fwdBwdProbs_);
+        });
+
+        for (size_t i = 0; task < windowEnd; i++, task++) {
+            this->writeLastSingleFwdProb(fwdBwdProbs[i], task % nChrom,
+                task / nChrom, false);  // false as not using ibd
+            vector < vector <double> >().swap(fwdBwdProbs[i]);
         }
     }
 }
@@ -25,8 +25,53 @@
 
 
 #include <iostream>  // std::cout
+#include <mutex>     // std::mutex
 #include "mcmc.hpp"
 #include "dEploidIO.hpp"
+#include "parallel.hpp"
+
+
+void DEploidIO::runWorkflow() {
+    if (this->doComputeLLK()) {
+        this->computeLLKfromInitialHap();
+    } else if (this->doLsPainting()) {
+        this->operation_chromPainting();
+    } else if (this->doIbdPainting()) {
+        this->operation_paintIBD();
+    } else if (this->doIbdViterbiPainting()) {
+        this->operation_paintIBDviterbi();
+    } else if (this->useLasso()) {  // DEploid-Lasso
+        this->workflow_lasso();
+    } else if (this->useBestPractice()) {  // best practice
+        this->workflow_best();
+    } else {  // classic version, and DEploid-IBD
+        this->workflow_ibd();
+    }
+}
+
+
+// One job per sample, written to the prefix followed by the sample name. The
+// jobs share the panel, PLAF and sites read once by the batch; they are run
+// side by side and the threads left over are given to each job.
+void DEploidIO::workflow_batch() {
+    size_t nSamples = this->vcfReaderPtr_->nBatchSamples();
+    size_t nWorkers = max(min(this->nThreads(), nSamples),
+                          static_cast<size_t>(1));
+    size_t jobThreads = this->nThreads() / nWorkers;
+    // The jobs only read the legit sites once they are found
+    this->vcfReaderPtr_->findLegitSnpsGivenVQSLOD(this->vqslod());
+
+    std::mutex logMutex;
+    runInParallel(nSamples, nWorkers, [&](size_t sampleI) {
+        DEploidIO job(*this, sampleI);
+        job.nThreads_.setUserDefined(jobThreads);
+        job.runWorkflow();
+
+        std::lock_guard <std::mutex> lock(logMutex);
+        job.wrapUp();
+    });
+    this->closeOutputBundle();
+}
 
 void DEploidIO::workflow_lasso() {
     this->dEploidLasso();
@@ -47,7 +92,7 @@ void DEploidIO::workflow_lasso() {
                                     &this->lassoPlafs.at(chromi),
                                     &this->lassoRefCount.at(chromi),
                                     &this->lassoAltCount.at(chromi),
-                                    this->lassoPanels.at(chromi),
+                                    this->lassoPanels.at(chromi).get(),
                                     &tmpIO,
                                     job,
                                     "lasso",
@@ -75,7 +120,7 @@ void DEploidIO::workflow_ibd() {
         McmcMachinery ibdMcmcMachinery(&this->plaf_,
                                        &this->refCount_,
                                        &this->altCount_,
-                                       this->panel,
+                                       this->panelToUpdate(),
                                        this,
                                        "DEploid-IBD",
                                        "ibd",
@@ -92,7 +137,7 @@ void DEploidIO::workflow_ibd() {
     McmcMachinery mcmcMachinery(&this->plaf_,
                         &this->refCount_,
                         &this->altCount_,
-                        this->panel,
+                        this->panelToUpdate(),
                         this,
                         "DEploid classic version",
                         "classic",  // brief
@@ -136,7 +181,7 @@ void DEploidIO::workflow_best() {
                                   &toLearnK.lassoPlafs.at(chromi),
                                   &toLearnK.lassoRefCount.at(chromi),
                                   &toLearnK.lassoAltCount.at(chromi),
-                                  toLearnK.lassoPanels.at(chromi),
+                                  toLearnK.lassoPanels.at(chromi).get(),
                                   &toLearnKtmp,
                                   job,
                                   job,
@@ -194,7 +239,7 @@ void DEploidIO::workflow_best() {
         McmcMachinery ibdMcmcMachinery(&tmpIO2.plaf_,
                               &tmpIO2.refCount_,
                               &tmpIO2.altCount_,
-                              tmpIO2.panel,
+                              tmpIO2.panelToUpdate(),
                               &tmpIO2,
                               string("DEploid-IBD learning proportion"),
                               string("ibd"),
@@ -259,7 +304,7 @@ void DEploidIO::workflow_best() {
                                     &this->lassoPlafs.at(chromi),
                                     &this->lassoRefCount.at(chromi),
                                     &this->lassoAltCount.at(chromi),
-                                    this->lassoPanels.at(chromi),
+                                    this->lassoPanels.at(chromi).get(),
                                     &dEploidLassoIO,
                                     job,
                                     job,
@@ -22,13 +22,17 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>      // std::find
 #include <ctime>
+#include <exception>      // std::exception_ptr
+#include <functional>     // std::function
 #include <iterator>
 #include <cassert>        // assert
 #include "utility.hpp"    // normailize by sum
 #include "dEploidIO.hpp"
 #include "ibd.hpp"
 #include "lasso/src/dEploidLasso.hpp"
+#include "parallel.hpp"
 
 DEploidIO::DEploidIO() {
     this->init();
@@ -64,9 +68,6 @@ DEploidIO::~DEploidIO() {
     if ( this->vcfReaderPtr_ != NULL ) {
         delete this->vcfReaderPtr_;
     }
-    if ( this->panel != NULL ) {
-        delete panel;
-    }
 }
 
 
@@ -94,13 +95,17 @@ void DEploidIO::init() {
     this->setDoExportRecombProb(false);
 
     this->setCompressVcf(false);
+    this->setPostProbFormat(POST_PROB_TEXT);
+    this->setCompressPostProb(false);
+    this->setUseOutputBundle(false);
+    this->outputBundle_.reset();
     this->setInitialPropWasGiven(false);
     this->setInitialHapWasGiven(false);
     this->initialProp.clear();
     this->setPleaseCheckInitialP(true);
     this->setExcludeSites( false );
     this->excludedMarkers = NULL;
-    this->panel = NULL;
+    this->panel.reset();
     this->set_help(false);
     this->setVersion(false);
     this->setUsePanel(true);
@@ -137,17 +142,21 @@ void DEploidIO::init() {
     this->vcfReaderPtr_ = NULL;
     this->setDoExportVcf(false);
     this->setDoComputeLLK(false);
+    this->setDoBatch(false);
+    this->batchSamples_.clear();
     this->setVqslod(8.0);
     this->setLassoMaxNumPanel(100);
+    this->ibdBufferBytes_ = 0;
 
     this->kStrain_.init(5);  // From DEploid-Lasso, set default K to 4.
     this->mcmcBurn_.init(0.5);
     this->mcmcMachineryRate_.init(5);
     this->missCopyProb_.init(0.01);
     this->nMcmcSample_.init(800);
-    this->precision_.init(8);
+    this->precision_.init(6);
     this->randomSeed_.init((unsigned)0);
     this->parameterSigma_.init(5.0);
+    this->nThreads_.init(1);
 
 
     #ifdef COMPILEDATE
@@ -200,6 +209,8 @@ void DEploidIO::reInit() {
     this->plafFileName_.clear();
     this->panelFileName_.clear();
     this->excludeFileName_.clear();
+    this->batchSamplesFileName_.clear();
+    this->siteCacheFileName_.clear();
     this->getTime(true);
 }
 
@@ -223,54 +234,164 @@ void DEploidIO::finalize() {
         throw VcfOutUnSpecified("");
     }
 
+    if ( this->compressPostProb() && this->postProbFormat() == POST_PROB_TEXT ) {
+        throw BinaryPostProbUnSpecified("");
+    }
+
     if ( !this->randomSeed_.useDefault() ) {
         this->randomSeed_.init((unsigned)(time(0)));
     }
 
-    if ( this->excludeSites() ) {
-        excludedMarkers = new ExcludeMarker();
-        excludedMarkers->readFromFile(excludeFileName_.c_str());
+    // The parsed sites are cached for later runs on the same inputs. The vcf
+    // output needs the vcf lines, and a batch the counts of every sample,
+    // so they always read the inputs.
+    bool useSiteCache = this->siteCacheFileName_.size() > 0 &&
+                        !this->doBatch() && !this->doExportVcf();
+    SiteCache siteCache(this->siteCacheFileName_);
+    bool sitesFromCache = false;
+    if ( useSiteCache ) {
+        this->initSiteCacheKey(siteCache);
+        sitesFromCache = siteCache.load();
     }
 
-    if ( useVcf() ) { // read vcf files, and parse it to refCount and altCount
-        this->vcfReaderPtr_ = new VcfReader (vcfFileName_, vcfSampleName_,
-            extractPlafFromVcf_);
-        if ( this->excludeSites() ) {
-            this->vcfReaderPtr_->findAndKeepMarkers (excludedMarkers);
+    this->readInputs(!sitesFromCache);
+    if ( sitesFromCache ) {
+        this->loadSites(siteCache);
+    } else if ( useSiteCache ) {
+        this->saveSites(siteCache);
+    }
+
+    // The jobs of a batch write to the bundle of the batch
+    if ( this->useOutputBundle() ) {
+        this->strExportBundle = this->prefix_ + ".bundle";
+        this->outputBundle_ = std::make_shared <OutputBundle> ();
+        this->outputBundle_->open(this->strExportBundle);
+    }
+
+    // Each job of a batch has its own output prefix
+    if ( !this->doBatch() ) {
+        (void)removeFilesWithSameName();
+    }
+
+    this->finalizePanel();
+    this->initEventCounts();
+}
+
+
+// Position of the last occurrence of flag on the command line
+size_t DEploidIO::flagPosition(const string &flag) const {
+    for (size_t i = this->argv_.size(); i > 0; i--) {
+        if (this->argv_[i-1] == flag) {
+            return i-1;
         }
-        this->vcfReaderPtr_->finalize(); // Finalize after remove variantlines
-        this->refCount_ = this->vcfReaderPtr_->refCount;
-        this->altCount_ = this->vcfReaderPtr_->altCount;
-    } else {
-        TxtReader ref;
-        ref.readFromFile(refFileName_.c_str());
+    }
+    return this->argv_.size();
+}
+
+
+// The exclude file, the read counts, the PLAF and the panel are independent
+// until their sites are matched, so they are read side by side on up to
+// -nThreads threads. The vcf, or the ref, alt and PLAF files, are filtered
+// as they are read, so they follow the exclude file on the same thread. If
+// several inputs fail, the error of the one given first on the command line
+// is thrown. The sites are only read withSites.
+void DEploidIO::readInputs(bool withSites) {
+    AlignedTxtReader refAltPlaf;
+    TxtReader plaf;
+    auto readExclude = [this]() {
+        this->excludedMarkers = new ExcludeMarker();
+        this->excludedMarkers->setRegions(this->regions_);
+        this->excludedMarkers->readFromFile(excludeFileName_.c_str());
+    };
+
+    // Inputs of a task are read in turn, up to the first that fails
+    typedef std::pair < string, std::function <void()> > InputRead;
+    vector < vector <InputRead> > tasks;
+    if ( withSites ) {
+        tasks.push_back(vector <InputRead> ());
         if ( this->excludeSites() ) {
-            ref.findAndKeepMarkers( excludedMarkers );
+            tasks.back().push_back(InputRead("-exclude", readExclude));
+        }
+        if ( this->doBatch() ) {
+            tasks.back().push_back(InputRead("-batchSamples", [this]() {
+                this->readBatchSamples(); }));
         }
-        this->refCount_ = ref.info_;
+        if ( useVcf() ) {
+            tasks.back().push_back(InputRead("-vcf", [this]() {
+                this->readVcf(); }));
+        } else {
+            tasks.back().push_back(InputRead("-ref", [&]() {
+                refAltPlaf.setNThreads(this->nThreads());
+                refAltPlaf.setRegions(this->regions_);
+                refAltPlaf.readFromFiles(this->refFileName_,
+                    this->altFileName_, this->plafFileName_,
+                    this->excludedMarkers); }));
+        }
+    } else if ( this->excludeSites() ) {
+        tasks.push_back(vector <InputRead> (1,
+            InputRead("-exclude", readExclude)));
+    }
+    if ( withSites && useVcf() && !extractPlafFromVcf() ) {
+        tasks.push_back(vector <InputRead> (1, InputRead("-plaf", [&]() {
+            plaf.setRegions(this->regions_);
+            plaf.readFromFile(this->plafFileName_.c_str()); })));
+    }
+    if ( this->usePanel() && !this->doIbdPainting() &&
+         !this->doComputeLLK() ) {
+        tasks.push_back(vector <InputRead> (1, InputRead("-panel", [this]() {
+            this->readPanel(); })));
+    }
 
-        TxtReader alt;
-        alt.readFromFile(altFileName_.c_str());
-        if ( this->excludeSites() ) {
-            alt.findAndKeepMarkers( excludedMarkers );
+    vector <std::exception_ptr> errors(tasks.size());
+    vector <size_t> errorFlagPositions(tasks.size(), this->argv_.size());
+    runInParallel(tasks.size(), this->nThreads(), [&](size_t taskI) {
+        for (auto const& input : tasks[taskI]) {
+            try {
+                input.second();
+            } catch (...) {
+                errors[taskI] = std::current_exception();
+                errorFlagPositions[taskI] = this->flagPosition(input.first);
+                return;
+            }
         }
-        this->altCount_ = alt.info_;
+    });
+    size_t firstErrorAt = tasks.size();
+    for (size_t taskI = 0; taskI < tasks.size(); taskI++) {
+        if ( errors[taskI] && (firstErrorAt == tasks.size() ||
+             errorFlagPositions[taskI] < errorFlagPositions[firstErrorAt]) ) {
+            firstErrorAt = taskI;
+        }
+    }
+    if ( firstErrorAt < tasks.size() ) {
+        std::rethrow_exception(errors[firstErrorAt]);
     }
 
-    this->nLoci_ = refCount_.size();
+    if ( !withSites ) {
+        return;
+    }
 
-    if ( this->nLoci_ != this->altCount_.size() ) {
-        throw LociNumberUnequal( this->altFileName_ );
+    if ( !useVcf() ) {
+        this->refCount_.swap(refAltPlaf.refCount_);
+        this->altCount_.swap(refAltPlaf.altCount_);
+        this->nLoci_ = refCount_.size();
+        this->plaf_.swap(refAltPlaf.plaf_);
+        this->chrom_.swap(refAltPlaf.chrom_);
+        this->position_.swap(refAltPlaf.position_);
+        this->indexOfChromStarts_.swap(refAltPlaf.indexOfChromStarts_);
+        return;
     }
 
+    this->refCount_ = this->vcfReaderPtr_->refCount;
+    this->altCount_ = this->vcfReaderPtr_->altCount;
+    this->vcfSampleName_ = this->vcfReaderPtr_->sampleName_;
+    this->nLoci_ = refCount_.size();
+
     if (extractPlafFromVcf()){
         this->plaf_ = this->vcfReaderPtr_->plaf;
         this->chrom_ = this->vcfReaderPtr_->chrom_;
         this->position_ = this->vcfReaderPtr_->position_;
         this->indexOfChromStarts_ = this->vcfReaderPtr_->indexOfChromStarts_;
     } else {
-        TxtReader plaf;
-        plaf.readFromFile(plafFileName_.c_str());
         if ( this->excludeSites() ) {
             plaf.findAndKeepMarkers( excludedMarkers );
         }
@@ -282,10 +403,97 @@ void DEploidIO::finalize() {
             throw LociNumberUnequal( this->plafFileName_ );
         }
     }
+}
+
+
+void DEploidIO::readVcf() {
+    // Excluded sites are dropped, and VQSLOD checked, as lines are read
+    VcfReadFilter vcfFilter;
+    if ( this->excludeSites() ) {
+        vcfFilter.excludedMarkers = excludedMarkers;
+    }
+    vcfFilter.regions = this->regions_;
+    vcfFilter.findLegitVqslod = true;
+    vcfFilter.vqslodThreshold = this->vqslod();
+    // A batch reads the counts of all its samples in the same pass
+    this->vcfReaderPtr_ = new VcfReader (vcfFileName_, vcfSampleName_,
+        extractPlafFromVcf_, this->nThreads(), vcfFilter,
+        this->doBatch() ? &this->batchSamples_ : NULL);
+    this->vcfReaderPtr_->finalize(); // Finalize after remove variantlines
+}
+
+
+void DEploidIO::initSiteCacheKey(SiteCache &siteCache) const {
+    if ( useVcf() ) {
+        siteCache.addInputFile("vcf", this->vcfFileName_);
+        siteCache.addOption("sample=" + this->vcfSampleName_);
+    } else {
+        siteCache.addInputFile("ref", this->refFileName_);
+        siteCache.addInputFile("alt", this->altFileName_);
+    }
+    if ( this->extractPlafFromVcf() ) {
+        siteCache.addOption("plafFromVcf");
+    } else {
+        siteCache.addInputFile("plaf", this->plafFileName_);
+    }
+    if ( this->excludeSites() ) {
+        siteCache.addInputFile("exclude", this->excludeFileName_);
+    }
+    for (auto const& region : this->regions_) {
+        siteCache.addOption("region=" + region.str());
+    }
+}
 
-    (void)removeFilesWithSameName();
 
-    this->readPanel();
+void DEploidIO::loadSites(const SiteCache &siteCache) {
+    this->refCount_ = siteCache.refCount;
+    this->altCount_ = siteCache.altCount;
+    this->plaf_ = siteCache.plaf;
+    this->chrom_ = siteCache.chrom;
+    this->position_ = siteCache.position;
+    this->nLoci_ = this->refCount_.size();
+    this->indexOfChromStarts_.clear();
+    size_t chromStart = 0;
+    for (auto const& positionOfChrom : this->position_) {
+        this->indexOfChromStarts_.push_back(chromStart);
+        chromStart += positionOfChrom.size();
+    }
+
+    // The VQSLOD trimming of -best and -lasso goes through the vcf reader
+    if ( siteCache.hasVcf ) {
+        this->vcfReaderPtr_ = new VcfReader(this->vcfFileName_,
+                                            siteCache.vcfSampleName,
+                                            siteCache.vcfChrom,
+                                            siteCache.vcfPosition);
+        this->vcfReaderPtr_->refCount = this->refCount_;
+        this->vcfReaderPtr_->altCount = this->altCount_;
+        this->vcfReaderPtr_->vqslod = siteCache.vqslod;
+        if ( this->extractPlafFromVcf() ) {
+            this->vcfReaderPtr_->plaf = this->plaf_;
+        }
+        this->vcfSampleName_ = siteCache.vcfSampleName;
+    }
+}
+
+
+void DEploidIO::saveSites(SiteCache &siteCache) const {
+    siteCache.refCount = this->refCount_;
+    siteCache.altCount = this->altCount_;
+    siteCache.plaf = this->plaf_;
+    siteCache.chrom = this->chrom_;
+    siteCache.position = this->position_;
+    siteCache.hasVcf = (this->vcfReaderPtr_ != NULL);
+    if ( siteCache.hasVcf ) {
+        siteCache.vcfSampleName = this->vcfReaderPtr_->sampleName_;
+        siteCache.vcfChrom = this->vcfReaderPtr_->chrom_;
+        siteCache.vcfPosition = this->vcfReaderPtr_->position_;
+        siteCache.vqslod = this->vcfReaderPtr_->vqslod;
+    }
+    siteCache.save();
+}
+
+
+void DEploidIO::initEventCounts() {
     IBDpathChangeAt = vector <double>(this->nLoci());
     finalIBDpathChangeAt = vector <double>(this->nLoci());
 
@@ -305,6 +513,71 @@ void DEploidIO::finalize() {
 }
 
 
+void DEploidIO::readBatchSamples() {
+    this->batchSamples_.clear();
+    if ( this->batchSamplesFileName_.size() == 0 ) {
+        return;
+    }
+    ifstream inFile(this->batchSamplesFileName_.c_str());
+    if ( !inFile.good() ) {
+        throw InvalidInputFile(this->batchSamplesFileName_);
+    }
+    string sample;
+    while ( getline(inFile, sample) ) {
+        if ( sample.size() > 0 && sample.back() == '\r' ) {
+            sample.pop_back();
+        }
+        if ( sample.size() == 0 || std::find(this->batchSamples_.begin(),
+                this->batchSamples_.end(), sample) != this->batchSamples_.end() ) {
+            continue;
+        }
+        this->batchSamples_.push_back(sample);
+    }
+    if ( this->batchSamples_.size() == 0 ) {
+        throw InvalidInputFile(this->batchSamplesFileName_);
+    }
+}
+
+
+DEploidIO::DEploidIO(const DEploidIO &batch, size_t batchSampleI) {
+    this->init();
+    this->argv_ = batch.argv_;
+    this->argv_i = argv_.begin();
+    this->reInit();
+    this->parse();
+    this->finalizeBatchJob(batch, batchSampleI);
+}
+
+
+// The flags are parsed again for each job, the checks done and the data read
+// by the batch are shared, except for the counts of the job's own sample.
+void DEploidIO::finalizeBatchJob(const DEploidIO &batch, size_t batchSampleI) {
+    if (useBestPractice()){
+        this->setBestPracticeParameters();
+    }
+    this->setIsCopied(true);
+    this->randomSeed_.makeCopy(batch.randomSeed_);
+    this->excludedMarkers = batch.excludedMarkers;
+    this->vcfReaderPtr_ = batch.vcfReaderPtr_;
+    this->panel = batch.panel;
+    this->outputBundle_ = batch.outputBundle_;
+    this->strExportBundle = batch.strExportBundle;
+
+    this->vcfSampleName_ = this->vcfReaderPtr_->batchSampleName(batchSampleI);
+    this->prefix_ = batch.prefix_ + "." + this->vcfSampleName_;
+    this->vcfReaderPtr_->batchCounts(batchSampleI, this->refCount_,
+                                     this->altCount_);
+    this->nLoci_ = this->refCount_.size();
+    this->plaf_ = batch.plaf_;
+    this->chrom_ = batch.chrom_;
+    this->position_ = batch.position_;
+    this->indexOfChromStarts_ = batch.indexOfChromStarts_;
+
+    (void)removeFilesWithSameName();
+    this->initEventCounts();
+}
+
+
 void DEploidIO::removeFilesWithSameName() {
     //strExportProp = this->prefix_ + ".prop";
     //strExportLLK = this->prefix_ + ".llk";
@@ -338,9 +611,9 @@ void DEploidIO::removeFilesWithSameName() {
         //remove(strExportHap.c_str());
         //remove(strExportVcf.c_str());
         //remove(strExportProp.c_str());
-        remove(strExportExtra.c_str());
-        remove(strIbdExportProbs.c_str());
-        remove(strIbdExportViterbi.c_str());
+        this->removeOutput(strExportExtra);
+        this->removeOutput(strIbdExportProbs);
+        this->removeOutput(strIbdExportViterbi);
     }
 
     if (this->doLsPainting() || this->doExportPostProb() ) {
@@ -348,22 +621,45 @@ void DEploidIO::removeFilesWithSameName() {
             strIbdExportSingleFwdProbPrefix = this->prefix_ + ".ibd.single";
             for ( size_t i = 0; i < this->kStrain_.getValue() ; i++ ) {
                 string tmpStrExportSingleFwdProb = strIbdExportSingleFwdProbPrefix + to_string(i);
-                remove(tmpStrExportSingleFwdProb.c_str());
+                this->removeOutput(tmpStrExportSingleFwdProb);
             }
             strIbdExportPairFwdProb = this->prefix_ + ".ibd.pair";
-            remove(strIbdExportPairFwdProb.c_str());
+            this->removeOutput(strIbdExportPairFwdProb);
         }
         strExportSingleFwdProbPrefix = this->prefix_ + ".single";
         for ( size_t i = 0; i < this->kStrain_.getValue() ; i++ ) {
             string tmpStrExportSingleFwdProb = strExportSingleFwdProbPrefix + to_string(i);
-            remove(tmpStrExportSingleFwdProb.c_str());
+            this->removeOutput(tmpStrExportSingleFwdProb);
         }
         strExportPairFwdProb = this->prefix_ + ".pair";
-        remove(strExportPairFwdProb.c_str());
+        this->removeOutput(strExportPairFwdProb);
     }
-    remove(strExportLog.c_str());
-    remove(strExportRecombProb.c_str());
+    this->removeOutput(strExportLog);
+    this->removeOutput(strExportRecombProb);
+
+}
+
 
+void DEploidIO::openOutput(OutputFile &file, const string &fileName,
+                           bool append, bool compress) {
+    file.open(fileName, append, compress, this->outputBundle_.get());
+}
+
+
+void DEploidIO::removeOutput(const string &fileName) {
+    if ( this->outputBundle_ != NULL ) {
+        this->outputBundle_->removeSection(fileName);
+    } else {
+        remove(fileName.c_str());
+    }
+}
+
+
+// Closed by the run, or by the batch once all its jobs are done
+void DEploidIO::closeOutputBundle() {
+    if ( this->outputBundle_ != NULL ) {
+        this->outputBundle_->close();
+    }
 }
 
 
@@ -389,13 +685,29 @@ void DEploidIO::parse () {
             if (useVcf() == false){
                 throw(FlagsOrderIncorrect((*argv_i) , "-vcf") );
             }
+            if ( this->doBatch() ) {
+                throw ( FlagsConflict((*argv_i) , "-batch or -batchSamples") );
+            }
             this->setUseVcfSample(true);
             this->readNextStringto ( this->vcfSampleName_ ) ;
+        } else if (*argv_i == "-batch" || *argv_i == "-batchSamples") {
+            if (useVcf() == false){
+                throw(FlagsOrderIncorrect((*argv_i) , "-vcf") );
+            }
+            if ( this->useVcfSample() ) {
+                throw ( FlagsConflict((*argv_i) , "-sample") );
+            }
+            if (*argv_i == "-batchSamples") {
+                this->readNextStringto ( this->batchSamplesFileName_ ) ;
+            }
+            this->setDoBatch(true);
         } else if (*argv_i == "-plafFromVcf") {
             if (useVcf() == false){
                 throw(FlagsOrderIncorrect((*argv_i) , "-vcf") );
             }
             this->setExtractPlafFromVcf(true);
+        } else if (*argv_i == "-siteCache") {
+            this->readNextStringto ( this->siteCacheFileName_ ) ;
         } else if (*argv_i == "-vcfOut") {
             this->setDoExportVcf (true);
         } else if (*argv_i == "-plaf") {
@@ -426,6 +738,15 @@ void DEploidIO::parse () {
         } else if (*argv_i == "-exclude") {
             this->setExcludeSites( true );
             this->readNextStringto ( this->excludeFileName_ ) ;
+        } else if (*argv_i == "-region") {
+            // the initial haplotypes are read as their flag is parsed
+            if ( this->initialHap.size() > 0 ) {
+                throw ( FlagsOrderIncorrect("-initialHap or -painting",
+                                            (*argv_i)) );
+            }
+            string region;
+            this->readNextStringto ( region ) ;
+            this->regions_.push_back(GenomicRegion(region));
         } else if (*argv_i == "-o") {
             this->readNextStringto ( this->prefix_ ) ;
         } else if ( *argv_i == "-p" ) {
@@ -500,6 +821,20 @@ void DEploidIO::parse () {
                 throw ( FlagsConflict((*argv_i) , "-noPanel") );
             }
             this->setDoExportPostProb( true );
+        } else if ( *argv_i == "-postProbFormat" ) {
+            string format;
+            this->readNextStringto ( format ) ;
+            if ( format == "text" ) {
+                this->setPostProbFormat( POST_PROB_TEXT );
+            } else if ( format == "float32" ) {
+                this->setPostProbFormat( POST_PROB_FLOAT32 );
+            } else if ( format == "uint16" ) {
+                this->setPostProbFormat( POST_PROB_UINT16 );
+            } else {
+                throw ( UnknownPostProbFormat(format) );
+            }
+        } else if ( *argv_i == "-zPostProb" ) {
+            this->setCompressPostProb(true);
         } else if ( *argv_i == "-painting" ) {
             if ( this->usePanel() == false ) {
                 throw ( FlagsConflict((*argv_i) , "-noPanel") );
@@ -594,6 +929,13 @@ void DEploidIO::parse () {
             this->readInitialHaps();
         } else if ( *argv_i == "-seed") {
             this->randomSeed_.setUserDefined(readNextInput<size_t>());
+        } else if ( *argv_i == "-nThreads" ) {
+            this->nThreads_.setUserDefined(readNextInput<size_t>());
+            if ( this->nThreads_.getValue() == 0 ) {
+                throw ( OutOfRange ("-nThreads", *argv_i) );
+            }
+        } else if ( *argv_i == "-bundle" ) {
+            this->setUseOutputBundle(true);
         } else if ( *argv_i == "-z" ) {
             this->setCompressVcf(true);
         } else if ( *argv_i == "-h" || *argv_i == "-help") {
@@ -675,6 +1017,7 @@ std::ostream& operator<< (std::ostream& stream, const DEploidIO& dEploidIO) {
 void DEploidIO::readInitialHaps() {
     assert( this->initialHap.size() == 0 );
     InitialHaplotypes initialHapToBeRead;
+    initialHapToBeRead.setRegions(this->regions_);
     initialHapToBeRead.readFromFile(this->initialHapFileName_.c_str());
 
     assert (this->initialHap.size() == 0 );
@@ -728,15 +1071,17 @@ void DEploidIO::computeLLKfromInitialHap() {
 
 
 void DEploidIO::readPanel() {
-    if ( this->usePanel() == false ) {
-        return;
-    }
-    if ( this->doIbdPainting() || this->doComputeLLK() ) {
+    panel.reset(new Panel());
+    panel->setNThreads(this->nThreads());
+    panel->setRegions(this->regions_);
+    panel->readFromFile(this->panelFileName_.c_str());
+}
+
+
+void DEploidIO::finalizePanel() {
+    if ( this->panel == NULL ) {
         return;
     }
-
-    panel = new Panel();
-    panel->readFromFile(this->panelFileName_.c_str());
     if ( this->excludeSites() ) {
         panel->findAndKeepMarkers( this->excludedMarkers );
     }
@@ -746,10 +1091,24 @@ void DEploidIO::readPanel() {
 }
 
 
+// The chains write the strains into the panel when inbreeding is allowed, so
+// a panel shared with other copies is copied before it is handed to them.
+Panel * DEploidIO::panelToUpdate() {
+    if ( this->doAllowInbreeding() && this->panel.use_count() > 1 ) {
+        this->panel.reset(new Panel(*this->panel));
+    }
+    return this->panel.get();
+}
+
+
 DEploidIO::DEploidIO(const DEploidIO &cpFrom) {
     this->setIsCopied(true);
     this->setDoExportRecombProb(cpFrom.doExportRecombProb());
     this->setCompressVcf(cpFrom.compressVcf());
+    this->setPostProbFormat(cpFrom.postProbFormat());
+    this->setCompressPostProb(cpFrom.compressPostProb());
+    this->setUseOutputBundle(cpFrom.useOutputBundle());
+    this->outputBundle_ = cpFrom.outputBundle_;
     this->setInitialPropWasGiven(cpFrom.initialPropWasGiven());
     this->setInitialHapWasGiven(cpFrom.initialHapWasGiven());
     this->initialProp = vector <double> (cpFrom.initialProp.begin(),
@@ -785,8 +1144,11 @@ DEploidIO::DEploidIO(const DEploidIO &cpFrom) {
     this->setIBDSigma(cpFrom.ibdSigma());
     this->setUseVcf(cpFrom.useVcf());
     this->vcfReaderPtr_ = cpFrom.vcfReaderPtr_;
+    this->vcfSampleName_ = cpFrom.vcfSampleName_;
+    this->setDoBatch(cpFrom.doBatch());
     this->setDoExportVcf(cpFrom.doExportVcf());
     this->setDoComputeLLK(cpFrom.doComputeLLK());
+    this->ibdBufferBytes_ = 0;
     this->setNLoci(cpFrom.nLoci());
     this->refCount_ = vector <double> (cpFrom.refCount_.begin(),
                                        cpFrom.refCount_.end());
@@ -801,6 +1163,8 @@ DEploidIO::DEploidIO(const DEploidIO &cpFrom) {
     this->indexOfChromStarts_ = vector <size_t> (cpFrom.indexOfChromStarts_.begin(),
                                    cpFrom.indexOfChromStarts_.end());
     this->setVqslod(cpFrom.vqslod());
+    this->regions_ = cpFrom.regions_;
+    this->siteCacheFileName_ = cpFrom.siteCacheFileName_;
     this->setLassoMaxNumPanel(cpFrom.lassoMaxNumPanel());
     //this->strExportProp = cpFrom.strExportProp;
     //this->strExportLLK = cpFrom.strExportLLK;
@@ -817,26 +1181,7 @@ DEploidIO::DEploidIO(const DEploidIO &cpFrom) {
     this->parameterSigma_.makeCopy(cpFrom.parameterSigma_);
     this->mcmcBurn_.makeCopy(cpFrom.mcmcBurn_);
     this->mcmcMachineryRate_.makeCopy(cpFrom.mcmcMachineryRate_);
-}
-
-
-void DEploidIO::getIBDprobsIntegrated(vector < vector <double> > &prob) {
-    if (prob.size() !=  this->nLoci()) {
-        throw InvalidInput("Invalid probabilities! Check size!");
-    }
-
-    assert(this->ibdProbsIntegrated.size() == 0);
-
-    for (size_t i = 0; i < prob[0].size(); i++) {
-        this->ibdProbsIntegrated.push_back(0.0);
-    }
-
-    for ( size_t siteIndex = 0; siteIndex < this->nLoci(); siteIndex++ ) {
-        for (size_t i = 0; i < prob[siteIndex].size(); i++) {
-            this->ibdProbsIntegrated[i] += prob[siteIndex][i];
-        }
-    }
-    normalizeBySum(this->ibdProbsIntegrated);
+    this->nThreads_.makeCopy(cpFrom.nThreads_);
 }
 
 
@@ -914,20 +1259,21 @@ void DEploidIO::dEploidLasso() {
             newPanel.push_back(tmpRow);
         }
 
-        Panel * tmp = new Panel(vecFromTo(this->panel->pRec_, start, end),
+        std::shared_ptr <Panel> tmp(new Panel(
+                            vecFromTo(this->panel->pRec_, start, end),
                             vecFromTo(this->panel->pRecEachHap_, start, end),
                             vecFromTo(this->panel->pNoRec_, start, end),
                             vecFromTo(this->panel->pRecRec_, start, end),
                             vecFromTo(this->panel->pRecNoRec_, start, end),
                             vecFromTo(this->panel->pNoRecNoRec_, start, end),
                             newPanel,
-                            this->panel->header_);
+                            this->panel->header_));
         lassoPanels.push_back(tmp);
         lassoPlafs.push_back(vecFromTo(plaf_, start, end));
         lassoRefCount.push_back(vecFromTo(refCount_, start, end));
         lassoAltCount.push_back(vecFromTo(altCount_, start, end));
         if (this->doPrintLassoPanel()) {
-            this->writePanel(tmp, chromi, newHeader);
+            this->writePanel(tmp.get(), chromi, newHeader);
         }
     }
     this->finalProp.clear();
@@ -939,14 +1285,11 @@ void DEploidIO::dEploidLasso() {
 
 void DEploidIO::trimVec(vector <double> &vec, vector <size_t> &idx) {
     vector <double> ret;
+    ret.reserve(idx.size());
     for (auto const& value : idx){
         ret.push_back(vec[value]);
     }
-    //return ret;
-    vec.clear();
-    for (auto const& value : ret){
-        vec.push_back(value);
-    }
+    vec.swap(ret);
 }
 
 
@@ -963,12 +1306,18 @@ void DEploidIO::trimming(vector <size_t> & trimmingCriteria) {
     vector < vector < int > > oldposition = this->position_;
     this->position_.clear();
 
+    // trimmingCriteria is sorted, so it is walked along with the sites
+    size_t criteriaI = 0;
     for (size_t chromI = 0; chromI < oldChrom.size(); chromI++) {
         size_t hapIndex = indexOfChromStarts_[chromI];
         vector <int> newTrimmedPos;
         for (size_t posI = 0; posI < oldposition[chromI].size(); posI++) {
-            if (std::find(trimmingCriteria.begin(),trimmingCriteria.end(), hapIndex)
-                    != trimmingCriteria.end()){
+            while (criteriaI < trimmingCriteria.size() &&
+                   trimmingCriteria[criteriaI] < hapIndex) {
+                criteriaI++;
+            }
+            if (criteriaI < trimmingCriteria.size() &&
+                trimmingCriteria[criteriaI] == hapIndex){
                 if (newTrimmedPos.size() == 0) {
                     this->chrom_.push_back(oldChrom[chromI]);
                 }
@@ -1006,14 +1355,20 @@ void DEploidIO::trimmingHalf(vector <size_t> & trimmingCriteria) {
     vector < vector < int > > oldposition = this->position_;
     this->position_.clear();
 
+    // trimmingCriteria is sorted, so it is walked along with the sites
+    size_t criteriaI = 0;
     for (size_t chromI = 0; chromI < oldChrom.size(); chromI++) {
         if (chromI > 10) {
         //if (chromI%2 == 0) {
             size_t hapIndex = indexOfChromStarts_[chromI];
             vector <int> newTrimmedPos;
             for (size_t posI = 0; posI < oldposition[chromI].size(); posI++) {
-                if (std::find(trimmingCriteria.begin(),trimmingCriteria.end(), hapIndex)
-                        != trimmingCriteria.end()){
+                while (criteriaI < trimmingCriteria.size() &&
+                       trimmingCriteria[criteriaI] < hapIndex) {
+                    criteriaI++;
+                }
+                if (criteriaI < trimmingCriteria.size() &&
+                    trimmingCriteria[criteriaI] == hapIndex){
                     if (newTrimmedPos.size() == 0) {
                         this->chrom_.push_back(oldChrom[chromI]);
                     }
@@ -1050,10 +1405,9 @@ void DEploidIO::computeObsWsaf() {
 
 void DEploidIO::dEploidLassoTrimfirst() {  // This is trimming using VQSLOD
     if (vcfReaderPtr_ == NULL){
-        panel = new Panel (*panel);
+        panel.reset(new Panel (*panel));
         panel->computeRecombProbs(this->averageCentimorganDistance(), this->parameterG(), true, 0.0000001, this->forbidCopyFromSame());
         this->dEploidLasso();
-        this->setIsCopied(false);
         this->excludedMarkers = NULL;
         return;
     }
@@ -1061,11 +1415,9 @@ void DEploidIO::dEploidLassoTrimfirst() {  // This is trimming using VQSLOD
     this->vcfReaderPtr_->findLegitSnpsGivenVQSLOD(this->vqslod());
     this->trimming(this->vcfReaderPtr_->legitVqslodAt);
 
-    panel = new Panel (*panel);
-    panel->computeRecombProbs(this->averageCentimorganDistance(), this->parameterG(), true, 0.0000001, this->forbidCopyFromSame());
-    panel->findAndKeepMarkersGivenIndex(this->vcfReaderPtr_->legitVqslodAt);
+    RecombProbsParameters constRecomb(this->averageCentimorganDistance(), this->parameterG(), true, 0.0000001, this->forbidCopyFromSame());
+    panel.reset(new Panel (*panel, this->vcfReaderPtr_->legitVqslodAt, &constRecomb));
     this->dEploidLasso();
-    this->setIsCopied(false);
     this->excludedMarkers = NULL;
     this->vcfReaderPtr_ = NULL;
 }
@@ -1110,16 +1462,15 @@ tmpRow.push_back(static_cast<int>(0));
         newPanel.push_back(tmpRow);
     }
 
-    panel = new Panel(tmpPanel.pRec_,
-                      tmpPanel.pRecEachHap_,
-                      tmpPanel.pNoRec_,
-                      tmpPanel.pRecRec_,
-                      tmpPanel.pRecNoRec_,
-                      tmpPanel.pNoRecNoRec_,
-                      newPanel,
-                      newHeader);
+    panel.reset(new Panel(tmpPanel.pRec_,
+                          tmpPanel.pRecEachHap_,
+                          tmpPanel.pNoRec_,
+                          tmpPanel.pRecRec_,
+                          tmpPanel.pRecNoRec_,
+                          tmpPanel.pNoRecNoRec_,
+                          newPanel,
+                          newHeader));
 
-    this->setIsCopied(false);
     this->excludedMarkers = NULL;
     this->vcfReaderPtr_ = NULL;
 }
@@ -1127,8 +1478,6 @@ tmpRow.push_back(static_cast<int>(0));
 
 void DEploidIO::ibdTrimming() {
     if (vcfReaderPtr_ == NULL){
-        panel = new Panel(*panel);
-        this->setIsCopied(false);
         this->excludedMarkers = NULL;
         return;
     }
@@ -1137,11 +1486,8 @@ void DEploidIO::ibdTrimming() {
     this->vcfReaderPtr_->findLegitSnpsGivenVQSLOD(this->vqslod());
     //cout << "stop here" <<endl;
     this->trimming(this->vcfReaderPtr_->legitVqslodAt);
-    panel = new Panel(*panel);
-    this->panel->findAndKeepMarkersGivenIndex(
-                                        this->vcfReaderPtr_->legitVqslodAt);
+    panel.reset(new Panel(*panel, this->vcfReaderPtr_->legitVqslodAt, NULL));
 
-    this->setIsCopied(false);
     this->excludedMarkers = NULL;
     this->vcfReaderPtr_ = NULL;
 }
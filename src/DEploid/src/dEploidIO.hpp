@@ -24,6 +24,7 @@
  */
 
 #include <vector>
+#include <memory>
 #include <fstream>
 #include <stdlib.h>             // strtol, strtod
 #include <stdexcept>            // std::invalid_argument
@@ -33,6 +34,10 @@
 #include "exceptions.hpp"
 #include "panel.hpp"
 #include "vcfReader.hpp"
+#include "siteCache.hpp"
+#include "outputFile.hpp"
+#include "outputBundle.hpp"
+#include "postProbFile.hpp"
 #include "chooseK.hpp"
 #include "param.hpp"
 
@@ -77,6 +82,8 @@ class DEploidIO{
     bool doIbdViterbiPainting() const { return this->doIbdViterbiPainting_;}
     bool doComputeLLK() const { return this->doComputeLLK_; }
     void computeLLKfromInitialHap();
+    // Deconvolute every sample of the vcf, or those listed, in one run
+    bool doBatch() const { return this->doBatch_; }
 
     // choose which version of deploid to use
     bool useIBD() const { return this->useIBD_;}
@@ -87,7 +94,7 @@ class DEploidIO{
     bool inferBestPracticeHap() const { return this->inferBestPracticeHap_;}
 
     double ibdLLK_;
-    void getIBDprobsIntegrated(vector < vector <double> > &prob);
+    size_t ibdBufferBytes_;
     // Lasso related
     void dEploidLasso();
     void dEploidLassoTrimfirst();
@@ -104,13 +111,15 @@ class DEploidIO{
     vector <double> plaf_;
     vector <double> refCount_;
     vector <double> altCount_;
-    Panel *panel;
+    // Shared by the copies, see panelToUpdate
+    std::shared_ptr <Panel> panel;
+    Panel * panelToUpdate();
     vector < size_t > indexOfChromStarts_;
     vector < vector < int > > position_;
 
     // Lasso Related
     //vector < vector < vector <double> > > lassoPanels;
-    vector < Panel* > lassoPanels;
+    vector < std::shared_ptr <Panel> > lassoPanels;
     vector < vector <double> > lassoPlafs;
     vector < vector <double> > lassoRefCount;
     vector < vector <double> > lassoAltCount;
@@ -139,12 +148,19 @@ class DEploidIO{
     void workflow_lasso();
     void workflow_ibd();
     void workflow_best();
+    void workflow_batch();
+    void runWorkflow();
 
     // Make this public so it is also accessible from
     Parameter <size_t> randomSeed_;
     bool randomSeedWasSet() const {return this->randomSeed_.useUserDefined(); }
 
+    size_t nThreads() const { return this->nThreads_.getValue(); }
+    size_t precision() const { return this->precision_.getValue(); }
+
   private:
+    // A job of a batch, which shares the data read by the batch
+    DEploidIO(const DEploidIO &batch, size_t batchSampleI);
     void setBestPracticeParameters();
     void core();
     double llkFromInitialHap_;
@@ -158,6 +174,9 @@ class DEploidIO{
     string excludeFileName_;
     string initialHapFileName_;
     string prefix_;
+    // Only sites in these regions are read, from every input
+    vector <GenomicRegion> regions_;
+    string siteCacheFileName_;
 
 
 
@@ -224,6 +243,19 @@ class DEploidIO{
     void setCompressVcf( const bool compress ) { this->compressVcf_ = compress; }
     bool compressVcf() const { return this->compressVcf_; }
 
+    PostProbFormat postProbFormat_;
+    void setPostProbFormat( const PostProbFormat format ) { this->postProbFormat_ = format; }
+    PostProbFormat postProbFormat() const { return this->postProbFormat_; }
+    bool compressPostProb_;
+    void setCompressPostProb( const bool compress ) { this->compressPostProb_ = compress; }
+    bool compressPostProb() const { return this->compressPostProb_; }
+
+    bool useOutputBundle_;
+    void setUseOutputBundle( const bool setTo ) { this->useOutputBundle_ = setTo; }
+    bool useOutputBundle() const { return this->useOutputBundle_; }
+    // Shared by the copies and the jobs of a batch
+    std::shared_ptr <OutputBundle> outputBundle_;
+
     bool doExportRecombProb_;
     void setDoExportRecombProb( const bool exportRecombProb ) { this->doExportRecombProb_ = exportRecombProb; }
     bool doExportRecombProb() const { return this->doExportRecombProb_; }
@@ -231,6 +263,14 @@ class DEploidIO{
     bool doComputeLLK_;
     void setDoComputeLLK( const bool setTo ) { this->doComputeLLK_ = setTo; }
 
+    // Batch related
+    bool doBatch_;
+    void setDoBatch( const bool setTo ) { this->doBatch_ = setTo; }
+    string batchSamplesFileName_;
+    vector <string> batchSamples_;  // Empty for every sample of the vcf
+    void readBatchSamples();
+    void finalizeBatchJob(const DEploidIO &batch, size_t batchSampleI);
+
 
 
     // Parameters
@@ -242,6 +282,7 @@ class DEploidIO{
 
     Parameter <double> missCopyProb_;
     Parameter <double> parameterSigma_;
+    Parameter <size_t> nThreads_;
 
 
     double averageCentimorganDistance_;// = 15000.0,
@@ -291,9 +332,10 @@ class DEploidIO{
     string strIbdExportPairFwdProb;
 
     string strExportExtra;
+    string strExportBundle;
 
-    ofstream ofstreamExportTmp;
-    ofstream ofstreamExportFwdProb;
+    OutputFile exportFwdProbFile_;
+    PostProbFile exportFwdProbBinaryFile_;
 
     string startingTime_;
     string endTime_;
@@ -307,11 +349,23 @@ class DEploidIO{
     void parse ();
     void checkInput();
     void finalize();
+    size_t flagPosition(const string &flag) const;
+    void readInputs(bool withSites);
+    void readVcf();
+    void initSiteCacheKey(SiteCache &siteCache) const;
+    void loadSites(const SiteCache &siteCache);
+    void saveSites(SiteCache &siteCache) const;
+    void initEventCounts();
     void readNextStringto( string &readto );
     void readInitialProportions();
     void readInitialHaps();
 
     void removeFilesWithSameName();
+    // Output files are sections of the bundle, if there is one
+    void openOutput(OutputFile &file, const string &fileName,
+                    bool append = false, bool compress = false);
+    void removeOutput(const string &fileName);
+    void closeOutputBundle();
     vector <double> computeExpectedWsafFromInitialHap();
 
 
@@ -387,7 +441,8 @@ class DEploidIO{
 
     // log and export resutls
     void writeRecombProb ( Panel * panel );
-    void writeIBDpostProb(vector < vector <double> > & reshapedProbs, vector <string> header);
+    void writeIBDpostProbHeader(OutputFile * writeTo, const vector <string> &header);
+    void writeIBDpostProbAtSite(OutputFile * writeTo, size_t chromIndex, size_t posI, const double * probs, size_t nPattern);
     void writeIBDviterbi(vector <size_t> & viterbiState);
     vector <string> ibdProbsHeader;
     vector <double> ibdProbsIntegrated;
@@ -420,6 +475,7 @@ class DEploidIO{
 
     void writeMcmcRelated (McmcSample * mcmcSample, string jobbrief, bool useIBD = false);
     void readPanel();
+    void finalizePanel();
 
     // Panel related
     string panelFileName_;
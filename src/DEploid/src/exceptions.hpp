@@ -118,6 +118,24 @@ struct VcfOutUnSpecified : public InvalidInput{
 };
 
 
+struct BinaryPostProbUnSpecified : public InvalidInput{
+  explicit BinaryPostProbUnSpecified(string str):InvalidInput(str) {
+    this->reason = "Flag \"-zPostProb\" needs \"-postProbFormat float32\" or \"uint16\".";
+    throwMsg = this->reason + this->src;
+  }
+  ~BinaryPostProbUnSpecified() throw() {}
+};
+
+
+struct UnknownPostProbFormat : public InvalidInput{
+  explicit UnknownPostProbFormat(string str):InvalidInput(str) {
+    this->reason = "Unknown posterior probability format, expecting text, float32 or uint16: ";
+    throwMsg = this->reason + this->src;
+  }
+  ~UnknownPostProbFormat() throw() {}
+};
+
+
 struct WrongType : public InvalidInput{
   explicit WrongType(string str):InvalidInput(str) {
     this->reason = "Wrong type for parsing: ";
@@ -165,6 +183,15 @@ struct InvalidInputFile : public InvalidInput{
 };
 
 
+struct CannotWriteFile : public InvalidInput{
+  explicit CannotWriteFile(string str):InvalidInput(str) {
+    this->reason = "Cannot write file: ";
+    throwMsg = this->reason + this->src;
+  }
+  ~CannotWriteFile() throw() {}
+};
+
+
 struct FileNameMissing : public InvalidInput{
   explicit FileNameMissing(string str):InvalidInput(str) {
     this->reason = " file path missing!";
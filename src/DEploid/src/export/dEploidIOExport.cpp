@@ -28,7 +28,7 @@
 
 
 void DEploidIO::wrapUp() {
-    this->writeRecombProb( panel );
+    this->writeRecombProb( panel.get() );
 
     // Get End time before writing the log
     this->getTime(false);
@@ -39,10 +39,15 @@ void DEploidIO::wrapUp() {
 
     this->writeLog (&std::cout);
 
-    ofstreamExportTmp.open(strExportLog.c_str(),
-        ios::out | ios::app | ios::binary);
-    this->writeLog (&ofstreamExportTmp);
-    ofstreamExportTmp.close();
+    std::ostringstream log;
+    this->writeLog (&log);
+    OutputFile logFile;
+    this->openOutput(logFile, strExportLog, true);
+    logFile << log.str();
+    logFile.close();
+    if ( !this->doBatch() ) {
+        this->closeOutputBundle();
+    }
 }
 
 
@@ -50,23 +55,24 @@ void DEploidIO::writeRecombProb(Panel * panel) {
     if (!doExportRecombProb()) return;
 
     if ( panel != NULL ) {
-        ofstreamExportTmp.open(strExportRecombProb.c_str(),
-            ios::out | ios::app | ios::binary );
-        ofstreamExportTmp << "p.recomb"       << "\t"
-                                 << "p.each"         << "\t"
-                                 << "p.no.recomb"    << "\t"
-                                 << "p.rec.rec"      << "\t"
-                                 << "p.rec.norec"    << "\t"
-                                 << "p.norec.norec"  << "\n";
+        OutputFile writeTo;
+        writeTo.setPrecision(this->precision());
+        this->openOutput(writeTo, strExportRecombProb, true);
+        writeTo << "p.recomb"       << "\t"
+                << "p.each"         << "\t"
+                << "p.no.recomb"    << "\t"
+                << "p.rec.rec"      << "\t"
+                << "p.rec.norec"    << "\t"
+                << "p.norec.norec"  << "\n";
         for ( size_t i = 0; i < panel->pRec_.size(); i++ ) {
-            ofstreamExportTmp << panel->pRec_[i]           << "\t"
-                                     << panel->pRecEachHap_[i]    << "\t"
-                                     << panel->pNoRec_[i]         << "\t"
-                                     << panel->pRecRec_[i]        << "\t"
-                                     << panel->pRecNoRec_[i]      << "\t"
-                                     << panel->pNoRecNoRec_[i]    << "\n";
+            writeTo << panel->pRec_[i]           << "\t"
+                    << panel->pRecEachHap_[i]    << "\t"
+                    << panel->pNoRec_[i]         << "\t"
+                    << panel->pRecRec_[i]        << "\t"
+                    << panel->pRecNoRec_[i]      << "\t"
+                    << panel->pNoRecNoRec_[i]    << "\n";
         }
-        ofstreamExportTmp.close();
+        writeTo.close();
     }
 }
 
@@ -93,9 +99,13 @@ void DEploidIO::writeLog ( ostream * writeTo ) {
     }
     (*writeTo) << setw(12) << "PLAF: "      << plafFileName_   << "\n";
     if ( useVcf() ) (*writeTo) << setw(12) << "VCF: " << vcfFileName_    << "\n";
+    if ( doBatch() ) (*writeTo) << setw(12) << "Sample: " << vcfSampleName_    << "\n";
     if ( refFileName_.size()>0) (*writeTo) << setw(12) << "REF count: " << refFileName_    << "\n";
     if ( altFileName_.size()>0) (*writeTo) << setw(12) << "ALT count: " << altFileName_    << "\n";
     if ( excludeSites() ) { (*writeTo) << setw(12) << "Exclude: " << excludeFileName_    << "\n"; }
+    for (auto const& region : this->regions_) {
+        (*writeTo) << setw(12) << "Region: " << region.str() << "\n";
+    }
     (*writeTo) << "\n";
     if ( (this->doLsPainting() == false) & (this->doIbdPainting() == false) ) {
         (*writeTo) << "MCMC parameters: "<< "\n";
@@ -126,6 +136,10 @@ void DEploidIO::writeLog ( ostream * writeTo ) {
     }
     (*writeTo) << setw(20) << " ScalingFactor: "    << this->scalingFactor() << "\n";
     (*writeTo) << setw(20) << " VQSLOD:        "    << this->vqslod() << "\n";
+    if ( this->ibdBufferBytes_ > 0 ) {
+        (*writeTo) << setw(20) << " IBD buffers: "
+                   << this->ibdBufferBytes_ / 1048576.0 << " MB\n";
+    }
     if ( this->initialPropWasGiven() ) {
         (*writeTo) << setw(20) << " Initial prob: " ;
         for ( size_t i = 0; i < this->initialProp.size(); i++ ) {
@@ -161,6 +175,9 @@ void DEploidIO::writeLog ( ostream * writeTo ) {
         (*writeTo) << "\n";
     } else {
         (*writeTo) << "Output saved to:\n";
+        if ( this->outputBundle_ != NULL ) {
+            (*writeTo) << setw(14) << "Bundle: " << strExportBundle << "\n";
+        }
         if ( this->doLsPainting() ) {
             for ( size_t i = 0; i < kStrain_.getValue(); i++ ) {
                 (*writeTo) << "Posterior probability of strain " << i << ": "<< strExportSingleFwdProbPrefix << i <<endl;
@@ -226,11 +243,12 @@ void DEploidIO::writeLog ( ostream * writeTo ) {
 
 
 void DEploidIO::writeEventCount() {
-    ofstreamExportTmp.open(strExportExtra.c_str(),
-        ios::out | ios::app | ios::binary);
+    OutputFile writeTo;
+    writeTo.setPrecision(this->precision());
+    this->openOutput(writeTo, strExportExtra, true);
 
     // HEADER
-    ofstreamExportTmp << "CHROM" << "\t"
+    writeTo << "CHROM" << "\t"
                       << "POS" << "\t"
                       << "IBDpathChangeAt" << "\t"
                       << "finalIBDpathChangeAt" << "\t"
@@ -251,12 +269,12 @@ void DEploidIO::writeEventCount() {
                       << "finalSiteOfOneSwitchOne" << "\t"
 
                       << "siteOfOneMissCopyOne" << "\t"
-                      << "finalSiteOfOneMissCopyOne" << endl;
+                      << "finalSiteOfOneMissCopyOne" << "\n";
 
     size_t siteIndex = 0;
     for ( size_t chromI = 0; chromI < chrom_.size(); chromI++ ) {
         for ( size_t posI = 0; posI < position_[chromI].size(); posI++) {
-            ofstreamExportTmp << chrom_[chromI] << "\t"
+            writeTo << chrom_[chromI] << "\t"
                           << (int)position_[chromI][posI] << "\t"
 
                           << this->IBDpathChangeAt[siteIndex] << "\t"
@@ -278,65 +296,42 @@ void DEploidIO::writeEventCount() {
                           << this->finalSiteOfOneSwitchOne[siteIndex] << "\t"
 
                           << this->siteOfOneMissCopyOne[siteIndex] << "\t"
-                          << this->finalSiteOfOneMissCopyOne[siteIndex] << endl;
+                          << this->finalSiteOfOneMissCopyOne[siteIndex] << "\n";
             siteIndex++;
         }
     }
 
     assert(siteIndex == this->IBDpathChangeAt.size());
-    ofstreamExportTmp.close();
+    writeTo.close();
 }
 
 
-void DEploidIO::writeIBDpostProb(vector < vector <double> > & reshapedProbs,
-    vector <string> header) {
-    ostream * writeTo;
-    #ifdef UNITTEST
-    writeTo = &std::cout;
-    #endif
-
-    #ifndef UNITTEST
-    ofstreamExportTmp.open(strIbdExportProbs.c_str(),
-        ios::out | ios::app | ios::binary);
-    writeTo = &ofstreamExportTmp;
-    #endif
-
+void DEploidIO::writeIBDpostProbHeader(OutputFile * writeTo,
+    const vector <string> &header) {
     (*writeTo) << "CHROM" << "\t" << "POS" << "\t";
     for (string tmp : header) {
         (*writeTo) << tmp << ((tmp!=header[header.size()-1])?"\t":"\n");
     }
+}
 
-    size_t siteIndex = 0;
-    for ( size_t chromIndex = 0; chromIndex < position_.size(); chromIndex++) {
-        for ( size_t posI = 0; posI < position_[chromIndex].size(); posI++) {
-            (*writeTo) << chrom_[chromIndex] << "\t"
-                       << (int)position_[chromIndex][posI] << "\t";
-            for (size_t ij = 0; ij < reshapedProbs[siteIndex].size(); ij++) {
-                (*writeTo) << reshapedProbs[siteIndex][ij] << "\t";
-            }
-            (*writeTo) << endl;
-            siteIndex++;
-        }
-    }
-    assert(siteIndex == nLoci());
 
-    #ifndef UNITTEST
-        ofstreamExportTmp.close();
-    #endif
+void DEploidIO::writeIBDpostProbAtSite(OutputFile * writeTo,
+    size_t chromIndex, size_t posI, const double * probs, size_t nPattern) {
+    (*writeTo) << chrom_[chromIndex] << "\t"
+               << (int)position_[chromIndex][posI] << "\t";
+    for (size_t ij = 0; ij < nPattern; ij++) {
+        (*writeTo) << probs[ij] << "\t";
+    }
+    (*writeTo) << "\n";
 }
 
 
 void DEploidIO::writeIBDviterbi(vector <size_t> & viterbiState) {
-    ostream * writeTo;
-    #ifdef UNITTEST
-    writeTo = &std::cout;
-    #endif
-
-    #ifndef UNITTEST
-    ofstreamExportTmp.open( strIbdExportViterbi.c_str(),
-    ios::out | ios::app | ios::binary );
-    writeTo = &ofstreamExportTmp;
-    #endif
+    OutputFile viterbiFile;
+    OutputFile * writeTo = &viterbiFile;
+    if (strIbdExportViterbi.size() > 0) {
+        this->openOutput(viterbiFile, strIbdExportViterbi, true);
+    }
 
     (*writeTo) << "CHROM" << "\t" << "POS" << "\t" << "viterbi" << "\n" ;
 
@@ -350,10 +345,7 @@ void DEploidIO::writeIBDviterbi(vector <size_t> & viterbiState) {
         }
     }
     assert(siteIndex == nLoci());
-
-    #ifndef UNITTEST
-    ofstreamExportTmp.close();
-    #endif
+    viterbiFile.close();
 }
 
 
@@ -388,6 +380,7 @@ void DEploidIO::operation_paintIBD() {
     tmpDEploidIO.position_ = this->position_;
     tmpDEploidIO.chrom_ = this->chrom_;
     tmpDEploidIO.setParameterG(this->parameterG());
+    tmpDEploidIO.nThreads_.makeCopy(this->nThreads_);
     // tmpDEploidIO.useConstRecomb_ = true;
     // tmpDEploidIO.constRecombProb_ = 0.000001;
 
@@ -396,18 +389,59 @@ void DEploidIO::operation_paintIBD() {
     MersenneTwister tmpRg(this->randomSeed_.getValue());
     IBDpath tmpIBDpath;
     tmpIBDpath.init(tmpDEploidIO, &tmpRg);
-    tmpIBDpath.buildPathProbabilityForPainting(goodProp);
-    this->ibdLLK_ = tmpIBDpath.bestPath(goodProp);
     this->ibdProbsHeader = tmpIBDpath.getIBDprobsHeader();
-    this->getIBDprobsIntegrated(tmpIBDpath.fwdbwd);
+    size_t nPattern = this->ibdProbsHeader.size();
+    this->ibdProbsIntegrated = vector <double> (nPattern, 0.0);
+
+    // Posterior probabilities are written out and integrated site by site
+    OutputFile probsFile;
+    OutputFile * writeTo = &probsFile;
+    probsFile.setPrecision(this->precision());
+
+    PostProbFile probsBinaryFile;
+    bool binary = (this->postProbFormat() != POST_PROB_TEXT);
+
+    if (strIbdExportProbs.size() > 0 && binary) {
+        probsBinaryFile.open(strIbdExportProbs, this->postProbFormat(),
+            this->compressPostProb(), this->ibdProbsHeader, this->chrom_,
+            this->position_, this->outputBundle_.get());
+    } else if (strIbdExportProbs.size() > 0) {
+        this->openOutput(probsFile, strIbdExportProbs, true);
+    }
 
+    if (!binary) {
+        this->writeIBDpostProbHeader(writeTo, this->ibdProbsHeader);
+    }
+    size_t chromIndex = 0;
+    size_t posI = 0;
+    // Sites arrive in order, so the site index is tracked as chromIndex, posI
+    this->ibdLLK_ = tmpIBDpath.paintIBDstreaming(goodProp,
+        [&](size_t, const double * postProb) {
+            while ( posI == this->position_[chromIndex].size() ) {
+                chromIndex++;
+                posI = 0;
+            }
+            if (binary) {
+                probsBinaryFile.addRow(postProb);
+            } else {
+                this->writeIBDpostProbAtSite(writeTo, chromIndex, posI,
+                                             postProb, nPattern);
+            }
+            for (size_t i = 0; i < nPattern; i++) {
+                this->ibdProbsIntegrated[i] += postProb[i];
+            }
+            posI++;
+        });
+    probsFile.close();
+    probsBinaryFile.close();
+
+    normalizeBySum(this->ibdProbsIntegrated);
+    this->ibdBufferBytes_ = tmpIBDpath.bufferBytes();
 
     for ( size_t stateI = 0; stateI < this->ibdProbsHeader.size(); stateI++ ) {
         cout << setw(14) << this->ibdProbsHeader[stateI] << ": "
              << this->ibdProbsIntegrated[stateI] << "\n";
     }
-
-    this->writeIBDpostProb(tmpIBDpath.fwdbwd, this->ibdProbsHeader);
 }
 
 
@@ -442,6 +476,7 @@ void DEploidIO::operation_paintIBDviterbi() {
     tmpDEploidIO.position_ = this->position_;
     tmpDEploidIO.chrom_ = this->chrom_;
     tmpDEploidIO.setParameterG(this->parameterG());
+    tmpDEploidIO.nThreads_.makeCopy(this->nThreads_);
     // tmpDEploidIO.useConstRecomb_ = true;
     // tmpDEploidIO.constRecombProb_ = 0.000001;
 
@@ -451,12 +486,8 @@ void DEploidIO::operation_paintIBDviterbi() {
     IBDpath tmpIBDpath;
     tmpIBDpath.init(tmpDEploidIO, &tmpRg);
 
-    // tmpIBDpath.buildPathProbabilityForPainting(goodProp);
-    // tmpIBDpath.findViterbiPath(goodProp);
     this->ibdLLK_ = tmpIBDpath.findViterbiPath(goodProp);
-    // ''tmpIBDpath.bestPath(goodProp);
-    // this->ibdProbsHeader = tmpIBDpath.getIBDprobsHeader();
-    // this->getIBDprobsIntegrated(tmpIBDpath.fm);
+    this->ibdBufferBytes_ = tmpIBDpath.bufferBytes();
 
     this->writeIBDviterbi(tmpIBDpath.viterbiPath);
 }
@@ -464,8 +495,10 @@ void DEploidIO::operation_paintIBDviterbi() {
 
 void DEploidIO::writeChooseKProportion() {
     string fileName = this->prefix_ + ".chooseK.prop";
-    ofstreamExportTmp.open(fileName.c_str(), ios::out | ios::binary);
-    ostream * writeTo = &ofstreamExportTmp;
+    OutputFile propFile;
+    OutputFile * writeTo = &propFile;
+    propFile.setPrecision(this->precision());
+    this->openOutput(propFile, fileName);
     for (size_t i = 0; i < this->chooseK.proportions_.size(); i++) {
         for (size_t ii = 0; ii < this->chooseK.proportions_[i].size(); ii++) {
             (*writeTo)  << this->chooseK.proportions_[i][ii];
@@ -473,5 +506,5 @@ void DEploidIO::writeChooseKProportion() {
                         "\n":"\t");
         }
     }
-    ofstreamExportTmp.close();
+    propFile.close();
 }
@@ -23,23 +23,44 @@
  *
  */
 
+#include <algorithm>     // std::min, std::max
 #include "dEploidIO.hpp"
 #include "updateHap.hpp"
 #include "mcmc.hpp"
+#include "parallel.hpp"
 
 void McmcMachinery::writeLastFwdProb(bool useIBD) {
     if (this->dEploidIO_ ->doExportPostProb() != true) {
         return;
     }
 
-    for (size_t tmpk = 0; tmpk < this->kStrain_; tmpk++) {
-        if (this->dEploidIO_->doAllowInbreeding() == true) {
-            this->updateReferencePanel(this->panel_->truePanelSize()+kStrain_-1,
-                tmpk);
+    // Only the forward probabilities of the final state are needed, so
+    // nothing is sampled and the chain's random numbers are left alone. The
+    // (strain, chromosome) pairs are computed in windows of nThreads and
+    // written in order, so at most nThreads chromosomes are held at once.
+    // With inbreeding the panel depends on the strain, so a window does not
+    // span two strains.
+    size_t nChrom = this->dEploidIO_->indexOfChromStarts_.size();
+    size_t nThreads = std::max(this->dEploidIO_->nThreads(),
+                               static_cast<size_t>(1));
+    bool inbreeding = this->dEploidIO_->doAllowInbreeding();
+    vector < vector < vector <double> > > fwdProbs(nThreads);
+
+    size_t task = 0;
+    while (task < this->kStrain_ * nChrom) {
+        size_t windowEnd = std::min(task + nThreads, this->kStrain_ * nChrom);
+        if (inbreeding) {
+            size_t tmpk = task / nChrom;
+            windowEnd = std::min(windowEnd, (tmpk + 1) * nChrom);
+            if (task % nChrom == 0) {
+                this->updateReferencePanel(
+                    this->panel_->truePanelSize()+kStrain_-1, tmpk);
+            }
         }
 
-        for (size_t chromi = 0 ;
-            chromi < this->dEploidIO_->indexOfChromStarts_.size(); chromi++) {
+        runInParallel(windowEnd - task, nThreads, [&](size_t i) {
+            size_t tmpk = (task + i) / nChrom;
+            size_t chromi = (task + i) % nChrom;
             size_t start = this->dEploidIO_->indexOfChromStarts_[chromi];
             size_t length = this->dEploidIO_->position_[chromi].size();
 
@@ -49,42 +70,30 @@ void McmcMachinery::writeLastFwdProb(bool useIBD) {
                                   this->currentExpectedWsaf_,
                                   this->currentProp_,
                                   this->currentHap_,
-                                  this->hapRg_,
+                                  NULL,
                                   start, length,
                                   this->panel_,
                                   this->dEploidIO_->missCopyProb_.getValue(),
                                   this->dEploidIO_->scalingFactor(),
                                   tmpk);
-            if (this->dEploidIO_->doAllowInbreeding() == true) {
+            if (inbreeding) {
                 updatingSingle.setPanelSize(
                     this->panel_->inbreedingPanelSize());
             }
 
-            updatingSingle.core(this->dEploidIO_->refCount_,
-                                this->dEploidIO_->altCount_,
-                                this->dEploidIO_->plaf_,
-                                this->currentExpectedWsaf_,
-                                this->currentProp_,
-                                this->currentHap_);
+            updatingSingle.forwardOnly(this->dEploidIO_->refCount_,
+                                       this->dEploidIO_->altCount_,
+                                       this->currentExpectedWsaf_,
+                                       this->currentProp_,
+                                       this->currentHap_);
+            fwdProbs[i].swap(updatingSingle.fwdProbs_);
+        });
+
+        for (size_t i = 0; task < windowEnd; i++, task++) {
             this->dEploidIO_->writeLastSingleFwdProb(
-                updatingSingle.fwdProbs_, chromi, tmpk, useIBD);
+                fwdProbs[i], task % nChrom, task / nChrom, useIBD);
+            vector < vector <double> >().swap(fwdProbs[i]);
         }
-        // UpdatePairHap updating( this->dEploidIO_->refCount_,
-                                // this->dEploidIO_->altCount_,
-                                // this->dEploidIO_->plaf_,
-                                // this->currentExpectedWsaf_,
-                                // this->currentProp_,
-                                // this->currentHap_, this->hapRg_,
-                                // start, length,
-                                // this->panel_,
-                                // this->dEploidIO_->missCopyProb_,
-                                // this->dEploidIO_->forbidCopyFromSame(),
-                                // (size_t)0,
-                                // (size_t)1);
-        // updating.core(this->dEploidIO_->refCount_,
-        // this->dEploidIO_->altCount_, this->dEploidIO_->plaf_,
-        // this->currentExpectedWsaf_, this->currentProp_, this->currentHap_);
-        // this->dEploidIO_->writeLastPairFwdProb( updating, chromi );
     }
 }
 
@@ -92,49 +101,80 @@ void McmcMachinery::writeLastFwdProb(bool useIBD) {
 void DEploidIO::writeLastSingleFwdProb(
     const vector < vector <double> >& probabilities,
     size_t chromIndex, size_t strainIndex, bool useIBD) {
+    string strExportFwdProb = ((useIBD == true) ?
+        strIbdExportSingleFwdProbPrefix :
+        strExportSingleFwdProbPrefix) + to_string(strainIndex);
+    bool binary = (this->postProbFormat() != POST_PROB_TEXT);
+    // The file of a strain stays open over its chromosomes
+    if (!binary && (chromIndex == 0 || !exportFwdProbFile_.isOpen())) {
+        exportFwdProbFile_.setPrecision(this->precision());
+        this->openOutput(exportFwdProbFile_, strExportFwdProb, true);
+    }
+    bool lastChrom = (chromIndex + 1 == this->chrom_.size());
+
     if (probabilities.size() == 0) {
+        if (lastChrom) {
+            exportFwdProbFile_.close();
+            exportFwdProbBinaryFile_.close();
+        }
         return;
     }
 
     size_t panelSize = probabilities[0].size();
+    vector <string> columns;
+    for (size_t ii = 0; ii < panelSize; ii++) {
+        if (this->doAllowInbreeding() == true) {
+            if (ii <= (panelSize - this->kStrain_.getValue())) {
+                columns.push_back("P" + to_string(ii+1));
+            } else {
+                columns.push_back("I" + to_string(
+                    ii - (panelSize - this->kStrain_.getValue())));
+            }
+        } else {
+            columns.push_back(to_string(ii+1));
+        }
+    }
 
-    string strExportFwdProb = ((useIBD == true) ?
-        strIbdExportSingleFwdProbPrefix :
-        strExportSingleFwdProbPrefix) + to_string(strainIndex);
-    ofstreamExportFwdProb.open(strExportFwdProb.c_str(),
-        ios::out | ios::app | ios::binary);
+    if (binary) {
+        // Every site is listed in the header, so the file is opened at the
+        // first chromosome with sites
+        if (!exportFwdProbBinaryFile_.isOpen()) {
+            exportFwdProbBinaryFile_.open(strExportFwdProb,
+                this->postProbFormat(), this->compressPostProb(), columns,
+                chrom_, position_, this->outputBundle_.get());
+        }
+        for (size_t siteIndex = 0; siteIndex < position_[chromIndex].size();
+             siteIndex++) {
+            exportFwdProbBinaryFile_.addRow(probabilities[siteIndex].data());
+        }
+        if (lastChrom) {
+            exportFwdProbBinaryFile_.close();
+        }
+        return;
+    }
 
     if (chromIndex == 0) {  // Print header
-        ofstreamExportFwdProb << "CHROM" << "\t" << "POS" << "\t";
-        for (size_t ii = 0; ii < probabilities[0].size(); ii++) {
-            if (this->doAllowInbreeding() == true) {
-                if (ii <= (panelSize - this->kStrain_.getValue())) {
-                    ofstreamExportFwdProb << "P" << (ii+1);
-                } else {
-                    ofstreamExportFwdProb <<
-                        "I" << (ii)-(panelSize - this->kStrain_.getValue());
-                }
-            } else {
-                ofstreamExportFwdProb << (ii+1);
-            }
-            ofstreamExportFwdProb << ((ii < (panelSize-1)) ? "\t" : "\n");
+        exportFwdProbFile_ << "CHROM" << "\t" << "POS" << "\t";
+        for (size_t ii = 0; ii < panelSize; ii++) {
+            exportFwdProbFile_ << columns[ii]
+                               << ((ii < (panelSize-1)) ? "\t" : "\n");
         }
     }
 
     size_t siteIndex = 0;
     for (size_t posI = 0; posI < position_[chromIndex].size(); posI++) {
-        ofstreamExportFwdProb << chrom_[chromIndex] << "\t"
-                              << static_cast<int>(position_[chromIndex][posI])
-                              << "\t";
+        exportFwdProbFile_ << chrom_[chromIndex] << "\t"
+                           << static_cast<int>(position_[chromIndex][posI])
+                           << "\t";
         for (size_t ii = 0; ii < probabilities[siteIndex].size(); ii++) {
-            ofstreamExportFwdProb << probabilities[siteIndex][ii];
-            ofstreamExportFwdProb <<
+            exportFwdProbFile_ << probabilities[siteIndex][ii];
+            exportFwdProbFile_ <<
                 ((ii < (probabilities[siteIndex].size()-1)) ? "\t" : "\n");
         }
         siteIndex++;
     }
 
-    ofstreamExportFwdProb.close();
+    if (lastChrom) {
+        exportFwdProbFile_.close();
+    }
 }
-
-
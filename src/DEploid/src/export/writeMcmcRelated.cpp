@@ -59,43 +59,43 @@ void DEploidIO::writeMcmcRelated(McmcSample * mcmcSpl,
 
 void DEploidIO::writeProp(McmcSample * mcmcSample, string jobbrief) {
     string strExport = this->prefix_ + "." + jobbrief + ".prop";
-    remove(strExport.c_str());
-    ofstreamExportTmp.open(strExport.c_str(),
-        ios::out | ios::app | ios::binary);
+    OutputFile writeTo;
+    writeTo.setPrecision(this->precision());
+    this->openOutput(writeTo, strExport);
     for (size_t i = 0; i < mcmcSample->proportion.size(); i++) {
         for (size_t ii = 0; ii < mcmcSample->proportion[i].size(); ii++) {
-            ofstreamExportTmp << setw(10) << mcmcSample->proportion[i][ii];
-            ofstreamExportTmp << ((ii < (mcmcSample->proportion[i].size()-1)) ?
+            writeTo.writeDouble(mcmcSample->proportion[i][ii], 10);
+            writeTo << ((ii < (mcmcSample->proportion[i].size()-1)) ?
                 "\t" : "\n");
         }
     }
-    ofstreamExportTmp.close();
+    writeTo.close();
 }
 
 
 void DEploidIO::writeLLK(McmcSample * mcmcSample, string jobbrief) {
     string strExport = this->prefix_ + "." + jobbrief + ".llk";
-    remove(strExport.c_str());
-    ofstreamExportTmp.open(strExport.c_str(),
-        ios::out | ios::app | ios::binary);
+    OutputFile writeTo;
+    writeTo.setPrecision(this->precision());
+    this->openOutput(writeTo, strExport);
     for (size_t i = 0; i < mcmcSample->sumLLKs.size(); i++) {
-        ofstreamExportTmp << mcmcSample->moves[i] << "\t"
-                          << mcmcSample->sumLLKs[i] << endl;
+        writeTo << mcmcSample->moves[i] << "\t"
+                << mcmcSample->sumLLKs[i] << "\n";
     }
-    ofstreamExportTmp.close();
+    writeTo.close();
 }
 
 
 void DEploidIO::writeHap(vector < vector <double> > &hap, string jobbrief) {
     string strExport = this->prefix_ + "." + jobbrief + ".hap";
-    remove(strExport.c_str());
-    ofstreamExportTmp.open(strExport.c_str(),
-        ios::out | ios::app | ios::binary);
+    OutputFile writeTo;
+    writeTo.setPrecision(this->precision());
+    this->openOutput(writeTo, strExport);
     // HEADER
-    ofstreamExportTmp << "CHROM" << "\t" << "POS" << "\t";;
+    writeTo << "CHROM" << "\t" << "POS" << "\t";
     for (size_t ii = 0; ii < kStrain_.getValue(); ii++) {
-        ofstreamExportTmp << "h" << (ii+1);
-        ofstreamExportTmp << ((ii < (kStrain_.getValue()-1)) ? "\t" : "\n");
+        writeTo << "h" << (ii+1);
+        writeTo << ((ii < (kStrain_.getValue()-1)) ? "\t" : "\n");
     }
 
     size_t siteIndex = 0;
@@ -103,50 +103,48 @@ void DEploidIO::writeHap(vector < vector <double> > &hap, string jobbrief) {
         dout << "chrom " << chromI << " length "
              << position_[chromI].size() << endl;
         for (size_t posI = 0; posI < position_[chromI].size(); posI++) {
-            ofstreamExportTmp << chrom_[chromI]
-                  << "\t" << static_cast<int>(position_[chromI][posI]) << "\t";
+            writeTo << chrom_[chromI]
+                    << "\t" << static_cast<int>(position_[chromI][posI]) << "\t";
             for (size_t ii = 0; ii < hap[siteIndex].size(); ii++) {
-                ofstreamExportTmp << hap[siteIndex][ii];
-                ofstreamExportTmp << ((ii < (hap[siteIndex].size()-1)) ?
-                    "\t" : "\n");
+                writeTo << hap[siteIndex][ii];
+                writeTo << ((ii < (hap[siteIndex].size()-1)) ? "\t" : "\n");
             }
             siteIndex++;
         }
     }
 
     assert(siteIndex == hap.size());
-    ofstreamExportTmp.close();
+    writeTo.close();
 }
 
 
 void DEploidIO::writePanel(Panel *panel, size_t chromI, vector <string> hdr) {
     string strExport = this->prefix_ + ".panel." + to_string(chromI);
-    remove(strExport.c_str());
-
-    ofstreamExportTmp.open(strExport.c_str(),
-        ios::out | ios::app | ios::binary);
+    OutputFile writeTo;
+    writeTo.setPrecision(this->precision());
+    this->openOutput(writeTo, strExport);
 
     // HEADER
-    ofstreamExportTmp << "CHROM" << "\t" << "POS" << "\t";;
+    writeTo << "CHROM" << "\t" << "POS" << "\t";
     for (size_t ii = 0; ii < panel->truePanelSize_; ii++) {
-        ofstreamExportTmp << hdr[ii];
-        ofstreamExportTmp << ((ii < (panel->truePanelSize_-1)) ? "\t" : "\n");
+        writeTo << hdr[ii];
+        writeTo << ((ii < (panel->truePanelSize_-1)) ? "\t" : "\n");
     }
 
     size_t siteIndex = 0;
     for (size_t posI = 0; posI < position_[chromI].size(); posI++) {
-        ofstreamExportTmp << chrom_[chromI] << "\t"
-                          << static_cast<int>(position_[chromI][posI]) << "\t";
+        writeTo << chrom_[chromI] << "\t"
+                << static_cast<int>(position_[chromI][posI]) << "\t";
         for (size_t ii = 0; ii < panel->content_[siteIndex].size(); ii++) {
-            ofstreamExportTmp << panel->content_[siteIndex][ii];
-            ofstreamExportTmp << ((ii < (panel->content_[siteIndex].size()-1)) ?
+            writeTo << panel->content_[siteIndex][ii];
+            writeTo << ((ii < (panel->content_[siteIndex].size()-1)) ?
                 "\t" : "\n");
         }
         siteIndex++;
     }
 
     assert(siteIndex == panel->content_.size());
-    ofstreamExportTmp.close();
+    writeTo.close();
 }
 
 
@@ -160,40 +158,34 @@ void DEploidIO::writeVcf(vector < vector <double> > &hap,
     if (compressVcf()) {
         strExportVcf += ".gz";
     }
-    remove(strExportVcf.c_str());
 
-    ogzstream ogstreamExport;
-    ostream * writeTo;
-    if (compressVcf()) {
-        ogstreamExport.open(strExportVcf.c_str(), ios::out);
-        writeTo = &ogstreamExport;
-    } else {
-        ofstreamExportTmp.open(strExportVcf.c_str(),
-            ios::out | ios::app | ios::binary);
-        writeTo = &ofstreamExportTmp;
-    }
+    // Compressed on the writer thread
+    OutputFile vcfFile;
+    OutputFile * writeTo = &vcfFile;
+    vcfFile.setPrecision(this->precision());
+    this->openOutput(vcfFile, strExportVcf, false, compressVcf());
 
     // VCF HEADER
     if (this->useVcf()) {
         for (auto const& headerLine : this->vcfReaderPtr_->headerLines) {
-            (*writeTo) << headerLine << endl;
+            (*writeTo) << headerLine << "\n";
         }
     } else {
-        (*writeTo) << "##fileformat=VCFv4.2" << endl;
+        (*writeTo) << "##fileformat=VCFv4.2" << "\n";
     }
     // DEploid call
     (*writeTo) << "##DEploid call: dEploid ";
     for (string s : argv_) {
         (*writeTo) << s << " ";
     }
-    (*writeTo) << endl;
+    (*writeTo) << "\n";
 
     // Include proportions
     for (size_t ii = 0; ii < prop.size(); ii++) {
         (*writeTo) << "##Proportion of strain "
-                   << (this->useVcf() ? this->vcfReaderPtr_->sampleName_ : "h")
+                   << (this->useVcf() ? this->vcfSampleName_ : "h")
                    << "." << (ii+1)
-                   << "=" << prop[ii] << endl;
+                   << "=" << prop[ii] << "\n";
     }
 
     // HEADER
@@ -207,7 +199,7 @@ void DEploidIO::writeVcf(vector < vector <double> > &hap,
                << "INFO"   << "\t"
                << "FORMAT" << "\t";
     for (size_t ii = 0; ii < kStrain_.getValue(); ii++) {
-        (*writeTo) << (this->useVcf() ? this->vcfReaderPtr_->sampleName_ : "h")
+        (*writeTo) << (this->useVcf() ? this->vcfSampleName_ : "h")
                           << "." << (ii+1);
         (*writeTo) << ((ii < (kStrain_.getValue()-1)) ? "\t" : "\n");
     }
@@ -216,14 +208,8 @@ void DEploidIO::writeVcf(vector < vector <double> > &hap,
     for (size_t chromI = 0; chromI < chrom_.size(); chromI++) {
         for (size_t posI = 0; posI < position_[chromI].size(); posI++) {
             if (useVcf()) {
-                (*writeTo) << this->vcfReaderPtr_->variants[siteIndex].chromStr
-                   << "\t" << this->vcfReaderPtr_->variants[siteIndex].posStr
-                   << "\t" << this->vcfReaderPtr_->variants[siteIndex].idStr
-                   << "\t" << this->vcfReaderPtr_->variants[siteIndex].refStr
-                   << "\t" << this->vcfReaderPtr_->variants[siteIndex].altStr
-                   << "\t" << this->vcfReaderPtr_->variants[siteIndex].qualStr
-                   << "\t" << this->vcfReaderPtr_->variants[siteIndex].filterStr
-                   << "\t" << this->vcfReaderPtr_->variants[siteIndex].infoStr
+                (*writeTo)
+                   << this->vcfReaderPtr_->variants.fixedFields(siteIndex)
                    << "\t" << "GT" << "\t";
             } else {
                 (*writeTo) << chrom_[chromI]               << "\t"
@@ -246,9 +232,5 @@ void DEploidIO::writeVcf(vector < vector <double> > &hap,
     }
 
     assert(siteIndex == hap.size());
-    if (compressVcf()) {
-        ogstreamExport.close();
-    } else {
-        ofstreamExportTmp.close();
-    }
+    vcfFile.close();
 }
@@ -28,8 +28,13 @@
 #include <iostream>
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <utility>  // std::pair
 #include "ibd.hpp"
+#include "parallel.hpp"
 
 IBDconfiguration::IBDconfiguration() {}
 
@@ -144,6 +149,43 @@ vector <string> IBDconfiguration::getIBDconfigureHeader() {
 }
 
 
+HpriorSiteTable::HpriorSiteTable(size_t kStrain,
+                                 const vector <double> &plaf) {
+    this->kStrain_ = kStrain;
+    this->plaf_ = plaf;
+    size_t rowSize = kStrain + 1;
+    this->altPow = vector <double> (plaf.size() * rowSize);
+    this->refPow = vector <double> (plaf.size() * rowSize);
+    for (size_t site = 0; site < plaf.size(); site++) {
+        for (size_t count = 0; count < rowSize; count++) {
+            altPow[site * rowSize + count] =
+                    pow(plaf[site], static_cast<double>(count));
+            refPow[site * rowSize + count] =
+                    pow((1.0-plaf[site]), static_cast<double>(count));
+        }
+    }
+}
+
+
+HpriorSiteTable::~HpriorSiteTable() {}
+
+
+shared_ptr <const HpriorSiteTable> HpriorSiteTable::get(
+        size_t kStrain, const vector <double> &plaf) {
+    // Keep the most recent table alive only as long as some Hprior uses it.
+    static mutex cacheMutex;
+    static weak_ptr <const HpriorSiteTable> lastTable;
+    lock_guard <mutex> lock(cacheMutex);
+    shared_ptr <const HpriorSiteTable> ret = lastTable.lock();
+    if ( ret && ret->kStrain_ == kStrain && ret->plaf_ == plaf ) {
+        return ret;
+    }
+    ret = make_shared <const HpriorSiteTable> (kStrain, plaf);
+    lastTable = ret;
+    return ret;
+}
+
+
 Hprior::Hprior() {}
 
 
@@ -151,9 +193,9 @@ void Hprior::buildHprior(size_t kStrain, const vector <double> &plaf) {
     ibdConfig.buildIBDconfiguration(kStrain);
     this->effectiveK = ibdConfig.effectiveK;
     this->nState_ = 0;
-    this->plaf_ = plaf;
     this->setKstrain(kStrain);
-    this->setnLoci(this->plaf_.size());
+    this->setnLoci(plaf.size());
+    this->siteTable_ = HpriorSiteTable::get(kStrain, plaf);
     vector < vector<int> > hSetBase = enumerateBinaryMatrixOfK(this->kStrain());
     size_t stateI = 0;
     for ( vector<int> state : ibdConfig.states ) {
@@ -171,19 +213,14 @@ void Hprior::buildHprior(size_t kStrain, const vector <double> &plaf) {
         stateIdxFreq.push_back(sizeOfhSetBaseTmpUnique);
 
         for (size_t i = 0; i < sizeOfhSetBaseTmpUnique; i++) {
-            int tmpSum = 0;
+            size_t tmpSum = 0;
             for (int uniqSt : stateUnique) {
                 tmpSum += hSetBaseTmpUnique[i][uniqSt];
             }
             // sumOfVec(hSetBaseTmpUnique[i]);
-            int tmpDiff = stateUnique.size()-tmpSum;
-            vector <double> hPriorTmp(nLoci());
-            for (size_t site = 0; site < nLoci(); site++) {
-                hPriorTmp[site] =
-                        pow(plaf_[site], static_cast<double>(tmpSum))*
-                        pow((1.0-plaf_[site]), static_cast<double>(tmpDiff));
-            }
-            priorProb.push_back(hPriorTmp);
+            size_t tmpDiff = stateUnique.size()-tmpSum;
+            stateAltCount.push_back(tmpSum);
+            stateRefCount.push_back(tmpDiff);
             hSet.push_back(hSetBaseTmpUnique[i]);
 
             nState_++;
@@ -194,18 +231,6 @@ void Hprior::buildHprior(size_t kStrain, const vector <double> &plaf) {
 }
 
 
-void Hprior::transposePriorProbs() {
-    assert(priorProbTrans.size() == 0);
-    for ( size_t i = 0; i < nLoci(); i++ ) {
-        vector <double> priorProbTransTmp(nState());
-        for ( size_t j = 0; j < nState(); j++ ) {
-            priorProbTransTmp[j] = priorProb[j][i];
-        }
-        priorProbTrans.push_back(priorProbTransTmp);
-    }
-}
-
-
 vector <string> Hprior::getIBDconfigureHeader() {
     return this->ibdConfig.getIBDconfigureHeader();
 }
@@ -294,6 +319,7 @@ void IBDpath::init(const DEploidIO &dEploidIO, RandomGenerator* rg) {
     this->setNLoci(dEploidIO.nLoci());
     this->setKstrain(dEploidIO.kStrain_.getValue());
     this->setTheta(1.0 / static_cast<double>(kStrain()));
+    this->nThreads_ = dEploidIO.nThreads();
 
     this->IBDpathChangeAt = vector <double> (this->nLoci());
 
@@ -302,12 +328,21 @@ void IBDpath::init(const DEploidIO &dEploidIO, RandomGenerator* rg) {
 
     // initialize haplotype prior
     this->hprior.buildHprior(kStrain(), dEploidIO.plaf_);
-    this->hprior.transposePriorProbs();
 
     this->makeIbdTransProbs();
 
-    // initialize fm
-    this->fSumState = vector <double> (this->hprior.nPattern());
+    // initialize per-thread buffers
+    this->scratch_ = vector <IBDchainScratch> (max(this->nThreads_,
+                                                   static_cast<size_t>(1)));
+    for (IBDchainScratch &scratch : this->scratch_) {
+        scratch.vPrior = vector <double> (this->hprior.nState());
+        scratch.lk = vector <double> (this->hprior.nState());
+        scratch.prop = vector <double> (this->hprior.nState());
+        scratch.fSumState = vector <double> (this->hprior.nPattern());
+        scratch.sumState = vector <double> (this->hprior.nPattern());
+        scratch.fSum = 0;
+    }
+    this->fm = vector <double> (this->nLoci() * this->hprior.nState());
 
     // initialize ibdConfigurePath
     this->ibdConfigurePath = vector <size_t> (this->nLoci());
@@ -322,37 +357,72 @@ void IBDpath::init(const DEploidIO &dEploidIO, RandomGenerator* rg) {
                                         dEploidIO.useConstRecomb(),
                                         dEploidIO.constRecombProb());
     this->currentIBDpathChangeAt = vector <double> (this->nLoci());
+    this->findChains();
 
     this->computeUniqueEffectiveKCount();
 }
 
 
-void IBDpath::ibdSamplePath(vector <double> statePrior) {
+void IBDpath::findChains() {
+    // The forward pass at siteI uses pNoRec_[siteI], while the backward pass
+    // from siteI+1 to siteI uses pNoRec_[siteI].
+    const vector <double> &pNoRec = this->ibdRecombProbs.pNoRec_;
+    this->fwdChainStarts_.clear();
+    this->bwdChainEnds_.clear();
+    this->fwdChainStarts_.push_back(0);
+    for (size_t siteI = 0; siteI < this->nLoci(); siteI++) {
+        if ( pNoRec[siteI] != 0 ) {
+            continue;
+        }
+        if ( siteI > 0 ) {
+            this->fwdChainStarts_.push_back(siteI);
+        }
+        if ( siteI < this->nLoci() - 1 ) {
+            this->bwdChainEnds_.push_back(siteI);
+        }
+    }
+    this->bwdChainEnds_.push_back(this->nLoci() - 1);
+}
+
+
+size_t IBDpath::bufferBytes() const {
+    size_t nDouble = this->fm.capacity() +
+                     this->bwdCheckpoint_.capacity() +
+                     this->blockBwd_.capacity();
+    for (const IBDchainScratch &scratch : this->scratch_) {
+        nDouble += scratch.vPrior.capacity() + scratch.lk.capacity() +
+                   scratch.prop.capacity() + scratch.fSumState.capacity() +
+                   scratch.sumState.capacity();
+    }
+    return sizeof(double) * nDouble;
+}
+
+
+void IBDpath::ibdSamplePath(const vector <double> &statePrior) {
+    size_t nState = this->hprior.nState();
+    vector <double> &prop = this->scratch_[0].prop;
     int lociIdx = this->nLoci()-1;
-    vector <double> tmpProp = fm[lociIdx];
-    (void)normalizeBySum(tmpProp);
-    ibdConfigurePath[lociIdx] = sampleIndexGivenProp(this->ibdRg_, tmpProp);
+    copy(fmAt(lociIdx), fmAt(lociIdx) + nState, prop.begin());
+    normalizeBySum(prop);
+    ibdConfigurePath[lociIdx] = sampleIndexGivenProp(this->ibdRg_,
+                                                     prop.data(), nState);
 
-    assert(this->fm.size() == nLoci());
     while (lociIdx > 0) {
         lociIdx--;
-        vector <double> vNoRecomb = vecProd(
-        this->ibdTransProbs[this->hprior.stateIdx[ibdConfigurePath[lociIdx+1]]],
-        fm[lociIdx]);
-        assert(vNoRecomb.size() == this->hprior.nState());
-        vector <double> vRecomb = fm[lociIdx];
-        assert(vRecomb.size() == this->hprior.nState());
-        vector <double> prop(this->hprior.nState());
-        for (size_t i = 0; i < prop.size(); i++) {
-            prop[i] = vNoRecomb[i]*this->ibdRecombProbs.pNoRec_[lociIdx] +
-                        vRecomb[i]*this->ibdRecombProbs.pRec_[lociIdx] *
-                        statePrior[ibdConfigurePath[lociIdx+1]];
+        const double * fmAtLoci = fmAt(lociIdx);
+        const vector <double> &vNoRecombTrans =
+            this->ibdTransProbs[this->hprior.stateIdx[ibdConfigurePath[lociIdx+1]]];
+        double pNoRec = this->ibdRecombProbs.pNoRec_[lociIdx];
+        double pRec = this->ibdRecombProbs.pRec_[lociIdx];
+        double statePriorNext = statePrior[ibdConfigurePath[lociIdx+1]];
+        for (size_t i = 0; i < nState; i++) {
+            prop[i] = (vNoRecombTrans[i] * fmAtLoci[i]) * pNoRec +
+                       fmAtLoci[i] * pRec * statePriorNext;
         }
-        tmpProp = prop;
-        (void)normalizeBySum(tmpProp);
-        ibdConfigurePath[lociIdx] = sampleIndexGivenProp(this->ibdRg_, tmpProp);
-        assert(ibdConfigurePath[lociIdx] < this->hprior.nState());
-        assert(ibdConfigurePath[lociIdx] >= 0);
+        normalizeBySum(prop);
+        ibdConfigurePath[lociIdx] = sampleIndexGivenProp(this->ibdRg_,
+                                                         prop.data(), nState);
+        assert(ibdConfigurePath[lociIdx] < nState);
     }
 }
 
@@ -369,148 +439,146 @@ vector <size_t> IBDpath::findWhichIsSomething(vector <size_t> tmpOp,
 }
 
 
-void IBDpath::buildPathProbabilityForPainting(vector <double> proportion) {
-    // vector <double> effectiveKPrior =
-    //                    this->computeEffectiveKPrior(this->theta());
-    vector <double> effectiveKPrior = vector <double> (this->hprior.nPattern(),
-                                                1.0/this->hprior.nPattern());
-    vector <double> statePrior = this->computeStatePrior(effectiveKPrior);
-    // First building the path likelihood
-    this->computeIbdPathFwdProb(proportion, statePrior);
-    // Reshape Fwd
-    vector < vector <double>> reshapedFwd = reshapeProbs(this->fm);
-
-    this->computeIbdPathBwdProb(proportion, effectiveKPrior, statePrior);
-    // Reshape Bwd
-    vector < vector <double>> reshapedBwd = reshapeProbs(this->bwd);
-
-    // Combine Fwd Bwd
-    this->combineFwdBwd(reshapedFwd, reshapedBwd);
-}
-
-
-
-void IBDpath::computeIbdPathBwdProb(vector <double> proportion,
-                                    vector <double> effectiveKPrior,
-                                    vector <double> statePrior) {
-    // # assuming each ibd state has equal probabilities,
-    // # transform it into ibd configurations
-    // dout << " start building ibd bwd "<< endl;
-    vector <double> tmp = vector <double> (hprior.stateIdxFreq.size());
-    assert(effectiveKPrior.size() == hprior.stateIdxFreq.size());
-    for (size_t i = 0; i < tmp.size(); i++) {
-        tmp[i] = effectiveKPrior[i] /
-                   static_cast<double>(hprior.stateIdxFreq[i]);
-    }
-
-    vector <double> tmpBw = vector <double> (hprior.nState());
-    for (size_t j = 0; j < tmpBw.size(); j++) {
+void IBDpath::bwdAtChainEnd(const vector <double> &effectiveKPrior,
+                            const vector <double> &statePrior,
+                            size_t chainEnd, double * bwdAtEnd) {
+    size_t nState = this->hprior.nState();
+    if ( chainEnd == this->nLoci()-1 ) {
+        // # assuming each ibd state has equal probabilities,
+        // # transform it into ibd configurations
+        assert(effectiveKPrior.size() == hprior.stateIdxFreq.size());
+        vector <double> tmp = vector <double> (hprior.stateIdxFreq.size());
         for (size_t i = 0; i < tmp.size(); i++) {
-            tmpBw[j] += tmp[i] * ibdTransProbs[i][j];
+            tmp[i] = effectiveKPrior[i] /
+                       static_cast<double>(hprior.stateIdxFreq[i]);
         }
-    }
-
-    this->bwd.push_back(tmpBw);
-    for ( size_t rev_siteI = 1; rev_siteI < this->nLoci(); rev_siteI++ ) {
-        size_t siteI = this->nLoci()-rev_siteI;
-
-        vector<double> lk = computeLlkOfStatesAtSiteI(proportion, siteI);
-        vector <double> bSumState = vector <double> (hprior.nPattern());
-        for (size_t i = 0; i < bSumState.size(); i++) {
-            for (size_t j = 0; j < hprior.nState(); j++) {
-                bSumState[i] += ibdTransProbs[i][j]*this->bwd.back()[j];
+        for (size_t j = 0; j < nState; j++) {
+            bwdAtEnd[j] = 0;
+            for (size_t i = 0; i < tmp.size(); i++) {
+                bwdAtEnd[j] += tmp[i] * ibdTransProbs[i][j];
             }
         }
-        vector <double> vNoRecomb(hprior.nState());
-        for (size_t i = 0; i < hprior.stateIdx.size(); i++) {
-            vNoRecomb[i] = bSumState[hprior.stateIdx[i]];
+    } else {
+        // No memory of the next chain is kept across the reset
+        for (size_t i = 0; i < nState; i++) {
+            bwdAtEnd[i] = statePrior[i] * hprior.priorProb(i, chainEnd+1);
         }
+        normalizeBySum(bwdAtEnd, nState);
+    }
+}
 
-        for (size_t i = 0; i < hprior.nState(); i++) {
-            tmpBw[i] = 0;
-            for (size_t j = 0; j < lk.size(); j++) {
-                tmpBw[i] += (lk[j] * bwd.back()[j]) *
-                            this->ibdRecombProbs.pRec_[siteI-1];
-            }
-            tmpBw[i] *= statePrior[i];
-            tmpBw[i] += lk[i] * (this->ibdRecombProbs.pNoRec_[siteI-1]) *
-                        vNoRecomb[i];
-            tmpBw[i] *= hprior.priorProb[i][siteI];
+
+void IBDpath::bwdStepFromSiteI(const vector <double> &proportion,
+                               const vector <double> &statePrior,
+                               size_t siteI, const double * bwdNext,
+                               double * tmpBw, IBDchainScratch &scratch) {
+    size_t nState = this->hprior.nState();
+    double * lk = scratch.lk.data();
+    vector <double> &sumState = scratch.sumState;
+    computeLlkOfStatesAtSiteI(proportion, siteI, lk);
+    for (size_t i = 0; i < sumState.size(); i++) {
+        sumState[i] = 0;
+        for (size_t j = 0; j < nState; j++) {
+            sumState[i] += ibdTransProbs[i][j]*bwdNext[j];
         }
-        normalizeBySum(tmpBw);
-        this->bwd.push_back(tmpBw);
     }
-    reverse(bwd.begin(), bwd.end());
-}
 
+    double pRec = this->ibdRecombProbs.pRec_[siteI-1];
+    double pNoRec = this->ibdRecombProbs.pNoRec_[siteI-1];
+    // The recombination term is the same for every state
+    double massFromRec = 0;
+    for (size_t j = 0; j < nState; j++) {
+        massFromRec += (lk[j] * bwdNext[j]) * pRec;
+    }
+    for (size_t i = 0; i < nState; i++) {
+        tmpBw[i] = massFromRec * statePrior[i];
+        tmpBw[i] += lk[i] * pNoRec * sumState[hprior.stateIdx[i]];
+        tmpBw[i] *= hprior.priorProb(i, siteI);
+    }
+    normalizeBySum(tmpBw, nState);
+}
 
-void IBDpath::computeIbdPathFwdProb(vector <double> proportion,
-                                    vector <double> statePrior) {
-    this->fm.clear();
-    vector <double> vPrior = vecProd(statePrior,
-                                     this->hprior.priorProbTrans[0]);
 
-    vector <double> lk = computeLlkOfStatesAtSiteI(proportion, 0);
-    this->updateFmAtSiteI(vPrior, lk);
-    for ( size_t siteI = 1; siteI < this->nLoci(); siteI++ ) {
-        vector <double> vNoRec;
-        for ( size_t stateIdxTmp : hprior.stateIdx ) {
-            vNoRec.push_back(this->fSumState[stateIdxTmp]);
+void IBDpath::fwdStepAtSiteI(const vector <double> &proportion,
+                             const vector <double> &statePrior,
+                             size_t siteI, bool chainStart,
+                             double * postAtSiteI, IBDchainScratch &scratch) {
+    size_t nState = this->hprior.nState();
+    double * vPrior = scratch.vPrior.data();
+    double * lk = scratch.lk.data();
+    if ( chainStart ) {
+        // No memory of the previous chain is kept across the reset
+        for ( size_t i = 0; i < nState; i++ ) {
+            vPrior[i] = statePrior[i] * hprior.priorProb(i, siteI);
         }
-        for ( size_t i = 0; i < hprior.nState(); i++ ) {
-            vPrior[i] = (vNoRec[i] * this->ibdRecombProbs.pNoRec_[siteI] +
-                         fSum * this->ibdRecombProbs.pRec_[siteI] *
-                         statePrior[i]) *
-                         hprior.priorProbTrans[siteI][i];
+    } else {
+        double pNoRec = this->ibdRecombProbs.pNoRec_[siteI];
+        double pRec = this->ibdRecombProbs.pRec_[siteI];
+        for ( size_t i = 0; i < nState; i++ ) {
+            vPrior[i] = (scratch.fSumState[hprior.stateIdx[i]] * pNoRec +
+                         scratch.fSum * pRec * statePrior[i]) *
+                         hprior.priorProb(i, siteI);
         }
+    }
+    computeLlkOfStatesAtSiteI(proportion, siteI, lk);
+    this->updateFmAtSiteI(postAtSiteI, vPrior, lk, scratch);
+}
 
-        lk = computeLlkOfStatesAtSiteI(proportion, siteI);
-        this->updateFmAtSiteI(vPrior, lk);
 
-        viterbiPath[siteI] = distance(fSumState.begin(),
-                       max_element(fSumState.begin(), fSumState.end()));
-    }
+void IBDpath::computeIbdPathFwdProb(const vector <double> &proportion,
+                                    const vector <double> &statePrior) {
+    runInParallelOnWorkers(this->fwdChainStarts_.size(), this->nThreads_,
+                           [&](size_t c, size_t worker) {
+        IBDchainScratch &scratch = this->scratch_[worker];
+        const vector <double> &fSumState = scratch.fSumState;
+        size_t chainStart = fwdChainStarts_[c];
+        for ( size_t siteI = chainStart; siteI < fwdChainEnd(c); siteI++ ) {
+            this->fwdStepAtSiteI(proportion, statePrior, siteI,
+                                 siteI == chainStart, fmAt(siteI), scratch);
+            if ( siteI > 0 ) {
+                viterbiPath[siteI] = distance(fSumState.begin(),
+                           max_element(fSumState.begin(), fSumState.end()));
+            }
+        }
+    });
 }
 
 
-void IBDpath::updateFmAtSiteI(const vector <double> & prior,
-                              const vector <double> & llk) {
-    vector <double> postAtSiteI = vecProd(prior, llk);
-    normalizeBySum(postAtSiteI);
-    this->fm.push_back(postAtSiteI);
-    this->fSum = sumOfVec(postAtSiteI);
+void IBDpath::updateFmAtSiteI(double * postAtSiteI, const double * prior,
+                              const double * llk, IBDchainScratch &scratch) {
+    size_t nState = this->hprior.nState();
+    for ( size_t j = 0; j < nState; j++ ) {
+        postAtSiteI[j] = prior[j] * llk[j];
+    }
+    normalizeBySum(postAtSiteI, nState);
+    scratch.fSum = 0;
+    for ( size_t j = 0; j < nState; j++ ) {
+        scratch.fSum += postAtSiteI[j];
+    }
+    vector <double> &fSumState = scratch.fSumState;
     for (size_t i = 0; i < fSumState.size(); i++) {
-        this->fSumState[i] = 0;
-        for ( size_t j = 0; j < hprior.nState(); j++ ) {
-            this->fSumState[i] += ibdTransProbs[i][j]*postAtSiteI[j];
+        fSumState[i] = 0;
+        for ( size_t j = 0; j < nState; j++ ) {
+            fSumState[i] += ibdTransProbs[i][j]*postAtSiteI[j];
         }
     }
 }
 
 
-double IBDpath::bestPath(vector <double> proportion, double err) {
-    double sumLLK = 0.0;
-    for (size_t i = 0; i < nLoci(); i++) {
-        vector <double> tmp;
-        for (size_t j = 0; j < fm[i].size(); j++) {
-            tmp.push_back(exp(log(fm[i][j])+log(bwd[i][j])));
-        }
-        normalizeBySum(tmp);
-        size_t indx = distance(tmp.begin(),
-                               max_element(tmp.begin(), tmp.end()));
-
-        vector <int> hSetI = this->hprior.hSet[indx];
-        double qs = 0;
-        for (size_t j = 0; j < this->kStrain(); j++) {
-            qs += static_cast<double>(hSetI[j]) * proportion[j];
-        }
-        double qs2 = qs*(1-err) + (1-qs)*err;
+double IBDpath::siteLlkGivenState(const vector <double> &proportion,
+                                  size_t siteI, size_t state, double err) {
+    const vector <int> &hSetI = this->hprior.hSet[state];
+    double qs = 0;
+    for (size_t j = 0; j < this->kStrain(); j++) {
+        qs += static_cast<double>(hSetI[j]) * proportion[j];
+    }
+    double qs2 = qs*(1-err) + (1-qs)*err;
 
-        if ( (qs > 0) & (qs < 1) ) {
-            sumLLK += logBetaPdf(qs2, this->llkSurf[i][0], this->llkSurf[i][1]);
-        }
+    if ( (qs > 0) & (qs < 1) ) {
+        return logBetaPdf(qs2, this->llkSurf[siteI][0],
+                          this->llkSurf[siteI][1]);
     }
-    return sumLLK;
+    return 0.0;
 }
 
 
@@ -521,41 +589,150 @@ double IBDpath::findViterbiPath(vector <double> proportion, double err) {
     // First building the path likelihood
     this->computeIbdPathFwdProb(proportion, statePrior);
 
-    double sumLLK = 0.0;
-    for (size_t i = 0; i < nLoci(); i++) {
-        vector <double> tmp;
-        for (size_t j = 0; j < fm[i].size(); j++) {
-            tmp.push_back(exp(log(fm[i][j])));
+    size_t nState = this->hprior.nState();
+    vector <double> siteLlk(nLoci());
+    runInParallelOnWorkers(this->fwdChainStarts_.size(), this->nThreads_,
+                           [&](size_t c, size_t worker) {
+        vector <double> &prop = this->scratch_[worker].prop;
+        for (size_t i = fwdChainStarts_[c]; i < fwdChainEnd(c); i++) {
+            const double * fmAtSiteI = fmAt(i);
+            for (size_t j = 0; j < nState; j++) {
+                prop[j] = exp(log(fmAtSiteI[j]));
+            }
+            normalizeBySum(prop);
+            size_t indx = distance(prop.begin(),
+                                   max_element(prop.begin(), prop.end()));
+            siteLlk[i] = siteLlkGivenState(proportion, i, indx, err);
         }
-        normalizeBySum(tmp);
-        size_t indx = distance(tmp.begin(),
-                               max_element(tmp.begin(), tmp.end()));
+    });
 
-        vector <int> hSetI = this->hprior.hSet[indx];
-        double qs = 0;
-        for (size_t j = 0; j < this->kStrain(); j++) {
-            qs += static_cast<double>(hSetI[j]) * proportion[j];
-        }
-        double qs2 = qs*(1-err) + (1-qs)*err;
-
-        if ( (qs > 0) & (qs < 1) ) {
-            sumLLK += logBetaPdf(qs2, this->llkSurf[i][0], this->llkSurf[i][1]);
-        }
+    double sumLLK = 0.0;
+    for (size_t i = 0; i < nLoci(); i++) {
+        sumLLK += siteLlk[i];
     }
     return sumLLK;
 }
 
 
-void IBDpath::combineFwdBwd(const vector < vector <double>> &reshapedFwd,
-                            const vector < vector <double>> &reshapedBwd) {
-    for (size_t i = 0; i < nLoci(); i++) {
-        vector <double> tmp;
-        for (size_t j = 0; j < reshapedFwd[i].size(); j++) {
-            tmp.push_back(exp(log(reshapedFwd[i][j])+log(reshapedBwd[i][j])));
+double IBDpath::paintIBDstreaming(const vector <double> &proportion,
+                                  const IBDpostProbSink &writeSite,
+                                  double err) {
+    vector <double> effectiveKPrior = vector <double> (this->hprior.nPattern(),
+                                                1.0/this->hprior.nPattern());
+    vector <double> statePrior = this->computeStatePrior(effectiveKPrior);
+    size_t nState = this->hprior.nState();
+    size_t nPattern = this->hprior.nPattern();
+
+    // Cut every backward chain into blocks of about sqrt(nLoci) sites, only
+    // the backward probabilities at the last site of each block are kept.
+    size_t blockLen = max(static_cast<size_t>(1), static_cast<size_t>(
+                          ceil(sqrt(static_cast<double>(this->nLoci())))));
+    vector <size_t> blockStarts;
+    vector <size_t> chainFirstBlock;
+    for (size_t c = 0; c < this->bwdChainEnds_.size(); c++) {
+        chainFirstBlock.push_back(blockStarts.size());
+        for (size_t siteI = bwdChainBegin(c); siteI <= bwdChainEnds_[c];
+             siteI += blockLen) {
+            blockStarts.push_back(siteI);
+        }
+    }
+    chainFirstBlock.push_back(blockStarts.size());
+    blockStarts.push_back(this->nLoci());
+    size_t nBlocks = blockStarts.size() - 1;
+
+    this->bwdCheckpoint_.assign(nBlocks * nState, 0.0);
+    runInParallelOnWorkers(this->bwdChainEnds_.size(), this->nThreads_,
+                           [&](size_t c, size_t worker) {
+        vector <double> bwdNext(nState);
+        vector <double> bwdCur(nState);
+        size_t chainBegin = bwdChainBegin(c);
+        size_t chainEnd = bwdChainEnds_[c];
+        this->bwdAtChainEnd(effectiveKPrior, statePrior, chainEnd,
+                            bwdCur.data());
+        size_t blockI = chainFirstBlock[c+1] - 1;
+        copy(bwdCur.begin(), bwdCur.end(),
+             this->bwdCheckpoint_.begin() + blockI * nState);
+        for ( size_t siteI = chainEnd; siteI > chainBegin; siteI-- ) {
+            bwdNext.swap(bwdCur);
+            this->bwdStepFromSiteI(proportion, statePrior, siteI,
+                                   bwdNext.data(), bwdCur.data(),
+                                   this->scratch_[worker]);
+            if ( siteI == blockStarts[blockI] ) {
+                blockI--;
+                copy(bwdCur.begin(), bwdCur.end(),
+                     this->bwdCheckpoint_.begin() + blockI * nState);
+            }
+        }
+    });
+
+    // Blocks are then handled in site order, a batch of nThreads blocks at a
+    // time: their backward probabilities are rebuilt from the checkpoints in
+    // parallel, and the forward pass runs through them on this thread.
+    size_t batchSize = this->scratch_.size();
+    this->blockBwd_.assign(batchSize * blockLen * nState, 0.0);
+    IBDchainScratch &fwdScratch = this->scratch_[0];
+    vector <double> fwdAtSite(nState);
+    vector <double> reshapedFwd(nPattern);
+    vector <double> reshapedBwd(nPattern);
+    size_t nextFwdChain = 0;
+    double sumLLK = 0.0;
+    for (size_t batchStart = 0; batchStart < nBlocks;
+         batchStart += batchSize) {
+        size_t batchEnd = min(batchStart + batchSize, nBlocks);
+        runInParallelOnWorkers(batchEnd - batchStart, this->nThreads_,
+                               [&](size_t b, size_t worker) {
+            size_t blockI = batchStart + b;
+            double * bwdOfBlock = &this->blockBwd_[b * blockLen * nState];
+            size_t blockStart = blockStarts[blockI];
+            size_t blockEnd = blockStarts[blockI+1] - 1;
+            copy(this->bwdCheckpoint_.begin() + blockI * nState,
+                 this->bwdCheckpoint_.begin() + (blockI + 1) * nState,
+                 bwdOfBlock + (blockEnd - blockStart) * nState);
+            for ( size_t siteI = blockEnd; siteI > blockStart; siteI-- ) {
+                this->bwdStepFromSiteI(proportion, statePrior, siteI,
+                    bwdOfBlock + (siteI - blockStart) * nState,
+                    bwdOfBlock + (siteI - 1 - blockStart) * nState,
+                    this->scratch_[worker]);
+            }
+        });
+
+        for (size_t blockI = batchStart; blockI < batchEnd; blockI++) {
+            const double * bwdOfBlock =
+                &this->blockBwd_[(blockI - batchStart) * blockLen * nState];
+            for (size_t siteI = blockStarts[blockI];
+                 siteI < blockStarts[blockI+1]; siteI++) {
+                bool chainStart = ( nextFwdChain < fwdChainStarts_.size() &&
+                                    fwdChainStarts_[nextFwdChain] == siteI );
+                if ( chainStart ) {
+                    nextFwdChain++;
+                }
+                this->fwdStepAtSiteI(proportion, statePrior, siteI,
+                                     chainStart, fwdAtSite.data(), fwdScratch);
+                const double * bwdAtSite =
+                    bwdOfBlock + (siteI - blockStarts[blockI]) * nState;
+
+                // Most likely state, for the best path likelihood
+                size_t indx = 0;
+                double maxProb = fwdAtSite[0] * bwdAtSite[0];
+                for (size_t j = 1; j < nState; j++) {
+                    if ( fwdAtSite[j] * bwdAtSite[j] > maxProb ) {
+                        maxProb = fwdAtSite[j] * bwdAtSite[j];
+                        indx = j;
+                    }
+                }
+                sumLLK += siteLlkGivenState(proportion, siteI, indx, err);
+
+                this->reshapeProbs(fwdAtSite.data(), reshapedFwd.data());
+                this->reshapeProbs(bwdAtSite, reshapedBwd.data());
+                for (size_t j = 0; j < nPattern; j++) {
+                    reshapedFwd[j] *= reshapedBwd[j];
+                }
+                normalizeBySum(reshapedFwd.data(), nPattern);
+                writeSite(siteI, reshapedFwd.data());
+            }
         }
-        normalizeBySum(tmp);
-        fwdbwd.push_back(tmp);
     }
+    return sumLLK;
 }
 
 
@@ -577,28 +754,22 @@ vector <string> IBDpath::getIBDprobsHeader() {
 }
 
 
-vector < vector <double> > IBDpath::reshapeProbs(
-        const vector < vector <double> >& probs) {
-    assert(this->nLoci() == probs.size());
-    vector < vector <double> > ret;
-    for (size_t siteIndex = 0; siteIndex < this->nLoci(); siteIndex++) {
-        size_t previousStateIdx = 0;
-        vector <double> tmpRow;
-        double cumProb = 0;
-        for (size_t prob_ij = 0; prob_ij < probs[siteIndex].size(); prob_ij++) {
-            cumProb += probs[siteIndex][prob_ij];
-            if (previousStateIdx != this->hprior.stateIdx[prob_ij]) {
-                cumProb -= probs[siteIndex][prob_ij];
-                previousStateIdx++;
-                tmpRow.push_back(cumProb);
-                cumProb = probs[siteIndex][prob_ij];
-            }
+void IBDpath::reshapeProbs(const double * probs, double * reshaped) {
+    size_t previousStateIdx = 0;
+    size_t patternI = 0;
+    double cumProb = 0;
+    for (size_t prob_ij = 0; prob_ij < this->hprior.nState(); prob_ij++) {
+        cumProb += probs[prob_ij];
+        if (previousStateIdx != this->hprior.stateIdx[prob_ij]) {
+            cumProb -= probs[prob_ij];
+            previousStateIdx++;
+            reshaped[patternI++] = cumProb;
+            cumProb = probs[prob_ij];
         }
-        tmpRow.push_back(cumProb);
-        normalizeBySum(tmpRow);
-        ret.push_back(tmpRow);
     }
-    return ret;
+    reshaped[patternI++] = cumProb;
+    assert(patternI == this->hprior.nPattern());
+    normalizeBySum(reshaped, patternI);
 }
 
 
@@ -667,7 +838,17 @@ void IBDpath::computeUniqueEffectiveKCount() {
 }
 
 
-void IBDpath::makeLlkSurf(vector <double> altCount, vector <double> refCount,
+struct ReadCountHash {
+    size_t operator()(const pair <double, double> &counts) const {
+        size_t h1 = hash <double>()(counts.first);
+        size_t h2 = hash <double>()(counts.second);
+        return h1 ^ (h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2));
+    }
+};
+
+
+void IBDpath::makeLlkSurf(const vector <double> &altCount,
+                          const vector <double> &refCount,
                           double scalingConst, double err, size_t gridSize) {
     double pGridSpacing = 1.0 / static_cast<double>(gridSize+1);
     vector <double> pGrid;
@@ -676,12 +857,27 @@ void IBDpath::makeLlkSurf(vector <double> altCount, vector <double> refCount,
         pGrid.push_back(pGrid.back() + pGridSpacing);
     }
     assert(pGrid.size() == gridSize);
+    vector <double> pGridSq = vecProd(pGrid, pGrid);
 
     assert(llkSurf.size() == 0);
 
+    // The surface only depends on the read counts, many sites share them.
+    unordered_map <pair <double, double>, size_t, ReadCountHash> countIndex;
+    vector < pair <double, double> > uniqueCounts;
+    vector <size_t> siteToUnique(altCount.size());
     for (size_t i = 0 ; i < altCount.size(); i++) {
-        double alt = altCount[i];
-        double ref = refCount[i];
+        pair <double, double> counts(refCount[i], altCount[i]);
+        auto found = countIndex.emplace(counts, uniqueCounts.size());
+        if ( found.second ) {
+            uniqueCounts.push_back(counts);
+        }
+        siteToUnique[i] = found.first->second;
+    }
+
+    vector < vector <double> > uniqueSurf(uniqueCounts.size());
+    runInParallel(uniqueCounts.size(), this->nThreads_, [&](size_t ui) {
+        double ref = uniqueCounts[ui].first;
+        double alt = uniqueCounts[ui].second;
 
         vector <double> ll;
         for ( double unadjustedP : pGrid ) {
@@ -705,41 +901,44 @@ void IBDpath::makeLlkSurf(vector <double> altCount, vector <double> refCount,
 
         vector <double> tmpVec1 = vecProd(ln, pGrid);
         double mn = sumOfVec(tmpVec1);
-        vector <double> pGridSq = vecProd(pGrid, pGrid);
         vector <double> tmpVec2 = vecProd(ln, pGridSq);
         double vr = sumOfVec(tmpVec2) - mn*mn;
 
         double comm = (mn*(1.0-mn)/vr-1.0);
-        llkSurf.push_back(vector <double> {mn*comm, (1-mn)*comm});
+        uniqueSurf[ui] = vector <double> {mn*comm, (1-mn)*comm};
+    });
+
+    for (size_t i = 0 ; i < altCount.size(); i++) {
+        llkSurf.push_back(uniqueSurf[siteToUnique[i]]);
     }
     assert(llkSurf.size() == this->nLoci());
 }
 
 
-vector <double> IBDpath::computeLlkOfStatesAtSiteI(vector<double> proportion,
-                                                   size_t siteI, double err ) {
-    vector <double> llks;
-    for ( vector <int> hSetI : this->hprior.hSet ) {
+void IBDpath::computeLlkOfStatesAtSiteI(const vector<double> &proportion,
+                                        size_t siteI, double * llks,
+                                        double err) {
+    size_t nState = this->hprior.nState();
+    for ( size_t i = 0; i < nState; i++ ) {
+        const vector <int> &hSetI = this->hprior.hSet[i];
         double qs = 0;
         for ( size_t j = 0; j < this->kStrain() ; j++ ) {
             qs += static_cast<double>(hSetI[j]) * proportion[j];
         }
         double qs2 = qs*(1-err) + (1-qs)*err;
-        llks.push_back(
-            logBetaPdf(qs2, this->llkSurf[siteI][0], this->llkSurf[siteI][1]));
+        llks[i] = logBetaPdf(qs2, this->llkSurf[siteI][0],
+                             this->llkSurf[siteI][1]);
     }
 
-    double maxllk = max_value(llks);
-    vector <double> ret;
-    for ( double llk : llks ) {
-        double normalized = exp(llk-maxllk);
+    double maxllk = *max_element(llks, llks + nState);
+    for ( size_t i = 0; i < nState; i++ ) {
+        double normalized = exp(llks[i]-maxllk);
         if ( normalized == 0 ) {
             // normalized = std::numeric_limits< double >::min();
             normalized = 2.22507e-308;
         }
-        ret.push_back(normalized);
+        llks[i] = normalized;
     }
-    return ret;
 }
 
 
@@ -27,6 +27,8 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <memory>  // shared_ptr
+#include <functional>
 #include "exceptions.hpp"
 #include "utility.hpp"
 #include "random/mersenne_twister.hpp"
@@ -80,6 +82,30 @@ class IBDconfiguration{
 };
 
 
+// Powers of the PLAF and its complement at every site. The prior of a
+// haplotype state only depends on how many of its distinct strains carry the
+// alternative allele, so this table replaces the nState x nLoci prior matrix.
+// Tables are shared between Hpriors built from the same PLAF.
+class HpriorSiteTable{
+#ifdef UNITTEST
+  friend class TestHprior;
+#endif
+  friend class Hprior;
+  public:
+    HpriorSiteTable(size_t kStrain, const vector <double> &plaf);
+    ~HpriorSiteTable();
+
+  private:
+    size_t kStrain_;
+    vector <double> plaf_;
+    vector <double> altPow;  // size: nLoci x (kStrain+1), site major
+    vector <double> refPow;  // size: nLoci x (kStrain+1), site major
+
+    static shared_ptr <const HpriorSiteTable> get(size_t kStrain,
+                                                  const vector <double> &plaf);
+};
+
+
 class Hprior{
 #ifdef UNITTEST
   friend class TestHprior;
@@ -103,10 +129,14 @@ class Hprior{
     void setnLoci(const size_t setTo) {this->nLoci_ = setTo;}
     size_t nLoci() const {return this->nLoci_;}
 
-    vector <double> plaf_;
-    vector < vector <double> > priorProb;  // size: nState x nLoci
-    vector < vector <double> > priorProbTrans;  // size: nLoci x nState
-    void transposePriorProbs();
+    shared_ptr <const HpriorSiteTable> siteTable_;
+    vector <size_t> stateAltCount;  // size: nState
+    vector <size_t> stateRefCount;  // size: nState
+    double priorProb(size_t state, size_t site) const {
+        size_t rowStart = site * (this->kStrain() + 1);
+        return this->siteTable_->altPow[rowStart + stateAltCount[state]] *
+               this->siteTable_->refPow[rowStart + stateRefCount[state]];
+    }
 
     vector <size_t> stateIdx;  // size: nState
     vector <size_t> stateIdxFreq;
@@ -121,6 +151,22 @@ class Hprior{
 };
 
 
+// Receives the posterior probabilities of the IBD patterns at one site.
+typedef std::function <void (size_t siteI, const double * postProb)>
+    IBDpostProbSink;
+
+
+// Per-thread temporaries of the forward and backward recursions.
+struct IBDchainScratch {
+    vector <double> vPrior;  // size: nState
+    vector <double> lk;  // size: nState
+    vector <double> prop;  // size: nState
+    vector <double> fSumState;  // size: nPattern
+    vector <double> sumState;  // size: nPattern
+    double fSum;
+};
+
+
 class IBDpath{
 #ifdef UNITTEST
   friend class TestIBDpath;
@@ -129,17 +175,38 @@ class IBDpath{
   friend class DEploidIO;
     RandomGenerator* ibdRg_;
 
-    double fSum;
     Hprior hprior;
     IBDrecombProbs ibdRecombProbs;
     vector < vector<double> > ibdTransProbs;
-    vector < vector <double> > fm;
-    vector <double> fSumState;
     vector <size_t> ibdConfigurePath;
     vector <size_t> viterbiPath;
 
-    vector < vector <double> > bwd;
-    vector < vector <double> > fwdbwd;
+    // Forward probabilities are stored site major in a flat buffer, which is
+    // allocated on first use and reused every iteration.
+    vector <double> fm;  // size: nLoci x nState
+    double * fmAt(size_t siteI) { return &fm[siteI * hprior.nState()]; }
+    size_t bufferBytes() const;
+
+    // Backward probabilities at the end of each block and the backward
+    // probabilities within a batch of blocks, for the streaming painter
+    vector <double> bwdCheckpoint_;  // size: nBlock x nState
+    vector <double> blockBwd_;  // size: nThreads x blockLen x nState
+
+    // One scratch per thread
+    vector <IBDchainScratch> scratch_;
+
+    // The recursions restart wherever the recombination probability is reset,
+    // i.e. at chromosome boundaries, which splits them into independent
+    // chains. Forward chain c covers [fwdChainStarts_[c], fwdChainEnd(c)),
+    // backward chain c covers [bwdChainBegin(c), bwdChainEnds_[c]].
+    vector <size_t> fwdChainStarts_;
+    vector <size_t> bwdChainEnds_;
+    size_t fwdChainEnd(size_t c) const {
+        return (c + 1 < fwdChainStarts_.size()) ? fwdChainStarts_[c + 1] :
+                                                  this->nLoci(); }
+    size_t bwdChainBegin(size_t c) const {
+        return (c == 0) ? 0 : bwdChainEnds_[c - 1] + 1; }
+    void findChains();
 
     IBDpath();
 
@@ -165,36 +232,48 @@ class IBDpath{
     vector <double> IBDpathChangeAt;
     // Methods
     void computeAndUpdateTheta();
-    void updateFmAtSiteI(const vector <double> & prior,
-                         const vector <double> & llk);
-    void ibdSamplePath(vector <double> statePrior);
+    void updateFmAtSiteI(double * postAtSiteI, const double * prior,
+                         const double * llk, IBDchainScratch &scratch);
+    void fwdStepAtSiteI(const vector <double> &proportion,
+                        const vector <double> &statePrior,
+                        size_t siteI, bool chainStart,
+                        double * postAtSiteI, IBDchainScratch &scratch);
+    void bwdAtChainEnd(const vector <double> &effectiveKPrior,
+                       const vector <double> &statePrior,
+                       size_t chainEnd, double * bwdAtEnd);
+    void bwdStepFromSiteI(const vector <double> &proportion,
+                          const vector <double> &statePrior,
+                          size_t siteI, const double * bwdNext,
+                          double * tmpBw, IBDchainScratch &scratch);
+    void ibdSamplePath(const vector <double> &statePrior);
     void makeIbdTransProbs();
     vector <double> computeEffectiveKPrior(double theta);
     vector <double> computeStatePrior(vector <double> effectiveKPrior);
-    void makeLlkSurf(vector <double> altCount,
-                     vector <double> refCount,
+    size_t nThreads_;
+    void makeLlkSurf(const vector <double> &altCount,
+                     const vector <double> &refCount,
                      double scalingConst = 100.0,
                      double err = 0.01,
                      size_t gridSize = 99);
     void computeUniqueEffectiveKCount();
-    vector <double> computeLlkOfStatesAtSiteI(vector<double> proportion,
-                                              size_t siteI, double err = 0.01);
+    void computeLlkOfStatesAtSiteI(const vector<double> &proportion,
+                                   size_t siteI, double * llks,
+                                   double err = 0.01);
     vector <size_t> findWhichIsSomething(vector <size_t> tmpOp,
                                          size_t something);
 
     // For painting IBD
-    void buildPathProbabilityForPainting(vector <double> proportion);
-    void computeIbdPathFwdProb(vector <double> proportion,
-                               vector <double> statePrior);
-    void computeIbdPathBwdProb(vector <double> proportion,
-                               vector <double> effectiveKPrior,
-                               vector <double> statePrior);
-    void combineFwdBwd(const vector < vector <double>> &reshapedFwd,
-                       const vector < vector <double>> &reshapedBwd);
-    vector < vector <double> > reshapeProbs(
-                              const vector < vector <double> >& probs);
-    double bestPath(vector <double> proportion, double err = 0.01);
+    void computeIbdPathFwdProb(const vector <double> &proportion,
+                               const vector <double> &statePrior);
+    double siteLlkGivenState(const vector <double> &proportion, size_t siteI,
+                             size_t state, double err);
+    void reshapeProbs(const double * probs, double * reshaped);
     double findViterbiPath(vector <double> proportion, double err = 0.01);
+    // Posterior decoding without the nLoci x nState buffers, sites are handed
+    // to writeSite in order. Returns the best path likelihood.
+    double paintIBDstreaming(const vector <double> &proportion,
+                             const IBDpostProbSink &writeSite,
+                             double err = 0.01);
 
  public:
     vector <string> getIBDprobsHeader();
@@ -282,7 +282,9 @@ void McmcMachinery::initializePropIBD() {
 void McmcMachinery::runMcmcChain( bool showProgress, bool useIBD, bool notInR, bool averageP) {
 
     string trace_filename = dEploidIO_->prefix_+".trace.log";
-    std::ofstream trace_log(trace_filename);
+    OutputFile trace_log;
+    trace_log.setPrecision(this->dEploidIO_->precision());
+    this->dEploidIO_->openOutput(trace_log, trace_filename);
     trace_log<<"iteration\tlikelihood\tK";
     for(size_t i=0;i<this->currentProp_.size();i++)
         trace_log<<"\tw"<<(i+1);
@@ -302,6 +304,7 @@ void McmcMachinery::runMcmcChain( bool showProgress, bool useIBD, bool notInR, b
 
         //printArray(this->currentProp_);
     }
+    trace_log.close();
 
     #ifndef RBUILD
         clog << "\r" << " MCMC step" << setw(4) << 100 << "% completed ("<<this->mcmcJob<<")"<<endl;
@@ -348,10 +351,6 @@ void McmcMachinery::runMcmcChain( bool showProgress, bool useIBD, bool notInR, b
         for (size_t atSiteI = 0; atSiteI < nLoci(); atSiteI++ ) {
             this->ibdPath.IBDpathChangeAt[atSiteI] /= (double)this->maxIteration_;
         }
-        //vector < vector <double> > reshapedProbs = this->reshapeFm(hprior.stateIdx);
-        //this->dEploidIO_->ibdProbsHeader = getIBDprobsHeader();
-        //this->dEploidIO_->ibdProbsIntegrated = getIBDprobsIntegrated(reshapedProbs);
-        //this->dEploidIO_->writeIBDpostProb(reshapedProbs, this->dEploidIO_->ibdProbsHeader);
         //clog << "Proportion update acceptance rate: "<<acceptUpdate / (this->kStrain()*1.0*this->maxIteration_)<<endl;
         this->dEploidIO_->initialProp = averageProportion();
         this->dEploidIO_->setInitialPropWasGiven(true);
@@ -432,7 +431,7 @@ vector <double> McmcMachinery::averageProportion() {
 }
 
 
-void McmcMachinery::sampleMcmcEvent( std::ostream& trace_log, bool useIBD) {
+void McmcMachinery::sampleMcmcEvent( OutputFile& trace_log, bool useIBD) {
     this->recordingMcmcBool_ = ( currentMcmcIteration_ > this->mcmcThresh_ && currentMcmcIteration_ % this->McmcMachineryRate_ == 0 );
     if ( useIBD == true ) {
         ibdSampleMcmcEventStep();
@@ -474,6 +473,7 @@ void McmcMachinery::ibdInitializeEssentials() {
 
     this->initializePropIBD();
     this->ibdPath.init(*this->dEploidIO_, this->hapRg_);
+    this->dEploidIO_->ibdBufferBytes_ = this->ibdPath.bufferBytes();
 
     vector <double> llkOfData;
     for ( size_t i = 0; i < nLoci(); i++) {
@@ -612,7 +612,7 @@ int find_K2(vector<double> props)
     return K;
 }
 
-void McmcMachinery::recordMcmcMachinery( std::ostream& trace_log ) {
+void McmcMachinery::recordMcmcMachinery( OutputFile& trace_log ) {
     dout << "***Record mcmc sample " <<endl;
     auto likelihood = product(this->currentSiteLikelihoods_);
 
@@ -634,7 +634,6 @@ void McmcMachinery::recordMcmcMachinery( std::ostream& trace_log ) {
     for(auto& prop: sortedProp)
         trace_log<<"\t"<<prop;
     trace_log<<"\n";
-    trace_log.flush();
 }
 
 
@@ -185,8 +185,8 @@ class McmcMachinery {
         dout << endl;
     }
 
-    void sampleMcmcEvent(std::ostream&, bool useIBD = false);
-    void recordMcmcMachinery(std::ostream&);
+    void sampleMcmcEvent(OutputFile&, bool useIBD = false);
+    void recordMcmcMachinery(OutputFile&);
     bool recordingMcmcBool_;
     void writeLastFwdProb(bool useIBD);
     void updateReferencePanel(size_t inbreedingPanelSizeSetTo,
@@ -212,7 +212,6 @@ class McmcMachinery {
     void ibdUpdateHaplotypesFromPrior();
     vector <double> ibdUpdateProportionGivenHap(
         const vector <double> &llkAtAllSites);
-    // vector <double> getIBDprobsIntegrated(vector < vector <double> > &prob);
 
 
     /* Moves */
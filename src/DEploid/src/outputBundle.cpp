@@ -0,0 +1,260 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstddef>       // offsetof
+#include <cstring>       // memcpy, memset
+#include "outputBundle.hpp"
+#include "outputFile.hpp"
+
+/* Bundle, version 1, in the byte order of the machine that wrote it:
+ *
+ *   header    magic "dEploidB", byte order mark, version, and the uint64
+ *             offset of the table of contents, 0 until the bundle is closed
+ *   chunks    the bytes of the sections, chunk by chunk, interleaved
+ *   contents  uint64 number of sections, then for each section its name, a
+ *             uint32 length followed by the characters, its uint64 size and
+ *             number of chunks, and the uint64 offset and size of each chunk
+ */
+static const char BUNDLE_MAGIC[8] = {'d', 'E', 'p', 'l',
+                                     'o', 'i', 'd', 'B'};
+static const uint32_t BUNDLE_BYTE_ORDER = 0x01020304;
+static const uint32_t BUNDLE_VERSION = 1;
+
+struct BundleHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint64_t contentsOffset;
+};
+
+
+OutputBundle::OutputBundle() : file_(NULL), fileSize_(0),
+                               writeFailed_(false) {}
+
+
+OutputBundle::~OutputBundle() {
+    try {
+        this->close();
+    } catch (...) {
+    }
+}
+
+
+void OutputBundle::open(const string &fileName) {
+    this->close();
+    this->file_ = fopen(fileName.c_str(), "wb");
+    if (this->file_ == NULL) {
+        throw CannotWriteFile(fileName);
+    }
+    this->fileName_ = fileName;
+    this->fileSize_ = 0;
+    this->writeFailed_ = false;
+    this->sections_.clear();
+
+    BundleHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUNDLE_MAGIC, sizeof(header.magic));
+    header.byteOrder = BUNDLE_BYTE_ORDER;
+    header.version = BUNDLE_VERSION;
+    this->writeBytes(&header, sizeof(header));
+}
+
+
+void OutputBundle::close() {
+    if (this->file_ == NULL) {
+        return;
+    }
+    std::lock_guard <std::mutex> lock(this->mutex_);
+    uint64_t contentsOffset = this->fileSize_;
+    uint64_t nSections = 0;
+    for (Section const& section : this->sections_) {
+        nSections += section.removed ? 0 : 1;
+    }
+    this->writeBytes(&nSections, sizeof(nSections));
+    for (Section const& section : this->sections_) {
+        if (section.removed) {
+            continue;
+        }
+        uint32_t nameLength = section.name.size();
+        this->writeBytes(&nameLength, sizeof(nameLength));
+        this->writeBytes(section.name.data(), section.name.size());
+        uint64_t size = 0;
+        for (uint64_t chunkSize : section.chunkSizes) {
+            size += chunkSize;
+        }
+        uint64_t nChunks = section.chunkSizes.size();
+        this->writeBytes(&size, sizeof(size));
+        this->writeBytes(&nChunks, sizeof(nChunks));
+        for (size_t i = 0; i < nChunks; i++) {
+            this->writeBytes(&section.chunkOffsets[i], sizeof(uint64_t));
+            this->writeBytes(&section.chunkSizes[i], sizeof(uint64_t));
+        }
+    }
+    // The offset goes in last, so a bundle cut short is never read
+    if (fseek(this->file_, offsetof(BundleHeader, contentsOffset),
+              SEEK_SET) != 0) {
+        this->writeFailed_ = true;
+    }
+    this->writeBytes(&contentsOffset, sizeof(contentsOffset));
+    if (fclose(this->file_) != 0) {
+        this->writeFailed_ = true;
+    }
+    this->file_ = NULL;
+    if (this->writeFailed_) {
+        throw CannotWriteFile(this->fileName_);
+    }
+}
+
+
+size_t OutputBundle::openSection(const string &name, bool append) {
+    std::lock_guard <std::mutex> lock(this->mutex_);
+    for (size_t i = 0; i < this->sections_.size(); i++) {
+        Section &section = this->sections_[i];
+        if (section.name != name) {
+            continue;
+        }
+        if (!append || section.removed) {
+            section.chunkOffsets.clear();
+            section.chunkSizes.clear();
+        }
+        section.removed = false;
+        return i;
+    }
+    Section section;
+    section.name = name;
+    section.removed = false;
+    this->sections_.push_back(section);
+    return this->sections_.size() - 1;
+}
+
+
+void OutputBundle::removeSection(const string &name) {
+    std::lock_guard <std::mutex> lock(this->mutex_);
+    for (Section &section : this->sections_) {
+        if (section.name == name) {
+            section.removed = true;
+            section.chunkOffsets.clear();
+            section.chunkSizes.clear();
+        }
+    }
+}
+
+
+void OutputBundle::write(size_t sectionIndex, const char * data,
+                         size_t nBytes) {
+    if (nBytes == 0) {
+        return;
+    }
+    std::lock_guard <std::mutex> lock(this->mutex_);
+    Section &section = this->sections_.at(sectionIndex);
+    section.chunkOffsets.push_back(this->fileSize_);
+    section.chunkSizes.push_back(nBytes);
+    this->writeBytes(data, nBytes);
+}
+
+
+bool OutputBundle::writeBytes(const void * data, size_t nBytes) {
+    if (fwrite(data, 1, nBytes, this->file_) != nBytes) {
+        this->writeFailed_ = true;
+        return false;
+    }
+    this->fileSize_ += nBytes;
+    return true;
+}
+
+
+OutputBundleReader::OutputBundleReader(const string &fileName)
+    : fileName_(fileName), bytes_(fileName) {
+    BundleHeader header = this->bytes_.read<BundleHeader>();
+    if (memcmp(header.magic, BUNDLE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.byteOrder != BUNDLE_BYTE_ORDER ||
+        header.version != BUNDLE_VERSION || header.contentsOffset == 0) {
+        throw InvalidBinaryFile(fileName);
+    }
+    this->bytes_.seek(header.contentsOffset);
+    uint64_t nSections = this->bytes_.read<uint64_t>();
+    for (uint64_t i = 0; i < nSections; i++) {
+        Section section;
+        section.name = this->bytes_.readString();
+        section.size = this->bytes_.read<uint64_t>();
+        uint64_t nChunks = this->bytes_.read<uint64_t>();
+        for (uint64_t chunkI = 0; chunkI < nChunks; chunkI++) {
+            section.chunkOffsets.push_back(this->bytes_.read<uint64_t>());
+            section.chunkSizes.push_back(this->bytes_.read<uint64_t>());
+        }
+        this->sections_.push_back(section);
+    }
+}
+
+
+vector <string> OutputBundleReader::sections() const {
+    vector <string> ret;
+    for (Section const& section : this->sections_) {
+        ret.push_back(section.name);
+    }
+    return ret;
+}
+
+
+uint64_t OutputBundleReader::sectionSize(const string &name) const {
+    return this->findSection(name).size;
+}
+
+
+string OutputBundleReader::readSection(const string &name) {
+    const Section &section = this->findSection(name);
+    string ret;
+    for (size_t i = 0; i < section.chunkSizes.size(); i++) {
+        this->bytes_.seek(section.chunkOffsets[i]);
+        ret.append(this->bytes_.take(section.chunkSizes[i]),
+                   section.chunkSizes[i]);
+    }
+    return ret;
+}
+
+
+void OutputBundleReader::extractSection(const string &name,
+                                        const string &toFileName) {
+    const Section &section = this->findSection(name);
+    OutputFile outFile;
+    outFile.open(toFileName);
+    for (size_t i = 0; i < section.chunkSizes.size(); i++) {
+        this->bytes_.seek(section.chunkOffsets[i]);
+        outFile << std::string_view(this->bytes_.take(section.chunkSizes[i]),
+                                    section.chunkSizes[i]);
+    }
+    outFile.close();
+}
+
+
+const OutputBundleReader::Section & OutputBundleReader::findSection(
+    const string &name) const {
+    for (Section const& section : this->sections_) {
+        if (section.name == name) {
+            return section;
+        }
+    }
+    throw SectionNotInBundle(name);
+}
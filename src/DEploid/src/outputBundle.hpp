@@ -0,0 +1,123 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>  /* string */
+#include <vector>  /* vector */
+#include "binaryFile.hpp"
+
+#ifndef DEPLOID_SRC_OUTPUTBUNDLE_HPP_
+#define DEPLOID_SRC_OUTPUTBUNDLE_HPP_
+
+using std::string;
+using std::vector;
+
+
+struct SectionNotInBundle : public InvalidInput{
+    explicit SectionNotInBundle(string str):InvalidInput(str) {
+        this->reason = "No such section in the bundle: ";
+        throwMsg = this->reason + this->src;
+    }
+    ~SectionNotInBundle() throw() {}
+};
+
+
+/*! \brief One container file holding the output files of a run
+ *
+ * Each output file is a section of the bundle. The chunks of the sections
+ * are written to the bundle as they come, interleaved, and a table of
+ * contents, listing the chunks of each section, is written at the end once
+ * the bundle is closed. Writes are thread safe, so the output files of the
+ * jobs of a batch share one bundle.
+ */
+class OutputBundle {
+ public:
+    OutputBundle();
+    ~OutputBundle();
+
+    void open(const string &fileName);
+    // Writes the table of contents, and throws if any write failed
+    void close();
+    bool isOpen() const { return this->file_ != NULL; }
+
+    // Starts the section anew, or continues it if appending. Returns the
+    // section index to write to.
+    size_t openSection(const string &name, bool append);
+    void removeSection(const string &name);
+    void write(size_t sectionIndex, const char * data, size_t nBytes);
+
+ private:
+    OutputBundle(const OutputBundle &);
+    OutputBundle & operator=(const OutputBundle &);
+
+    struct Section {
+        string name;
+        bool removed;
+        vector <uint64_t> chunkOffsets;
+        vector <uint64_t> chunkSizes;
+    };
+
+    string fileName_;
+    FILE * file_;
+    uint64_t fileSize_;
+    bool writeFailed_;
+    vector <Section> sections_;
+    std::mutex mutex_;
+
+    bool writeBytes(const void * data, size_t nBytes);
+};
+
+
+// Reads the sections of a closed bundle
+class OutputBundleReader {
+ public:
+    explicit OutputBundleReader(const string &fileName);
+
+    vector <string> sections() const;
+    uint64_t sectionSize(const string &name) const;
+    string readSection(const string &name);
+    void extractSection(const string &name, const string &toFileName);
+
+ private:
+    OutputBundleReader(const OutputBundleReader &);
+    OutputBundleReader & operator=(const OutputBundleReader &);
+
+    struct Section {
+        string name;
+        uint64_t size;
+        vector <uint64_t> chunkOffsets;
+        vector <uint64_t> chunkSizes;
+    };
+
+    string fileName_;
+    BinaryFileReader bytes_;
+    vector <Section> sections_;
+
+    const Section & findSection(const string &name) const;
+};
+
+#endif  // DEPLOID_SRC_OUTPUTBUNDLE_HPP_
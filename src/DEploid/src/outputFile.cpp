@@ -0,0 +1,250 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>     // std::min
+#include <charconv>      // std::to_chars
+#include <cstring>       // memset
+#include "outputFile.hpp"
+#include "outputBundle.hpp"
+
+// Text gathered before it is handed over to the writer thread
+static const size_t OUTPUT_BUFFER_SIZE = 1 << 20;
+// Buffers waiting for the writer thread, before the caller waits too
+static const size_t OUTPUT_MAX_QUEUED_BUFFERS = 4;
+// Digits beyond these do not change the value read back
+static const size_t OUTPUT_MAX_PRECISION = 17;
+
+
+OutputFile::OutputFile() : isOpen_(false), file_(NULL), gzFile_(NULL),
+                           bundle_(NULL), bundleSection_(0),
+                           compressBundleSection_(false), precision_(6),
+                           doneWriting_(false), writeFailed_(false) {}
+
+
+OutputFile::~OutputFile() {
+    try {
+        this->close();
+    } catch (...) {
+    }
+}
+
+
+void OutputFile::open(const string &fileName, bool append, bool compress,
+                      OutputBundle * bundle) {
+    this->close();
+    this->fileName_ = fileName;
+    if (bundle != NULL) {
+        this->bundle_ = bundle;
+        this->bundleSection_ = bundle->openSection(fileName, append);
+        this->compressBundleSection_ = compress;
+    } else if (compress) {
+        this->gzFile_ = gzopen(fileName.c_str(), append ? "ab" : "wb");
+    } else {
+        this->file_ = fopen(fileName.c_str(), append ? "ab" : "wb");
+    }
+    if (this->file_ == NULL && this->gzFile_ == NULL &&
+        this->bundle_ == NULL) {
+        throw CannotWriteFile(fileName);
+    }
+    this->isOpen_ = true;
+    this->writeFailed_ = false;
+    this->buffer_.reserve(OUTPUT_BUFFER_SIZE);
+}
+
+
+void OutputFile::close() {
+    if (!this->isOpen_) {
+        this->buffer_.clear();
+        return;
+    }
+    if (this->writer_.joinable()) {
+        this->handOver();
+        {
+            std::lock_guard <std::mutex> lock(this->queueMutex_);
+            this->doneWriting_ = true;
+        }
+        this->queueChanged_.notify_all();
+        this->writer_.join();
+        this->doneWriting_ = false;
+    } else if (!this->writeChunk(this->buffer_)) {
+        this->writeFailed_ = true;
+    }
+    this->buffer_.clear();
+
+    if (this->gzFile_ != NULL && gzclose(this->gzFile_) != Z_OK) {
+        this->writeFailed_ = true;
+    }
+    if (this->file_ != NULL && fclose(this->file_) != 0) {
+        this->writeFailed_ = true;
+    }
+    this->gzFile_ = NULL;
+    this->file_ = NULL;
+    this->bundle_ = NULL;
+    this->isOpen_ = false;
+    if (this->writeFailed_) {
+        throw CannotWriteFile(this->fileName_);
+    }
+}
+
+
+void OutputFile::setPrecision(size_t precision) {
+    this->precision_ = std::min(precision, OUTPUT_MAX_PRECISION);
+}
+
+
+OutputFile & OutputFile::writeDouble(double value, size_t width) {
+    char chars[64];
+    char * end;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    if (this->precision_ == 0) {
+        end = std::to_chars(chars, chars + sizeof(chars), value).ptr;
+    } else {
+        end = std::to_chars(chars, chars + sizeof(chars), value,
+                            std::chars_format::general,
+                            static_cast<int>(this->precision_)).ptr;
+    }
+#else
+    int precision = (this->precision_ == 0) ?
+        static_cast<int>(OUTPUT_MAX_PRECISION) :
+        static_cast<int>(this->precision_);
+    end = chars + snprintf(chars, sizeof(chars), "%.*g", precision, value);
+#endif
+    size_t length = end - chars;
+    if (length < width) {
+        this->buffer_.append(width - length, ' ');
+    }
+    this->buffer_.append(chars, length);
+    this->handOverIfFull();
+    return *this;
+}
+
+
+void OutputFile::appendInteger(long long value) {
+    char chars[24];
+    char * end = std::to_chars(chars, chars + sizeof(chars), value).ptr;
+    this->buffer_.append(chars, end - chars);
+}
+
+
+void OutputFile::handOverIfFull() {
+    if (this->buffer_.size() < OUTPUT_BUFFER_SIZE) {
+        return;
+    }
+    if (this->isOpen_) {
+        this->handOver();
+    } else {
+        this->buffer_.clear();
+    }
+}
+
+
+void OutputFile::handOver() {
+    if (this->buffer_.size() == 0) {
+        return;
+    }
+    if (!this->writer_.joinable()) {
+        this->writer_ = std::thread([this]() { this->writeQueuedChunks(); });
+    }
+    {
+        std::unique_lock <std::mutex> lock(this->queueMutex_);
+        this->queueChanged_.wait(lock, [this]() {
+            return this->queue_.size() < OUTPUT_MAX_QUEUED_BUFFERS; });
+        this->queue_.push_back(string());
+        this->queue_.back().swap(this->buffer_);
+    }
+    this->queueChanged_.notify_all();
+    this->buffer_.reserve(OUTPUT_BUFFER_SIZE);
+}
+
+
+// The whole chunk as one gzip member
+static bool gzipChunk(const string &chunk, string &member) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    member.resize(deflateBound(&stream, chunk.size()));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(
+        chunk.data()));
+    stream.avail_in = static_cast<uInt>(chunk.size());
+    stream.next_out = reinterpret_cast<Bytef *>(&member[0]);
+    stream.avail_out = static_cast<uInt>(member.size());
+    int status = deflate(&stream, Z_FINISH);
+    member.resize(stream.total_out);
+    deflateEnd(&stream);
+    return status == Z_STREAM_END;
+}
+
+
+bool OutputFile::writeChunk(const string &chunk) {
+    if (chunk.size() == 0) {
+        return true;
+    }
+    if (this->bundle_ != NULL && this->compressBundleSection_) {
+        string member;
+        if (!gzipChunk(chunk, member)) {
+            return false;
+        }
+        this->bundle_->write(this->bundleSection_, member.data(),
+                             member.size());
+        return true;
+    }
+    if (this->bundle_ != NULL) {
+        this->bundle_->write(this->bundleSection_, chunk.data(),
+                             chunk.size());
+        return true;
+    }
+    if (this->gzFile_ != NULL) {
+        return gzwrite(this->gzFile_, chunk.data(),
+                       static_cast<unsigned>(chunk.size())) ==
+               static_cast<int>(chunk.size());
+    }
+    return fwrite(chunk.data(), 1, chunk.size(), this->file_) == chunk.size();
+}
+
+
+// Chunks are written in the order they were handed over. After a failed
+// write the rest are dropped, and close() throws.
+void OutputFile::writeQueuedChunks() {
+    string chunk;
+    while (true) {
+        {
+            std::unique_lock <std::mutex> lock(this->queueMutex_);
+            this->queueChanged_.wait(lock, [this]() {
+                return !this->queue_.empty() || this->doneWriting_; });
+            if (this->queue_.empty()) {
+                return;
+            }
+            chunk.swap(this->queue_.front());
+            this->queue_.pop_front();
+        }
+        this->queueChanged_.notify_all();
+        if (!this->writeFailed_ && !this->writeChunk(chunk)) {
+            this->writeFailed_ = true;
+        }
+    }
+}
@@ -0,0 +1,120 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <zlib.h>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>  // std::enable_if, std::is_integral
+#include "exceptions.hpp"
+
+#ifndef DEPLOID_SRC_OUTPUTFILE_HPP_
+#define DEPLOID_SRC_OUTPUTFILE_HPP_
+
+using std::string;
+
+class OutputBundle;
+
+
+/*! \brief Buffered text output, written out on a background thread
+ *
+ * Text is gathered in a buffer. Full buffers are handed over to a writer
+ * thread, which also compresses them for gzipped files, so the caller does
+ * not wait on the disk. Doubles are written as iostream does, with the given
+ * number of significant digits, or as the shortest text that reads back to
+ * the same value if the precision is 0. Text written while no file is open
+ * is dropped.
+ */
+class OutputFile {
+ public:
+    OutputFile();
+    ~OutputFile();
+
+    void open(const string &fileName, bool append = false,
+              bool compress = false, OutputBundle * bundle = NULL);
+    // Writes out the rest of the text, and throws if any write failed
+    void close();
+    bool isOpen() const { return this->isOpen_; }
+    // Significant digits of doubles, the same default as iostream
+    void setPrecision(size_t precision);
+
+    OutputFile & operator<<(std::string_view str) {
+        this->buffer_.append(str.data(), str.size());
+        this->handOverIfFull();
+        return *this;
+    }
+    OutputFile & operator<<(char c) {
+        this->buffer_.push_back(c);
+        this->handOverIfFull();
+        return *this;
+    }
+    OutputFile & operator<<(double value) {
+        return this->writeDouble(value, 0);
+    }
+    template <class T, typename std::enable_if<std::is_integral<T>::value &&
+        !std::is_same<T, char>::value && !std::is_same<T, bool>::value,
+        int>::type = 0>
+    OutputFile & operator<<(T value) {
+        this->appendInteger(static_cast<long long>(value));
+        this->handOverIfFull();
+        return *this;
+    }
+    // Same as << setw(width) << value
+    OutputFile & writeDouble(double value, size_t width);
+
+ private:
+    OutputFile(const OutputFile &);
+    OutputFile & operator=(const OutputFile &);
+
+    string fileName_;
+    bool isOpen_;
+    FILE * file_;
+    gzFile gzFile_;
+    OutputBundle * bundle_;
+    size_t bundleSection_;
+    bool compressBundleSection_;
+    size_t precision_;
+    string buffer_;
+
+    // Writer thread, started once the first buffer is full
+    std::thread writer_;
+    std::mutex queueMutex_;
+    std::condition_variable queueChanged_;
+    std::deque <string> queue_;
+    bool doneWriting_;
+    bool writeFailed_;
+
+    void appendInteger(long long value);
+    void handOverIfFull();
+    void handOver();
+    bool writeChunk(const string &chunk);
+    void writeQueuedChunks();
+};
+
+#endif  // DEPLOID_SRC_OUTPUTFILE_HPP_
@@ -28,7 +28,9 @@
 #include <iostream>
 using std::endl;
 
-Panel::Panel():TxtReader() {
+Panel::Panel():TxtReader(),
+    recombProbsFromFile_(false),
+    recombProbsFromFileParameters_(0.0, 0.0, false, 0.0, false) {
     this->setTruePanelSize(0);
     this->setInbreedingPanelSize(0);
 }
@@ -41,7 +43,9 @@ Panel::Panel(vector < double > pRec,
              vector < double > pRecNoRec,
              vector < double > pNoRecNoRec,
              vector < vector < double > > content,
-             vector < string > header) {
+             vector < string > header)
+    : recombProbsFromFile_(false),
+      recombProbsFromFileParameters_(0.0, 0.0, false, 0.0, false) {
              this->pRec_ = vector <double> (pRec.begin(), pRec.end());
     this->pRecEachHap_ = vector <double> (pRecEachHap.begin(),
                                           pRecEachHap.end());
@@ -64,7 +68,46 @@ Panel::Panel(vector < double > pRec,
 }
 
 
-Panel::Panel(const Panel &copyFrom) {
+Panel::Panel(const Panel &copyFrom)
+    : recombProbsFromFile_(copyFrom.recombProbsFromFile_),
+      recombProbsFromFileParameters_(copyFrom.recombProbsFromFileParameters_) {
+    this->copyAllButContent(copyFrom);
+    for (size_t i = 0; i < copyFrom.content_.size(); i++) {
+        this->content_.push_back(vector <double> (copyFrom.content_[i].begin(),
+                                                  copyFrom.content_[i].end()));
+    }
+}
+
+
+// As copying the panel, recomputing the recombination probabilities if asked
+// and then calling findAndKeepMarkersGivenIndex, but only the kept sites of
+// the content are ever copied.
+Panel::Panel(const Panel &copyFrom, const vector <size_t> & givenIndex,
+             const RecombProbsParameters * recombProbsParameters)
+    : recombProbsFromFile_(copyFrom.recombProbsFromFile_),
+      recombProbsFromFileParameters_(copyFrom.recombProbsFromFileParameters_) {
+    this->copyAllButContent(copyFrom);
+    if (recombProbsParameters != NULL) {
+        this->computeRecombProbs(
+            recombProbsParameters->averageCentimorganDistance,
+            recombProbsParameters->G,
+            recombProbsParameters->useConstRecomb,
+            recombProbsParameters->constRecombProb,
+            recombProbsParameters->forbidCopyFromSame);
+    }
+    this->setDoneGetIndexOfChromStarts(false);
+    this->findWhoToBeKeptGivenIndex(givenIndex);
+    this->getIndexOfChromStarts();
+    this->content_.reserve(givenIndex.size());
+    for (auto const& value : givenIndex) {
+        this->content_.push_back(copyFrom.content_[value]);
+    }
+    this->nLoci_ = this->content_.size();
+    this->recombProbsFromFile_ = false;
+}
+
+
+void Panel::copyAllButContent(const Panel &copyFrom) {
     nLoci_ = copyFrom.nLoci_;
 
     chrom_ = vector <string> (copyFrom.chrom_.begin(), copyFrom.chrom_.end());
@@ -88,11 +131,6 @@ Panel::Panel(const Panel &copyFrom) {
                                         copyFrom.pRecNoRec_.end());
     this->pNoRecNoRec_ = vector <double> (copyFrom.pNoRecNoRec_.begin(),
                                           copyFrom.pNoRecNoRec_.end());
-    for (size_t i = 0; i < copyFrom.content_.size(); i++) {
-        this->content_.push_back(vector <double> (copyFrom.content_[i].begin(),
-                                                  copyFrom.content_[i].end()));
-    }
-    this->setTruePanelSize(this->content_[0].size());
 
     truePanelSize_ = copyFrom.truePanelSize_;
 
@@ -107,6 +145,10 @@ Panel::Panel(const Panel &copyFrom) {
 
 
 void Panel::readFromFile(const char inchar[]) {
+    if (Panel::isBinaryFile(inchar)) {
+        this->readFromBinaryFile(inchar);
+        return;
+    }
     this->readFromFileBase(inchar);
     this->setTruePanelSize(this->nInfoLines_);
     this->setInbreedingPanelSize(this->truePanelSize());
@@ -128,6 +170,14 @@ void Panel::checkForExceptions(size_t nLoci, string panelFileName) {
 void Panel::computeRecombProbs(double averageCentimorganDistance,
     double G, bool useConstRecomb, double constRecombProb,
     bool forbidCopyFromSame) {
+    if (this->recombProbsFromFile_ &&
+        this->recombProbsFromFileParameters_ == RecombProbsParameters(
+            averageCentimorganDistance, G, useConstRecomb, constRecombProb,
+            forbidCopyFromSame) &&
+        this->pRec_.size() == this->content_.size()) {
+        return;
+    }
+    this->recombProbsFromFile_ = false;
 
     pRec_.clear();
     pRecEachHap_.clear();
@@ -265,21 +315,49 @@ void Panel::updatePanelWithHaps(size_t inbreedingPanelSizeSetTo,
     }
 
     for (size_t siteI = 0; siteI < this->content_.size(); siteI++) {
-        size_t shiftAfter = this->inbreedingPanelSize();
+        this->fillInbreedingColumns(this->content_[siteI],
+            this->inbreedingPanelSize(), excludedStrain, haps[siteI]);
+    }
+}
 
-        for (size_t panelStrainJ = this->truePanelSize();
-            panelStrainJ < this->inbreedingPanelSize(); panelStrainJ++) {
-            size_t strainIndex = panelStrainJ - this->truePanelSize();
 
-            if (strainIndex == excludedStrain) {
-                shiftAfter = panelStrainJ;
-            }
+// The sites [start, start+length) of the panel as initializeUpdatePanel and
+// updatePanelWithHaps would leave them, without touching the panel, so that
+// strains can be worked on at the same time.
+vector < vector <double> > Panel::inbreedingRows(size_t start, size_t length,
+    size_t inbreedingPanelSizeSetTo, size_t excludedStrain,
+    const vector < vector<double> > & haps) const {
+    vector < vector <double> > rows(length);
+    for (size_t siteI = 0; siteI < length; siteI++) {
+        const vector <double> & panelRow = this->content_[start + siteI];
+        rows[siteI].reserve(inbreedingPanelSizeSetTo);
+        rows[siteI].assign(panelRow.begin(),
+                           panelRow.begin() + this->truePanelSize());
+        rows[siteI].resize(inbreedingPanelSizeSetTo);
+        this->fillInbreedingColumns(rows[siteI], inbreedingPanelSizeSetTo,
+                                    excludedStrain, haps[start + siteI]);
+    }
+    return rows;
+}
+
+
+void Panel::fillInbreedingColumns(vector <double> & row,
+    size_t inbreedingPanelSize, size_t excludedStrain,
+    const vector <double> & siteHaps) const {
+    size_t shiftAfter = inbreedingPanelSize;
+
+    for (size_t panelStrainJ = this->truePanelSize();
+        panelStrainJ < inbreedingPanelSize; panelStrainJ++) {
+        size_t strainIndex = panelStrainJ - this->truePanelSize();
+
+        if (strainIndex == excludedStrain) {
+            shiftAfter = panelStrainJ;
+        }
 
-            if (shiftAfter <= panelStrainJ) {
-                strainIndex++;
-            }
-            this->content_[siteI][panelStrainJ] = haps[siteI][strainIndex];
+        if (shiftAfter <= panelStrainJ) {
+            strainIndex++;
         }
+        row[panelStrainJ] = siteHaps[strainIndex];
     }
 }
 
@@ -309,6 +387,7 @@ void Panel::findAndKeepMarkersGivenIndex(
     this->trimVec(this->pRecRec_, givenIndex);
     this->trimVec(this->pRecNoRec_, givenIndex);
     this->trimVec(this->pNoRecNoRec_, givenIndex);
+    this->recombProbsFromFile_ = false;
 }
 
 
@@ -325,6 +404,7 @@ void Panel::findAndKeepMarkersGivenIndexHalf(
     this->trimVec(this->pRecRec_, givenIndex);
     this->trimVec(this->pRecNoRec_, givenIndex);
     this->trimVec(this->pNoRecNoRec_, givenIndex);
+    this->recombProbsFromFile_ = false;
 }
 
 void IBDrecombProbs::computeRecombProbs(double averageCentimorganDistance,
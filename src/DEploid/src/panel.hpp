@@ -32,6 +32,39 @@
 #include "txtReader.hpp"
 #include "exceptions.hpp"
 
+
+struct NonBinaryPanelEntry : public InvalidInput{
+    explicit NonBinaryPanelEntry(string str):InvalidInput(str) {
+        this->reason = "Only 0 and 1 can be stored in a binary panel, check: ";
+        throwMsg = this->reason + this->src;
+    }
+    ~NonBinaryPanelEntry() throw() {}
+};
+
+
+// Parameters of Panel::computeRecombProbs
+struct RecombProbsParameters {
+    double averageCentimorganDistance;
+    double G;
+    bool useConstRecomb;
+    double constRecombProb;
+    bool forbidCopyFromSame;
+    RecombProbsParameters(double averageCentimorganDistance, double G,
+        bool useConstRecomb, double constRecombProb, bool forbidCopyFromSame)
+        : averageCentimorganDistance(averageCentimorganDistance), G(G),
+          useConstRecomb(useConstRecomb), constRecombProb(constRecombProb),
+          forbidCopyFromSame(forbidCopyFromSame) {}
+    bool operator==(const RecombProbsParameters &other) const {
+        return this->averageCentimorganDistance ==
+                   other.averageCentimorganDistance &&
+               this->G == other.G &&
+               this->useConstRecomb == other.useConstRecomb &&
+               this->constRecombProb == other.constRecombProb &&
+               this->forbidCopyFromSame == other.forbidCopyFromSame;
+    }
+};
+
+
 class Panel: public TxtReader{
   #ifdef UNITTEST
   friend class TestPanel;
@@ -57,6 +90,12 @@ class Panel: public TxtReader{
     vector < double > pRecNoRec_;  // pRecEachHap * pNoRec;
     vector < double > pNoRecNoRec_;  // pNoRec * pNoRec;
 
+    // The recombination probabilities read from a binary panel are kept as
+    // long as they are asked for with the same parameters, and no site was
+    // removed.
+    bool recombProbsFromFile_;
+    RecombProbsParameters recombProbsFromFileParameters_;
+
     size_t truePanelSize_;
     void setTruePanelSize(const size_t setTo) {
         this->truePanelSize_ = setTo; }
@@ -77,16 +116,28 @@ class Panel: public TxtReader{
           vector < vector < double > > content,
           vector < string > header);
     Panel(const Panel &copyFrom);
+    Panel(const Panel &copyFrom, const vector <size_t> & givenIndex,
+          const RecombProbsParameters * recombProbsParameters);
     // Panel(const char inchar[]);
+    void copyAllButContent(const Panel &copyFrom);
 
     // Methods
     void readFromFile(const char inchar[]);
+    void readFromBinaryFile(const string &fileName);
+    void writeBinaryFile(const string &fileName,
+                         bool withRecombProbs) const;
     void computeRecombProbs(double averageCentimorganDistance, double Ne,
         bool useConstRecomb, double constRecombProb, bool forbidCopyFromSame);
     void checkForExceptions(size_t nLoci, string panelFileName);
     void initializeUpdatePanel(size_t inbreedingPanelSizeSetTo);
     void updatePanelWithHaps(size_t inbreedingPanelSizeSetTo,
         size_t excludedStrain, const vector < vector<double> > & haps);
+    vector < vector <double> > inbreedingRows(size_t start, size_t length,
+        size_t inbreedingPanelSizeSetTo, size_t excludedStrain,
+        const vector < vector<double> > & haps) const;
+    void fillInbreedingColumns(vector <double> & row,
+        size_t inbreedingPanelSize, size_t excludedStrain,
+        const vector <double> & siteHaps) const;
 
     void print();
     void buildExamplePanelContent();
@@ -100,6 +151,17 @@ class Panel: public TxtReader{
 
  public:
     virtual ~Panel() {}
+
+    // Binary panels start with a magic string, a byte order mark and a
+    // version, they are read by readFromFile as text panels are.
+    static bool isBinaryFile(const string &fileName);
+    // Converts a text panel, with the recombination probabilities computed
+    // for the given parameters unless recombProbsParameters is NULL
+    static void convertToBinary(const string &textPanelFileName,
+        const string &binaryPanelFileName,
+        const vector <GenomicRegion> &regions,
+        const string &excludeFileName,
+        const RecombProbsParameters * recombProbsParameters);
 };
 
 
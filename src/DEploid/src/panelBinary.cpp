@@ -0,0 +1,278 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdint>
+#include <cstring>       // memcmp, memcpy, memset
+#include <fstream>
+#include "panel.hpp"
+#include "binaryFile.hpp"
+
+/* Binary panel, version 1, in the byte order of the machine that wrote it:
+ *
+ *   header       magic "dEploidP", byte order mark, version, flags, number
+ *                of sites, of strains and of chromosomes, and the
+ *                parameters of the recombination probabilities
+ *   strains      names, each a uint32 length followed by the characters
+ *   chromosomes  names, as above, of each run of sites on one chromosome
+ *   chromStarts  uint64 index of the first site of each chromosome
+ *   positions    int32 position of each site
+ *   alleles      one bit per strain, site by site, each site padded to a
+ *                whole byte
+ *   recombProbs  if flagged, pRec, pRecEachHap, pNoRec, pRecRec, pRecNoRec
+ *                and pNoRecNoRec as doubles, table by table
+ *
+ * Sections start on 8 byte boundaries.
+ */
+static const char BINARY_PANEL_MAGIC[8] = {'d', 'E', 'p', 'l',
+                                           'o', 'i', 'd', 'P'};
+static const uint32_t BINARY_PANEL_BYTE_ORDER = 0x01020304;
+static const uint32_t BINARY_PANEL_VERSION = 1;
+static const uint32_t BINARY_PANEL_HAS_RECOMB_PROBS = 1;
+
+struct BinaryPanelHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t nLoci;
+    uint64_t nStrains;
+    uint64_t nChrom;
+    double averageCentimorganDistance;
+    double G;
+    double constRecombProb;
+    uint32_t useConstRecomb;
+    uint32_t forbidCopyFromSame;
+};
+
+
+bool Panel::isBinaryFile(const string &fileName) {
+    std::ifstream inFile(fileName.c_str(), std::ios::in | std::ios::binary);
+    char magic[sizeof(BINARY_PANEL_MAGIC)];
+    inFile.read(magic, sizeof(magic));
+    return inFile.gcount() == static_cast<std::streamsize>(sizeof(magic)) &&
+           memcmp(magic, BINARY_PANEL_MAGIC, sizeof(magic)) == 0;
+}
+
+
+// Sites outside the regions, if any are given, are skipped as the alleles
+// are unpacked
+void Panel::readFromBinaryFile(const string &fileName) {
+    this->fileName_ = fileName;
+    BinaryFileReader bytes(fileName);
+
+    BinaryPanelHeader header = bytes.read<BinaryPanelHeader>();
+    if (header.byteOrder != BINARY_PANEL_BYTE_ORDER ||
+        header.version != BINARY_PANEL_VERSION || header.nStrains == 0) {
+        throw InvalidBinaryFile(fileName);
+    }
+    size_t nLoci = header.nLoci;
+    size_t nStrains = header.nStrains;
+    size_t nChrom = header.nChrom;
+
+    this->header_.clear();
+    for (size_t i = 0; i < nStrains; i++) {
+        this->header_.push_back(bytes.readString());
+    }
+    vector <string> chrom;
+    for (size_t i = 0; i < nChrom; i++) {
+        chrom.push_back(bytes.readString());
+    }
+    bytes.align();
+    vector <uint64_t> chromStarts(nChrom + 1, nLoci);
+    bytes.readArray(chromStarts.data(), nChrom);
+    vector <int32_t> positions(nLoci);
+    bytes.readArray(positions.data(), nLoci);
+    bytes.align();
+    size_t bytesPerSite = (nStrains + 7) / 8;
+    const unsigned char * alleles = reinterpret_cast<const unsigned char *>(
+        bytes.take(nLoci * bytesPerSite));
+    for (size_t chromI = 0; chromI < nChrom; chromI++) {
+        if (chromStarts[chromI] > chromStarts[chromI + 1]) {
+            throw InvalidBinaryFile(fileName);
+        }
+    }
+
+    vector <size_t> keptSites;
+    this->chrom_.clear();
+    this->position_.clear();
+    for (size_t chromI = 0; chromI < nChrom; chromI++) {
+        vector <int> positionOfChrom;
+        for (size_t siteI = chromStarts[chromI];
+             siteI < chromStarts[chromI + 1]; siteI++) {
+            if (this->regions_.size() > 0) {
+                bool inRegions = false;
+                for (const GenomicRegion &region : this->regions_) {
+                    inRegions = inRegions ||
+                                region.contains(chrom[chromI], positions[siteI]);
+                }
+                if (!inRegions) {
+                    continue;
+                }
+            }
+            keptSites.push_back(siteI);
+            positionOfChrom.push_back(positions[siteI]);
+        }
+        if (positionOfChrom.size() > 0) {
+            this->chrom_.push_back(chrom[chromI]);
+            this->position_.push_back(positionOfChrom);
+        }
+    }
+    if (this->regions_.size() > 0 && keptSites.size() == 0) {
+        throw NoSitesInRegions(fileName);
+    }
+
+    this->content_.assign(keptSites.size(), vector <double> (nStrains));
+    for (size_t i = 0; i < keptSites.size(); i++) {
+        const unsigned char * site = alleles + keptSites[i] * bytesPerSite;
+        vector <double> &row = this->content_[i];
+        for (size_t strainI = 0; strainI < nStrains; strainI++) {
+            row[strainI] = (site[strainI / 8] >> (strainI % 8)) & 1;
+        }
+    }
+
+    // The tables only hold for the sites they were computed on
+    this->recombProbsFromFile_ =
+        (header.flags & BINARY_PANEL_HAS_RECOMB_PROBS) &&
+        keptSites.size() == nLoci;
+    if (this->recombProbsFromFile_) {
+        bytes.align();
+        vector <double> * tables[] = {&this->pRec_, &this->pRecEachHap_,
+                                      &this->pNoRec_, &this->pRecRec_,
+                                      &this->pRecNoRec_, &this->pNoRecNoRec_};
+        for (vector <double> * table : tables) {
+            table->resize(nLoci);
+            bytes.readArray(table->data(), nLoci);
+        }
+        this->recombProbsFromFileParameters_ = RecombProbsParameters(
+            header.averageCentimorganDistance, header.G,
+            header.useConstRecomb != 0, header.constRecombProb,
+            header.forbidCopyFromSame != 0);
+    }
+
+    this->nLoci_ = this->content_.size();
+    this->nInfoLines_ = nStrains;
+    this->setTruePanelSize(this->nInfoLines_);
+    this->setInbreedingPanelSize(this->truePanelSize());
+    this->getIndexOfChromStarts();
+    this->checkSortedPositions(fileName);
+}
+
+
+void Panel::writeBinaryFile(const string &fileName,
+                            bool withRecombProbs) const {
+    size_t nStrains = this->truePanelSize();
+    BinaryPanelHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_PANEL_MAGIC, sizeof(header.magic));
+    header.byteOrder = BINARY_PANEL_BYTE_ORDER;
+    header.version = BINARY_PANEL_VERSION;
+    header.flags = withRecombProbs ? BINARY_PANEL_HAS_RECOMB_PROBS : 0;
+    header.nLoci = this->content_.size();
+    header.nStrains = nStrains;
+    header.nChrom = this->chrom_.size();
+    if (withRecombProbs) {
+        header.averageCentimorganDistance =
+            this->recombProbsFromFileParameters_.averageCentimorganDistance;
+        header.G = this->recombProbsFromFileParameters_.G;
+        header.constRecombProb =
+            this->recombProbsFromFileParameters_.constRecombProb;
+        header.useConstRecomb =
+            this->recombProbsFromFileParameters_.useConstRecomb;
+        header.forbidCopyFromSame =
+            this->recombProbsFromFileParameters_.forbidCopyFromSame;
+    }
+
+    BinaryFileWriter out(fileName);
+    out.write(header);
+    for (size_t i = 0; i < nStrains; i++) {
+        out.writeString(i < this->header_.size() ? this->header_[i] : "");
+    }
+    for (auto const& chrom : this->chrom_) {
+        out.writeString(chrom);
+    }
+    out.align();
+    for (size_t chromI = 0; chromI < this->chrom_.size(); chromI++) {
+        out.write(static_cast<uint64_t>(this->indexOfChromStarts_[chromI]));
+    }
+    for (auto const& positionOfChrom : this->position_) {
+        for (int position : positionOfChrom) {
+            out.write(static_cast<int32_t>(position));
+        }
+    }
+    out.align();
+    vector <unsigned char> site((nStrains + 7) / 8);
+    for (size_t siteI = 0; siteI < this->content_.size(); siteI++) {
+        std::fill(site.begin(), site.end(), 0);
+        for (size_t strainI = 0; strainI < nStrains; strainI++) {
+            double allele = this->content_[siteI][strainI];
+            if (allele != 0.0 && allele != 1.0) {
+                throw NonBinaryPanelEntry(this->fileName_);
+            }
+            if (allele == 1.0) {
+                site[strainI / 8] |= 1 << (strainI % 8);
+            }
+        }
+        out.write(site.data(), site.size());
+    }
+    if (withRecombProbs) {
+        out.align();
+        const vector <double> * tables[] = {&this->pRec_, &this->pRecEachHap_,
+                                            &this->pNoRec_, &this->pRecRec_,
+                                            &this->pRecNoRec_,
+                                            &this->pNoRecNoRec_};
+        for (const vector <double> * table : tables) {
+            out.writeArray(table->data(), table->size());
+        }
+    }
+    out.close();
+}
+
+
+void Panel::convertToBinary(const string &textPanelFileName,
+    const string &binaryPanelFileName,
+    const vector <GenomicRegion> &regions,
+    const string &excludeFileName,
+    const RecombProbsParameters * recombProbsParameters) {
+    Panel panel;
+    panel.setRegions(regions);
+    panel.readFromFile(textPanelFileName.c_str());
+    if (excludeFileName.size() > 0) {
+        ExcludeMarker excludedMarkers;
+        excludedMarkers.setRegions(regions);
+        excludedMarkers.readFromFile(excludeFileName.c_str());
+        panel.findAndKeepMarkers(&excludedMarkers);
+    }
+    if (recombProbsParameters != NULL) {
+        panel.computeRecombProbs(
+            recombProbsParameters->averageCentimorganDistance,
+            recombProbsParameters->G,
+            recombProbsParameters->useConstRecomb,
+            recombProbsParameters->constRecombProb,
+            recombProbsParameters->forbidCopyFromSame);
+        panel.recombProbsFromFileParameters_ = *recombProbsParameters;
+    }
+    panel.writeBinaryFile(binaryPanelFileName, recombProbsParameters != NULL);
+}
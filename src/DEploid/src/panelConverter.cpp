@@ -0,0 +1,120 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdlib>   // strtod
+#include <iostream>  // std::cout
+#include <string>
+#include <vector>
+#include "panel.hpp"
+
+using std::string;
+using std::vector;
+
+static void printUsage(std::ostream &output) {
+    output << "Usage: panelConverter -panel FILE -o FILE [-exclude FILE] "
+           << "[-region STR]... [-G FLT] [-recomb FLT] [-forbidSame] "
+           << "[-noRecombTables]" << std::endl
+           << "Converts a text reference panel into a binary panel for "
+           << "dEploid -panel." << std::endl
+           << "The recombination probabilities are stored for the given "
+           << "-G, -recomb and -forbidSame, and reused by dEploid runs with "
+           << "the same values." << std::endl;
+}
+
+
+static string nextArgument(int argc, char *argv[], int &i) {
+    string flag(argv[i]);
+    if (++i >= argc) {
+        throw NotEnoughArg(flag);
+    }
+    return string(argv[i]);
+}
+
+
+static double nextDouble(int argc, char *argv[], int &i) {
+    string flag(argv[i]);
+    string value = nextArgument(argc, argv, i);
+    char * end;
+    double ret = strtod(value.c_str(), &end);
+    if (value.size() == 0 || *end != '\0') {
+        throw WrongType(flag);
+    }
+    return ret;
+}
+
+
+int main(int argc, char *argv[]) {
+    try {
+        string panelFileName, outFileName, excludeFileName;
+        vector <GenomicRegion> regions;
+        // Same defaults as dEploid
+        RecombProbsParameters parameters(15000.0, 20.0, false, 1.0, false);
+        bool withRecombTables = true;
+
+        for (int i = 1; i < argc; i++) {
+            string flag(argv[i]);
+            if (flag == "-panel") {
+                panelFileName = nextArgument(argc, argv, i);
+            } else if (flag == "-o") {
+                outFileName = nextArgument(argc, argv, i);
+            } else if (flag == "-exclude") {
+                excludeFileName = nextArgument(argc, argv, i);
+            } else if (flag == "-region") {
+                regions.push_back(GenomicRegion(nextArgument(argc, argv, i)));
+            } else if (flag == "-G") {
+                parameters.G = nextDouble(argc, argv, i);
+            } else if (flag == "-recomb") {
+                parameters.constRecombProb = nextDouble(argc, argv, i);
+                parameters.useConstRecomb = true;
+                if (parameters.constRecombProb < 0 ||
+                    parameters.constRecombProb > 1) {
+                    throw OutOfRange("-recomb", argv[i]);
+                }
+            } else if (flag == "-forbidSame") {
+                parameters.forbidCopyFromSame = true;
+            } else if (flag == "-noRecombTables") {
+                withRecombTables = false;
+            } else if (flag == "-help" || flag == "-h") {
+                printUsage(std::cout);
+                return EXIT_SUCCESS;
+            } else {
+                throw UnknowArg(flag);
+            }
+        }
+        if (panelFileName.size() == 0 || outFileName.size() == 0) {
+            printUsage(std::cerr);
+            return EXIT_FAILURE;
+        }
+
+        Panel::convertToBinary(panelFileName, outFileName, regions,
+                               excludeFileName,
+                               withRecombTables ? &parameters : NULL);
+        return EXIT_SUCCESS;
+    }
+    catch (const exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,94 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2020 - 2021  Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>  // std::min
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef DEPLOID_SRC_PARALLEL_HPP_
+#define DEPLOID_SRC_PARALLEL_HPP_
+
+// Run task(i, worker) for every i in [0, nTasks) on a pool of at most
+// nThreads threads, the calling thread included. Tasks are handed out in index
+// order, worker is in [0, nThreads) and identifies the thread, so it can be
+// used to pick per-thread scratch space. If tasks throw, the exception of the
+// lowest task index is rethrown once all workers have finished, so errors are
+// reported deterministically.
+//
+// Tasks must not draw from R's random number generator, which is not thread
+// safe.
+template <class Task>
+void runInParallelOnWorkers(size_t nTasks, size_t nThreads, const Task &task) {
+    if ( nThreads < 2 || nTasks < 2 ) {
+        for ( size_t i = 0; i < nTasks; i++ ) {
+            task(i, static_cast<size_t>(0));
+        }
+        return;
+    }
+
+    nThreads = std::min(nThreads, nTasks);
+    std::atomic <size_t> nextTask(0);
+    std::mutex errorMutex;
+    std::exception_ptr firstError;
+    size_t firstErrorAt = nTasks;
+
+    auto worker = [&](size_t workerIndex) {
+        for ( size_t i = nextTask++; i < nTasks; i = nextTask++ ) {
+            try {
+                task(i, workerIndex);
+            } catch (...) {
+                std::lock_guard <std::mutex> lock(errorMutex);
+                if ( i < firstErrorAt ) {
+                    firstErrorAt = i;
+                    firstError = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector <std::thread> workers;
+    for ( size_t t = 1; t < nThreads; t++ ) {
+        workers.push_back(std::thread(worker, t));
+    }
+    worker(0);
+    for ( std::thread &w : workers ) {
+        w.join();
+    }
+
+    if ( firstError ) {
+        std::rethrow_exception(firstError);
+    }
+}
+
+
+// As above, for tasks that do not need to know their worker.
+template <class Task>
+void runInParallel(size_t nTasks, size_t nThreads, const Task &task) {
+    runInParallelOnWorkers(nTasks, nThreads,
+                           [&task](size_t i, size_t) { task(i); });
+}
+
+#endif  // DEPLOID_SRC_PARALLEL_HPP_
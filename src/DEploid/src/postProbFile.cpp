@@ -0,0 +1,209 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <zlib.h>
+#include <algorithm>     // std::max
+#include <cmath>         // lround
+#include <cstring>       // memcpy, memset
+#include "postProbFile.hpp"
+
+/* Binary posterior probabilities, version 1, in the byte order of the machine
+ * that wrote them:
+ *
+ *   header       magic "dEploidM", byte order mark, version, value type
+ *                (1 for float32, 2 for uint16), flags, number of rows, of
+ *                columns and of chromosomes, and rows per block
+ *   columns      labels, each a uint32 length followed by the characters
+ *   chromosomes  names, as above, of each run of rows on one chromosome
+ *   chromStarts  uint64 index of the first row of each chromosome
+ *   positions    int32 position of each row
+ *   blocks       rows per block rows, the last block holding the rest, row
+ *                by row. If flagged, each block is zlib compressed and
+ *                preceded by its uint64 compressed size
+ *
+ * Sections up to the blocks start on 8 byte boundaries.
+ */
+static const char POST_PROB_MAGIC[8] = {'d', 'E', 'p', 'l',
+                                        'o', 'i', 'd', 'M'};
+static const uint32_t POST_PROB_BYTE_ORDER = 0x01020304;
+static const uint32_t POST_PROB_VERSION = 1;
+static const uint32_t POST_PROB_COMPRESSED = 1;
+// Uncompressed size a block is filled up to
+static const size_t POST_PROB_BLOCK_SIZE = 1 << 20;
+
+struct PostProbHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t valueType;
+    uint32_t flags;
+    uint64_t nRows;
+    uint64_t nCols;
+    uint64_t nChrom;
+    uint64_t rowsPerBlock;
+};
+
+
+PostProbFile::PostProbFile() : bytesWritten_(0), format_(POST_PROB_FLOAT32),
+                               compress_(false), nCols_(0),
+                               rowsPerBlock_(1), rowsInBlock_(0) {}
+
+
+PostProbFile::~PostProbFile() {
+    try {
+        this->close();
+    } catch (...) {
+    }
+}
+
+
+void PostProbFile::open(const string &fileName, PostProbFormat format,
+                        bool compress, const vector <string> &columns,
+                        const vector <string> &chrom,
+                        const vector < vector <int> > &position,
+                        OutputBundle * bundle) {
+    this->close();
+    this->file_.open(fileName, false, false, bundle);
+    this->fileName_ = fileName;
+    this->bytesWritten_ = 0;
+    this->format_ = format;
+    this->compress_ = compress;
+    this->nCols_ = columns.size();
+    size_t valueSize = (format == POST_PROB_UINT16) ? sizeof(uint16_t) :
+                                                      sizeof(float);
+    this->rowsPerBlock_ = std::max(POST_PROB_BLOCK_SIZE /
+        std::max(this->nCols_ * valueSize, static_cast<size_t>(1)),
+        static_cast<size_t>(1));
+    this->rowsInBlock_ = 0;
+    this->block_.clear();
+
+    size_t nRows = 0;
+    for (auto const& positionOfChrom : position) {
+        nRows += positionOfChrom.size();
+    }
+    PostProbHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, POST_PROB_MAGIC, sizeof(header.magic));
+    header.byteOrder = POST_PROB_BYTE_ORDER;
+    header.version = POST_PROB_VERSION;
+    header.valueType = (format == POST_PROB_UINT16) ? 2 : 1;
+    header.flags = compress ? POST_PROB_COMPRESSED : 0;
+    header.nRows = nRows;
+    header.nCols = this->nCols_;
+    header.nChrom = chrom.size();
+    header.rowsPerBlock = this->rowsPerBlock_;
+    this->write(&header, sizeof(header));
+
+    for (auto const& column : columns) {
+        this->writeString(column);
+    }
+    for (auto const& chromName : chrom) {
+        this->writeString(chromName);
+    }
+    this->align();
+    uint64_t chromStart = 0;
+    for (auto const& positionOfChrom : position) {
+        this->write(&chromStart, sizeof(chromStart));
+        chromStart += positionOfChrom.size();
+    }
+    for (auto const& positionOfChrom : position) {
+        for (int pos : positionOfChrom) {
+            int32_t pos32 = pos;
+            this->write(&pos32, sizeof(pos32));
+        }
+    }
+    this->align();
+}
+
+
+void PostProbFile::addRow(const double * values) {
+    if (!this->isOpen()) {
+        return;
+    }
+    for (size_t i = 0; i < this->nCols_; i++) {
+        if (this->format_ == POST_PROB_UINT16) {
+            double value = (values[i] > 0) ? values[i] : 0.0;
+            uint16_t quantised = static_cast<uint16_t>(
+                lround((value < 1) ? value * 65535 : 65535));
+            this->block_.append(reinterpret_cast<const char *>(&quantised),
+                                sizeof(quantised));
+        } else {
+            float value = static_cast<float>(values[i]);
+            this->block_.append(reinterpret_cast<const char *>(&value),
+                                sizeof(value));
+        }
+    }
+    if (++this->rowsInBlock_ == this->rowsPerBlock_) {
+        this->writeBlock();
+    }
+}
+
+
+void PostProbFile::close() {
+    if (this->isOpen() && this->rowsInBlock_ > 0) {
+        this->writeBlock();
+    }
+    this->file_.close();
+}
+
+
+void PostProbFile::write(const void * data, size_t nBytes) {
+    this->file_ << std::string_view(static_cast<const char *>(data), nBytes);
+    this->bytesWritten_ += nBytes;
+}
+
+
+void PostProbFile::writeString(const string &str) {
+    uint32_t length = str.size();
+    this->write(&length, sizeof(length));
+    this->write(str.data(), str.size());
+}
+
+
+void PostProbFile::align() {
+    static const char zeros[8] = {0};
+    this->write(zeros, (8 - this->bytesWritten_ % 8) % 8);
+}
+
+
+void PostProbFile::writeBlock() {
+    if (this->compress_) {
+        uLongf compressedSize = compressBound(this->block_.size());
+        this->compressedBlock_.resize(compressedSize);
+        if (compress2(reinterpret_cast<Bytef *>(&this->compressedBlock_[0]),
+                      &compressedSize,
+                      reinterpret_cast<const Bytef *>(this->block_.data()),
+                      this->block_.size(), Z_BEST_SPEED) != Z_OK) {
+            throw CannotWriteFile(this->fileName_);
+        }
+        uint64_t size64 = compressedSize;
+        this->write(&size64, sizeof(size64));
+        this->write(this->compressedBlock_.data(), compressedSize);
+    } else {
+        this->write(this->block_.data(), this->block_.size());
+    }
+    this->block_.clear();
+    this->rowsInBlock_ = 0;
+}
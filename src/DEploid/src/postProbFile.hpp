@@ -0,0 +1,83 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdint>
+#include <string>  /* string */
+#include <vector>  /* vector */
+#include "outputFile.hpp"
+
+#ifndef DEPLOID_SRC_POSTPROBFILE_HPP_
+#define DEPLOID_SRC_POSTPROBFILE_HPP_
+
+using std::string;
+using std::vector;
+
+
+enum PostProbFormat { POST_PROB_TEXT, POST_PROB_FLOAT32, POST_PROB_UINT16 };
+
+
+/*! \brief Binary matrix of posterior probabilities, one row per site
+ *
+ * The sites and the column labels are written up front, then the rows are
+ * added in site order and written out in blocks, which are compressed with
+ * zlib if asked for. Probabilities are either stored as float32, or
+ * quantised to uint16 as round(p * 65535). Rows added while no file is open
+ * are dropped.
+ */
+class PostProbFile {
+ public:
+    PostProbFile();
+    ~PostProbFile();
+
+    void open(const string &fileName, PostProbFormat format, bool compress,
+              const vector <string> &columns, const vector <string> &chrom,
+              const vector < vector <int> > &position,
+              OutputBundle * bundle = NULL);
+    void addRow(const double * values);
+    void close();
+    bool isOpen() const { return this->file_.isOpen(); }
+
+ private:
+    PostProbFile(const PostProbFile &);
+    PostProbFile & operator=(const PostProbFile &);
+
+    OutputFile file_;
+    string fileName_;
+    size_t bytesWritten_;
+    PostProbFormat format_;
+    bool compress_;
+    size_t nCols_;
+    size_t rowsPerBlock_;
+    size_t rowsInBlock_;
+    string block_;
+    string compressedBlock_;
+
+    void write(const void * data, size_t nBytes);
+    void writeString(const string &str);
+    void align();
+    void writeBlock();
+};
+
+#endif  // DEPLOID_SRC_POSTPROBFILE_HPP_
@@ -0,0 +1,225 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <sys/stat.h>
+#include <cstring>       // memcmp, memcpy
+#include <fstream>
+#include "siteCache.hpp"
+#include "binaryFile.hpp"
+#include "mappedFile.hpp"
+
+/* Site cache, version 1, in the byte order of the machine that wrote it:
+ *
+ *   header     magic "dEploidS", byte order mark, version and whether the
+ *              vcf sites follow the sites of the run
+ *   key        role, size, modification time and hash of each input file,
+ *              then the options
+ *   sites      chromosome names, number of sites and int32 positions of each
+ *              chromosome, then the ref, alt and PLAF columns as doubles
+ *   vcf sites  sample name, the vcf sites as above and the VQSLOD column
+ *
+ * Sections start on 8 byte boundaries.
+ */
+static const char SITE_CACHE_MAGIC[8] = {'d', 'E', 'p', 'l',
+                                         'o', 'i', 'd', 'S'};
+static const uint32_t SITE_CACHE_BYTE_ORDER = 0x01020304;
+static const uint32_t SITE_CACHE_VERSION = 1;
+
+struct SiteCacheHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t hasVcf;
+    uint32_t reserved;
+};
+
+
+// FNV-1a, eight bytes at a time
+static uint64_t hashBytes(const char * data, size_t size) {
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+    return hash;
+}
+
+
+FileFingerprint::FileFingerprint(const string &role, const string &fileName)
+    : role(role) {
+    struct stat fileStat;
+    if (stat(fileName.c_str(), &fileStat) != 0) {
+        throw InvalidInputFile(fileName);
+    }
+    this->mtime = static_cast<int64_t>(fileStat.st_mtime);
+    MappedFile file(fileName);
+    this->size = file.size();
+    this->hash = hashBytes(file.data(), file.size());
+}
+
+
+static void writeSites(BinaryFileWriter &out, const vector <string> &chrom,
+                       const vector < vector <int> > &position) {
+    out.write(static_cast<uint64_t>(chrom.size()));
+    for (auto const& chromName : chrom) {
+        out.writeString(chromName);
+    }
+    out.align();
+    for (auto const& positionOfChrom : position) {
+        out.write(static_cast<uint64_t>(positionOfChrom.size()));
+    }
+    for (auto const& positionOfChrom : position) {
+        out.writeArray(positionOfChrom.data(), positionOfChrom.size());
+    }
+    out.align();
+}
+
+
+static size_t readSites(BinaryFileReader &in, vector <string> &chrom,
+                        vector < vector <int> > &position) {
+    uint64_t nChrom = in.read<uint64_t>();
+    chrom.clear();
+    for (uint64_t i = 0; i < nChrom; i++) {
+        chrom.push_back(in.readString());
+    }
+    in.align();
+    vector <uint64_t> nSites(nChrom);
+    in.readArray(nSites.data(), nChrom);
+    position.clear();
+    size_t nLoci = 0;
+    for (uint64_t i = 0; i < nChrom; i++) {
+        // Checked before allocating, the cache may be corrupted
+        if (nSites[i] > in.remaining() / sizeof(int)) {
+            throw InvalidBinaryFile("");
+        }
+        position.push_back(vector <int> (nSites[i]));
+        in.readArray(position.back().data(), nSites[i]);
+        nLoci += nSites[i];
+    }
+    in.align();
+    return nLoci;
+}
+
+
+static void readColumn(BinaryFileReader &in, vector <double> &column,
+                       size_t nLoci) {
+    column.resize(nLoci);
+    in.readArray(column.data(), nLoci);
+}
+
+
+bool SiteCache::load() {
+    std::ifstream probe(this->fileName_.c_str());
+    if (!probe.good()) {
+        return false;
+    }
+    probe.close();
+
+    try {
+        BinaryFileReader in(this->fileName_);
+        SiteCacheHeader header = in.read<SiteCacheHeader>();
+        if (memcmp(header.magic, SITE_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.byteOrder != SITE_CACHE_BYTE_ORDER ||
+            header.version != SITE_CACHE_VERSION) {
+            return false;
+        }
+
+        uint32_t nInputs = in.read<uint32_t>();
+        if (nInputs != this->inputs_.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < nInputs; i++) {
+            FileFingerprint input;
+            input.role = in.readString();
+            input.size = in.read<uint64_t>();
+            input.mtime = in.read<int64_t>();
+            input.hash = in.read<uint64_t>();
+            if (!(input == this->inputs_[i])) {
+                return false;
+            }
+        }
+        if (in.readString() != this->options_) {
+            return false;
+        }
+        in.align();
+
+        size_t nLoci = readSites(in, this->chrom, this->position);
+        readColumn(in, this->refCount, nLoci);
+        readColumn(in, this->altCount, nLoci);
+        readColumn(in, this->plaf, nLoci);
+
+        this->hasVcf = (header.hasVcf != 0);
+        if (this->hasVcf) {
+            this->vcfSampleName = in.readString();
+            in.align();
+            size_t nVcfLoci = readSites(in, this->vcfChrom, this->vcfPosition);
+            readColumn(in, this->vqslod, nVcfLoci);
+        }
+        return in.atEnd();
+    } catch (const InvalidBinaryFile &) {
+        return false;
+    }
+}
+
+
+void SiteCache::save() const {
+    SiteCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SITE_CACHE_MAGIC, sizeof(header.magic));
+    header.byteOrder = SITE_CACHE_BYTE_ORDER;
+    header.version = SITE_CACHE_VERSION;
+    header.hasVcf = this->hasVcf;
+
+    BinaryFileWriter out(this->fileName_);
+    out.write(header);
+    out.write(static_cast<uint32_t>(this->inputs_.size()));
+    for (auto const& input : this->inputs_) {
+        out.writeString(input.role);
+        out.write(input.size);
+        out.write(input.mtime);
+        out.write(input.hash);
+    }
+    out.writeString(this->options_);
+    out.align();
+
+    writeSites(out, this->chrom, this->position);
+    out.writeArray(this->refCount.data(), this->refCount.size());
+    out.writeArray(this->altCount.data(), this->altCount.size());
+    out.writeArray(this->plaf.data(), this->plaf.size());
+
+    if (this->hasVcf) {
+        out.writeString(this->vcfSampleName);
+        out.align();
+        writeSites(out, this->vcfChrom, this->vcfPosition);
+        out.writeArray(this->vqslod.data(), this->vqslod.size());
+    }
+    out.close();
+}
@@ -0,0 +1,97 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "exceptions.hpp"
+
+#ifndef DEPLOID_SRC_SITECACHE_HPP_
+#define DEPLOID_SRC_SITECACHE_HPP_
+
+using std::string;
+using std::vector;
+
+
+// Size, modification time and content hash of an input file
+struct FileFingerprint {
+    string role;
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;
+    FileFingerprint() : size(0), mtime(0), hash(0) {}
+    FileFingerprint(const string &role, const string &fileName);
+    bool operator==(const FileFingerprint &other) const {
+        return this->role == other.role && this->size == other.size &&
+               this->mtime == other.mtime && this->hash == other.hash;
+    }
+};
+
+
+/*! \brief Parsed and filtered sites of a run, saved for later runs
+ *
+ * The cache is keyed by the fingerprints of the input files and by the
+ * options that change which sites are read. load() only succeeds when both
+ * match, a missing, stale or corrupted cache is simply read again and
+ * replaced.
+ */
+class SiteCache {
+#ifdef UNITTEST
+  friend class TestSiteCache;
+#endif
+  friend class DEploidIO;
+ public:
+    explicit SiteCache(const string &fileName) : fileName_(fileName),
+                                                 hasVcf(false) {}
+    ~SiteCache() {}
+
+    void addInputFile(const string &role, const string &fileName) {
+        this->inputs_.push_back(FileFingerprint(role, fileName)); }
+    void addOption(const string &option) {
+        this->options_ += option + ";"; }
+
+    bool load();
+    void save() const;
+
+ private:
+    string fileName_;
+    vector <FileFingerprint> inputs_;
+    string options_;
+
+    // Sites as used by the run
+    vector <string> chrom;
+    vector < vector <int> > position;
+    vector <double> refCount;
+    vector <double> altCount;
+    vector <double> plaf;
+    // Sites of the vcf, and their VQSLOD, if the counts came from a vcf
+    bool hasVcf;
+    string vcfSampleName;
+    vector <string> vcfChrom;
+    vector < vector <int> > vcfPosition;
+    vector <double> vqslod;
+};
+
+#endif  // DEPLOID_SRC_SITECACHE_HPP_
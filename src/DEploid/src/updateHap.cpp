@@ -42,6 +42,7 @@ UpdateHap::UpdateHap( vector <double> &refCount,
                       double missCopyProb,
                       double scalingFactor) {
     this->panel_ = panel;
+    this->panelRows_ = NULL;
     this->nPanel_ = 0; // Initialize when panel is not given
 
     if ( this->panel_ != NULL ) {
@@ -121,6 +122,22 @@ void UpdateSingleHap::painting( vector <double> &refCount,
 }
 
 
+// The forward probabilities of the current state, without sampling, so no
+// random numbers are drawn
+void UpdateSingleHap::forwardOnly( vector <double> &refCount,
+                                   vector <double> &altCount,
+                                   vector <double> &expectedWsaf,
+                                   vector <double> &proportion,
+                                   vector < vector <double> > &haplotypes ) {
+    this->calcExpectedWsaf( expectedWsaf, proportion, haplotypes);
+    this->calcHapLLKs(refCount, altCount);
+    if ( this->panel_ != NULL ) {
+        this->buildEmission( this->missCopyProb_ );
+        this->calcFwdProbs();
+    }
+}
+
+
 void UpdateSingleHap::calcBwdProbs() {
     vector <double> bwdLast (this->nPanel_, 0.0);
     for ( size_t i = 0 ; i < this->nPanel_; i++) {
@@ -139,12 +156,13 @@ void UpdateSingleHap::calcBwdProbs() {
         vector <double> bwdTmp (this->nPanel_, 1.0);
         double pRecEachHap = this->panel_->pRecEachHap_[hapIndexBack-1];
         double pNoRec = this->panel_->pNoRec_[hapIndexBack-1];
+        const vector <double> &panelRow = this->panelRow(hapIndexBack);
         for ( size_t i = 0 ; i < this->nPanel_; i++) {
             bwdTmp[i] = 0.0;
             for ( size_t ii = 0 ; ii < this->nPanel_; ii++) {
-                bwdTmp[i] += this->emission_[j][this->panel_->content_[hapIndexBack][ii]] * bwdProbs_.back()[ii] * pRecEachHap;
+                bwdTmp[i] += this->emission_[j][panelRow[ii]] * bwdProbs_.back()[ii] * pRecEachHap;
                 if ( i == ii) {
-                    bwdTmp[i] += this->emission_[j][this->panel_->content_[hapIndexBack][ii]] * bwdProbs_.back()[ii] * pNoRec;
+                    bwdTmp[i] += this->emission_[j][panelRow[ii]] * bwdProbs_.back()[ii] * pNoRec;
                 }
             }
         }
@@ -239,8 +257,9 @@ void UpdateSingleHap::calcFwdProbs() {
     size_t hapIndex = this->segmentStartIndex_;
     this->fwdProbs_.clear();
     vector <double> fwd1st (this->nPanel_, 0.0);
+    const vector <double> &firstRow = this->panelRow(hapIndex);
     for ( size_t i = 0 ; i < this->nPanel_; i++) {
-        fwd1st[i] = this->emission_[0][this->panel_->content_[hapIndex][i]];
+        fwd1st[i] = this->emission_[0][firstRow[i]];
         assert(fwd1st[i] >= 0);
     }
     (void)normalizeBySum(fwd1st);
@@ -255,8 +274,9 @@ void UpdateSingleHap::calcFwdProbs() {
 
         double massFromRec = sumOfVec(fwdProbs_.back()) * pRecEachHap;
         vector <double> fwdTmp (this->nPanel_, 0.0);
+        const vector <double> &panelRow = this->panelRow(hapIndex);
         for ( size_t i = 0 ; i < this->nPanel_; i++) {
-            fwdTmp[i] = this->emission_[j][this->panel_->content_[hapIndex][i]] * (fwdProbs_.back()[i] * pNoRec + massFromRec);
+            fwdTmp[i] = this->emission_[j][panelRow[i]] * (fwdProbs_.back()[i] * pNoRec + massFromRec);
             assert(fwdTmp[i] >= 0);
             //if ( i >= this->panel_->truePanelSize() ) {
                 //fwdTmp[i] = this->emission_[j][this->panel_->content_[hapIndex][i]] * (fwdProbs_.back()[i] * pNoRec + massFromRec) * inbreedProb;
@@ -286,7 +306,7 @@ void UpdateSingleHap::samplePaths() {
     size_t pathTmp = sampleIndexGivenProp ( this->recombRg_, fwdProbs_.back() );
     size_t contentIndex = this->segmentStartIndex_ + this->nLoci_ - 1;
 
-    this->path_.push_back( this->panel_->content_[contentIndex][pathTmp]);
+    this->path_.push_back( this->panelRow(contentIndex)[pathTmp]);
 
     for ( size_t j = (this->nLoci_ - 1) ; j > 0; j-- ) {
         contentIndex--;
@@ -305,7 +325,7 @@ void UpdateSingleHap::samplePaths() {
             this->siteOfOneSwitchOne[j] += 1.0;
         }
 
-        this->path_.push_back(this->panel_->content_[contentIndex][pathTmp]);
+        this->path_.push_back(this->panelRow(contentIndex)[pathTmp]);
     }
 
     reverse(path_.begin(), path_.end());
@@ -73,6 +73,15 @@ class UpdateHap{
     size_t nPanel_;
     void setPanelSize ( const size_t setTo ) { this->nPanel_ = setTo; }
 
+    // Panel rows of the segment, used instead of the panel's own content
+    // when given, see Panel::inbreedingRows
+    const vector < vector <double> > * panelRows_;
+    void setPanelRows ( const vector < vector <double> > * rows ) { this->panelRows_ = rows; }
+    const vector <double> & panelRow ( size_t hapIndex ) const {
+        return ( this->panelRows_ == NULL ) ? this->panel_->content_[hapIndex] :
+               (*this->panelRows_)[hapIndex - this->segmentStartIndex_];
+    }
+
     vector <double> newLLK;
 
     size_t segmentStartIndex_;
@@ -152,6 +161,11 @@ class UpdateSingleHap : public UpdateHap{
                    vector <double> &expectedWsaf,
                    vector <double> &proportion,
                    vector < vector <double> > &haplotypes );
+    void forwardOnly( vector <double> &refCount,
+                      vector <double> &altCount,
+                      vector <double> &expectedWsaf,
+                      vector <double> &proportion,
+                      vector < vector <double> > &haplotypes );
     void calcExpectedWsaf( vector <double> & expectedWsaf, vector <double> &proportion, vector < vector <double> > &haplotypes);
     void calcHapLLKs( vector <double> &refCount, vector <double> &altCount);
     void buildEmission( double missCopyProb );
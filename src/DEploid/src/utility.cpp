@@ -74,6 +74,17 @@ void normalizeBySum(vector <double> & array ) {
 }
 
 
+void normalizeBySum(double * array, size_t length) {
+    double sumOfArray = 0;
+    for (size_t i = 0; i < length; i++) {
+        sumOfArray += array[i];
+    }
+    for (size_t i = 0; i < length; i++) {
+        array[i] /= sumOfArray;
+    }
+}
+
+
 void normalizeByMax(vector <double> & array ) {
     double maxOfArray = max_value(array);
     for (vector<double>::iterator it = array.begin(); it != array.end(); ++it) {
@@ -164,22 +175,25 @@ log_double_t calcSiteLikelihood(double ref, double alt, double unadjustedWsaf, d
 }
 
 
-size_t sampleIndexGivenProp(RandomGenerator* rg, vector <double> proportion) {
+size_t sampleIndexGivenProp(RandomGenerator* rg,
+                            const vector <double> &proportion) {
+    return sampleIndexGivenProp(rg, proportion.data(), proportion.size());
+}
+
+
+size_t sampleIndexGivenProp(RandomGenerator* rg, const double * proportion,
+                            size_t length) {
     #ifndef NDEBUG
-        auto biggest = std::max_element(
-            std::begin(proportion), std::end(proportion));
-        return std::distance(proportion.begin(), biggest);
+        (void)rg;
+        return std::distance(proportion,
+                             std::max_element(proportion, proportion + length));
     #else
-        vector <size_t> tmpIndex;
-        for ( size_t i = 0; i < proportion.size(); i++ ) {
-            tmpIndex.push_back(i);
-        }
-        vector <double> tmpCdf = computeCdf(proportion);
-
         double u = rg->sample();
+        double cumsum = 0;
         size_t i = 0;
-        for ( ; i < tmpCdf.size() ; i++) {
-            if ( u < tmpCdf[i] ) {
+        for ( ; i < length ; i++) {
+            cumsum += proportion[i];
+            if ( u < cumsum ) {
                 break;
             }
         }
@@ -181,6 +181,7 @@ double normal_pdf(double x, double m, double s);
 vector <double> computeCdf(const vector <double> & dist);
 double sumOfMat(const vector <vector <double> > & matrix);
 void normalizeBySum(vector <double> & array);
+void normalizeBySum(double * array, size_t length);
 void normalizeByMax(vector <double> & array);
 void normalizeBySumMat(vector <vector <double> > & matrix);
 vector <double> calcLLKs(const vector <double> &refCount,
@@ -193,7 +194,10 @@ vector <log_double_t> calcSiteLikelihoods(const vector <double> &refCount,
                                           double fac, double err = 0.01);
 log_double_t calcSiteLikelihood(double ref, double alt,
                                 double unadjustedWsaf, double err, double fac);
-size_t sampleIndexGivenProp(RandomGenerator* rg, vector <double> proportion);
+size_t sampleIndexGivenProp(RandomGenerator* rg,
+                            const vector <double> &proportion);
+size_t sampleIndexGivenProp(RandomGenerator* rg, const double * proportion,
+                            size_t length);
 vector <double> reshapeMatToVec(const vector < vector <double> > &Mat);
 double betaPdf(double x, double a, double b);
 double logBetaPdf(double x, double a, double b);
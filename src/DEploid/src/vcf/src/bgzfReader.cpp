@@ -0,0 +1,269 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <zlib.h>
+#include <algorithm>     // std::min, std::max
+#include <cstring>       // memchr, memset
+#include "bgzfReader.hpp"
+#include "parallel.hpp"
+
+using std::min;
+using std::max;
+
+// Blocks inflated per thread in one batch
+static const size_t BGZF_BLOCKS_PER_THREAD = 16;
+// Fixed part of the gzip header, up to and including XLEN
+static const size_t BGZF_HEADER_SIZE = 12;
+// CRC32 and ISIZE
+static const size_t BGZF_FOOTER_SIZE = 8;
+
+
+static inline size_t readLittleEndian(const unsigned char * bytes,
+                                      size_t nBytes) {
+    size_t ret = 0;
+    for (size_t i = nBytes; i > 0; i--) {
+        ret = (ret << 8) | bytes[i-1];
+    }
+    return ret;
+}
+
+
+// Size of the BGZF block given its header, or 0 if it is not a BGZF header.
+// The header must hold the fixed part and the XLEN extra bytes.
+static size_t bgzfBlockSize(const unsigned char * header, size_t headerSize) {
+    if (headerSize < BGZF_HEADER_SIZE || header[0] != 0x1f ||
+        header[1] != 0x8b || header[2] != 8 || (header[3] & 4) == 0) {
+        return 0;
+    }
+    size_t xlen = readLittleEndian(header + 10, 2);
+    if (headerSize < BGZF_HEADER_SIZE + xlen) {
+        return 0;
+    }
+    const unsigned char * extra = header + BGZF_HEADER_SIZE;
+    for (size_t i = 0; i + 4 <= xlen; ) {
+        size_t subfieldLength = readLittleEndian(extra + i + 2, 2);
+        if (extra[i] == 'B' && extra[i+1] == 'C' && subfieldLength == 2 &&
+            i + 6 <= xlen) {
+            return readLittleEndian(extra + i + 4, 2) + 1;
+        }
+        i += 4 + subfieldLength;
+    }
+    return 0;
+}
+
+
+BgzfReader::BgzfReader() : file_(NULL), nThreads_(1), bufferPos_(0) {}
+
+
+BgzfReader::~BgzfReader() {
+    this->close();
+}
+
+
+bool BgzfReader::isBgzf(const string &fileName) {
+    FILE * f = fopen(fileName.c_str(), "rb");
+    if (f == NULL) {
+        return false;
+    }
+    unsigned char header[BGZF_HEADER_SIZE + 256];
+    size_t nRead = fread(header, 1, BGZF_HEADER_SIZE, f);
+    if (nRead == BGZF_HEADER_SIZE) {
+        size_t xlen = min(readLittleEndian(header + 10, 2),
+                          static_cast<size_t>(256));
+        nRead += fread(header + BGZF_HEADER_SIZE, 1, xlen, f);
+    }
+    fclose(f);
+    return bgzfBlockSize(header, nRead) > 0;
+}
+
+
+bool BgzfReader::open(const string &fileName, size_t nThreads) {
+    this->close();
+    if (!BgzfReader::isBgzf(fileName)) {
+        return false;
+    }
+    this->file_ = fopen(fileName.c_str(), "rb");
+    if (this->file_ == NULL) {
+        throw InvalidInputFile(fileName);
+    }
+    this->fileName_ = fileName;
+    this->nThreads_ = max(nThreads, static_cast<size_t>(1));
+    this->buffer_.clear();
+    this->bufferPos_ = 0;
+    return true;
+}
+
+
+void BgzfReader::close() {
+    if (this->file_ != NULL) {
+        fclose(this->file_);
+        this->file_ = NULL;
+    }
+}
+
+
+bool BgzfReader::getline(string &line) {
+    line.clear();
+    while (true) {
+        if (this->bufferPos_ == this->buffer_.size()) {
+            if (!this->inflateNextBatch()) {
+                return line.size() > 0;
+            }
+            continue;
+        }
+        const char * start = this->buffer_.data() + this->bufferPos_;
+        size_t remaining = this->buffer_.size() - this->bufferPos_;
+        const char * lineEnd = static_cast<const char *>(
+            memchr(start, '\n', remaining));
+        if (lineEnd != NULL) {
+            line.append(start, lineEnd);
+            this->bufferPos_ += (lineEnd - start) + 1;
+            return true;
+        }
+        line.append(start, remaining);
+        this->bufferPos_ = this->buffer_.size();
+    }
+}
+
+
+void BgzfReader::seek(uint64_t virtualOffset) {
+    if (this->file_ == NULL) {
+        throw InvalidBgzfBlock(this->fileName_);
+    }
+    uint64_t blockStart = virtualOffset >> 16;
+    size_t offsetInBlock = static_cast<size_t>(virtualOffset & 0xffff);
+#ifdef _WIN32
+    int status = _fseeki64(this->file_, blockStart, SEEK_SET);
+#else
+    int status = fseeko(this->file_, static_cast<off_t>(blockStart),
+                        SEEK_SET);
+#endif
+    if (status != 0) {
+        throw InvalidBgzfBlock(this->fileName_);
+    }
+    this->buffer_.clear();
+    this->bufferPos_ = 0;
+    if (offsetInBlock > 0 && (!this->inflateNextBatch() ||
+                              offsetInBlock > this->buffer_.size())) {
+        throw InvalidBgzfBlock(this->fileName_);
+    }
+    this->bufferPos_ = offsetInBlock;
+}
+
+
+bool BgzfReader::readBlock(vector <unsigned char> &block) {
+    block.resize(BGZF_HEADER_SIZE);
+    size_t nRead = fread(block.data(), 1, BGZF_HEADER_SIZE, this->file_);
+    if (nRead == 0) {
+        return false;
+    }
+    if (nRead < BGZF_HEADER_SIZE) {
+        throw InvalidBgzfBlock(this->fileName_);
+    }
+    size_t xlen = readLittleEndian(block.data() + 10, 2);
+    block.resize(BGZF_HEADER_SIZE + xlen);
+    if (fread(block.data() + BGZF_HEADER_SIZE, 1, xlen, this->file_) != xlen) {
+        throw InvalidBgzfBlock(this->fileName_);
+    }
+    size_t blockSize = bgzfBlockSize(block.data(), block.size());
+    if (blockSize < block.size() + BGZF_FOOTER_SIZE) {
+        throw InvalidBgzfBlock(this->fileName_);
+    }
+    size_t headerSize = block.size();
+    block.resize(blockSize);
+    if (fread(block.data() + headerSize, 1, blockSize - headerSize,
+              this->file_) != blockSize - headerSize) {
+        throw InvalidBgzfBlock(this->fileName_);
+    }
+    return true;
+}
+
+
+void BgzfReader::inflateBlock(const vector <unsigned char> &block,
+                              string &inflated) const {
+    size_t xlen = readLittleEndian(block.data() + 10, 2);
+    size_t dataStart = BGZF_HEADER_SIZE + xlen;
+    size_t dataSize = block.size() - dataStart - BGZF_FOOTER_SIZE;
+    const unsigned char * footer = block.data() + block.size() -
+                                   BGZF_FOOTER_SIZE;
+    size_t expectedCrc = readLittleEndian(footer, 4);
+    size_t expectedSize = readLittleEndian(footer + 4, 4);
+
+    inflated.resize(expectedSize);
+    if (expectedSize == 0) {
+        return;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, -15) != Z_OK) {
+        throw InvalidBgzfBlock(this->fileName_);
+    }
+    stream.next_in = const_cast<Bytef *>(block.data() + dataStart);
+    stream.avail_in = static_cast<uInt>(dataSize);
+    stream.next_out = reinterpret_cast<Bytef *>(&inflated[0]);
+    stream.avail_out = static_cast<uInt>(expectedSize);
+    int status = inflate(&stream, Z_FINISH);
+    size_t inflatedSize = stream.total_out;
+    inflateEnd(&stream);
+
+    if (status != Z_STREAM_END || inflatedSize != expectedSize ||
+        crc32(crc32(0L, Z_NULL, 0),
+              reinterpret_cast<const Bytef *>(inflated.data()),
+              static_cast<uInt>(inflatedSize)) != expectedCrc) {
+        throw InvalidBgzfBlock(this->fileName_);
+    }
+}
+
+
+bool BgzfReader::inflateNextBatch() {
+    if (this->file_ == NULL) {
+        return false;
+    }
+
+    size_t batchSize = this->nThreads_ * BGZF_BLOCKS_PER_THREAD;
+    this->compressedBlocks_.resize(batchSize);
+    size_t nBlocks = 0;
+    while (nBlocks < batchSize &&
+           this->readBlock(this->compressedBlocks_[nBlocks])) {
+        nBlocks++;
+    }
+    if (nBlocks == 0) {
+        return false;
+    }
+
+    this->inflatedBlocks_.resize(batchSize);
+    runInParallel(nBlocks, this->nThreads_, [&](size_t blockI) {
+        this->inflateBlock(this->compressedBlocks_[blockI],
+                           this->inflatedBlocks_[blockI]);
+    });
+
+    this->buffer_.clear();
+    for (size_t blockI = 0; blockI < nBlocks; blockI++) {
+        this->buffer_ += this->inflatedBlocks_[blockI];
+    }
+    this->bufferPos_ = 0;
+    return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <string>  /* string */
+#include <vector>  /* vector */
+#include "exceptions.hpp"
+
+#ifndef DEPLOID_SRC_BGZFREADER_HPP_
+#define DEPLOID_SRC_BGZFREADER_HPP_
+
+using std::string;
+using std::vector;
+
+
+struct InvalidBgzfBlock : public InvalidInput{
+    explicit InvalidBgzfBlock(string str):InvalidInput(str) {
+        this->reason = "Corrupted BGZF block in: ";
+        throwMsg = this->reason + this->src;
+    }
+    ~InvalidBgzfBlock() throw() {}
+};
+
+
+/*! \brief Line reader for BGZF files, i.e. bgzipped files
+ *
+ * BGZF files are a series of independent gzip blocks of at most 64KB. The
+ * blocks are read in batches, inflated on up to nThreads threads and handed
+ * out line by line in file order.
+ */
+class BgzfReader {
+#ifdef UNITTEST
+  friend class TestVCF;
+#endif
+ public:
+    BgzfReader();
+    ~BgzfReader();
+
+    // Returns false, and leaves the reader closed, if the file is not BGZF
+    bool open(const string &fileName, size_t nThreads = 1);
+    void close();
+    // Same as std::getline, returns false once the file is exhausted
+    bool getline(string &line);
+    // Moves to a virtual offset, i.e. the block offset in the file shifted
+    // 16 bits left plus the offset within the inflated block
+    void seek(uint64_t virtualOffset);
+
+    static bool isBgzf(const string &fileName);
+
+ private:
+    BgzfReader(const BgzfReader &);
+    BgzfReader & operator=(const BgzfReader &);
+
+    string fileName_;
+    FILE * file_;
+    size_t nThreads_;
+
+    vector < vector <unsigned char> > compressedBlocks_;
+    vector < string > inflatedBlocks_;
+    string buffer_;
+    size_t bufferPos_;
+
+    bool readBlock(vector <unsigned char> &block);
+    void inflateBlock(const vector <unsigned char> &block,
+                      string &inflated) const;
+    bool inflateNextBatch();
+};
+
+#endif  // DEPLOID_SRC_BGZFREADER_HPP_
@@ -183,6 +183,15 @@ struct InvalidInputFile : public InvalidInput{
 };
 
 
+struct CannotWriteFile : public InvalidInput{
+  explicit CannotWriteFile(string str):InvalidInput(str) {
+    this->reason = "Cannot write file: ";
+    throwMsg = this->reason + this->src;
+  }
+  ~CannotWriteFile() throw() {}
+};
+
+
 struct FileNameMissing : public InvalidInput{
   explicit FileNameMissing(string str):InvalidInput(str) {
     this->reason = " file path missing!";
@@ -0,0 +1,84 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <fstream>
+#include <iterator>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "exceptions.hpp"
+#include "mappedFile.hpp"
+
+
+MappedFile::MappedFile(const string &fileName)
+    : data_(NULL), size_(0), mapped_(NULL) {
+#ifndef _WIN32
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw InvalidInputFile(fileName);
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        close(fd);
+        throw InvalidInputFile(fileName);
+    }
+    this->size_ = static_cast<size_t>(fileStat.st_size);
+    if (this->size_ > 0) {
+        void * mapped = mmap(NULL, this->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            this->mapped_ = mapped;
+            this->data_ = static_cast<const char *>(mapped);
+#ifdef MADV_SEQUENTIAL
+            madvise(mapped, this->size_, MADV_SEQUENTIAL);
+#endif
+        }
+    }
+    close(fd);
+    if (this->mapped_ != NULL || this->size_ == 0) {
+        return;
+    }
+#endif
+    // No mmap, or it failed: read the whole file instead
+    std::ifstream inFile(fileName.c_str(), std::ios::in | std::ios::binary);
+    if (!inFile.good()) {
+        throw InvalidInputFile(fileName);
+    }
+    this->buffer_.assign(std::istreambuf_iterator<char>(inFile),
+                         std::istreambuf_iterator<char>());
+    this->data_ = this->buffer_.data();
+    this->size_ = this->buffer_.size();
+}
+
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (this->mapped_ != NULL) {
+        munmap(this->mapped_, this->size_);
+    }
+#endif
+}
@@ -0,0 +1,59 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DEPLOID_SRC_MAPPEDFILE_HPP_
+#define DEPLOID_SRC_MAPPEDFILE_HPP_
+
+
+#include <vector>
+#include <string>
+
+using std::vector;
+using std::string;
+
+
+// Read-only view of a whole file. The file is memory mapped where mmap is
+// available, otherwise it is read into a buffer.
+class MappedFile {
+ public:
+    explicit MappedFile(const string &fileName);
+    ~MappedFile();
+
+    const char * data() const { return this->data_; }
+    size_t size() const { return this->size_; }
+    const char * end() const { return this->data_ + this->size_; }
+
+ private:
+    MappedFile(const MappedFile &);
+    MappedFile & operator=(const MappedFile &);
+
+    const char * data_;
+    size_t size_;
+    void * mapped_;
+    vector <char> buffer_;
+};
+
+
+#endif  // DEPLOID_SRC_MAPPEDFILE_HPP_
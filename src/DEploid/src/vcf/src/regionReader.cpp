@@ -0,0 +1,435 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <zlib.h>
+#include <algorithm>     // std::sort, std::binary_search, std::min, std::max
+#include <charconv>      // std::from_chars
+#include <climits>       // INT_MAX
+#include <cstdio>
+#include <utility>       // std::pair
+#include "regionReader.hpp"
+
+using std::min;
+using std::max;
+
+
+static bool parseInt(std::string_view str, int &value) {
+    std::from_chars_result res = std::from_chars(
+        str.data(), str.data() + str.size(), value);
+    return res.ec == std::errc() && res.ptr == str.data() + str.size();
+}
+
+
+GenomicRegion::GenomicRegion(const string &region)
+    : chrom(region), start(1), end(INT_MAX) {
+    // Chromosome names may hold ':', so only a parsable suffix is taken as
+    // coordinates
+    size_t colon = region.rfind(':');
+    if (colon != string::npos) {
+        std::string_view coords = std::string_view(region).substr(colon + 1);
+        size_t dash = coords.find('-');
+        int regionStart;
+        int regionEnd = INT_MAX;
+        if (parseInt(coords.substr(0, dash), regionStart) &&
+            (dash == std::string_view::npos ||
+             parseInt(coords.substr(dash + 1), regionEnd))) {
+            this->chrom = region.substr(0, colon);
+            this->start = regionStart;
+            this->end = regionEnd;
+        }
+    }
+    if (this->chrom.size() == 0 || this->start < 1 ||
+        this->end < this->start) {
+        throw InvalidRegion(region);
+    }
+}
+
+
+string GenomicRegion::str() const {
+    if (this->start == 1 && this->end == INT_MAX) {
+        return this->chrom;
+    }
+    return this->chrom + ":" + std::to_string(this->start) +
+           ((this->end == INT_MAX) ? "" : "-" + std::to_string(this->end));
+}
+
+
+static inline bool isFieldDelimiter(char c) {
+    return (c == ' ') || (c == ',') || (c == '\t');
+}
+
+
+// CHROM and POS of a data line, returns false if POS does not parse
+static bool chromAndPos(std::string_view line, std::string_view &chrom,
+                        int &pos) {
+    size_t chromEnd = 0;
+    while (chromEnd < line.size() && !isFieldDelimiter(line[chromEnd])) {
+        chromEnd++;
+    }
+    chrom = line.substr(0, chromEnd);
+    if (chromEnd == line.size()) {
+        return false;
+    }
+    size_t posEnd = chromEnd + 1;
+    while (posEnd < line.size() && !isFieldDelimiter(line[posEnd])) {
+        posEnd++;
+    }
+    return parseInt(line.substr(chromEnd + 1, posEnd - chromEnd - 1), pos);
+}
+
+
+bool lineInRegions(const vector <GenomicRegion> &regions,
+                   std::string_view line) {
+    std::string_view chrom;
+    int pos;
+    if (!chromAndPos(line, chrom, pos)) {
+        return true;
+    }
+    for (const GenomicRegion &region : regions) {
+        if (region.contains(chrom, pos)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Little-endian reads from the inflated index, which throw past its end
+class IndexBytes {
+ public:
+    IndexBytes(const vector <unsigned char> &bytes, const string &fileName)
+        : bytes_(bytes), fileName_(fileName) {}
+
+    uint64_t read(size_t &cur, size_t nBytes) const {
+        if (cur + nBytes > this->bytes_.size()) {
+            throw InvalidRegionIndex(this->fileName_);
+        }
+        uint64_t ret = 0;
+        for (size_t i = nBytes; i > 0; i--) {
+            ret = (ret << 8) | this->bytes_[cur + i - 1];
+        }
+        cur += nBytes;
+        return ret;
+    }
+    int32_t readInt32(size_t &cur) const {
+        return static_cast<int32_t>(this->read(cur, 4));
+    }
+    size_t readCount(size_t &cur) const {
+        int32_t n = this->readInt32(cur);
+        if (n < 0) {
+            throw InvalidRegionIndex(this->fileName_);
+        }
+        return static_cast<size_t>(n);
+    }
+
+ private:
+    const vector <unsigned char> &bytes_;
+    const string &fileName_;
+};
+
+
+bool TabixIndex::load(const string &fileName) {
+    this->names_.clear();
+    this->bins_.clear();
+    this->linearIndex_.clear();
+
+    const char * suffixes[] = {".tbi", ".csi"};
+    for (size_t i = 0; i < 2; i++) {
+        this->indexFileName_ = fileName + suffixes[i];
+        FILE * f = fopen(this->indexFileName_.c_str(), "rb");
+        if (f == NULL) {
+            continue;
+        }
+        fclose(f);
+
+        // Indices are bgzipped, which gzread reads as one stream
+        gzFile indexFile = gzopen(this->indexFileName_.c_str(), "rb");
+        if (indexFile == NULL) {
+            throw InvalidRegionIndex(this->indexFileName_);
+        }
+        vector <unsigned char> bytes;
+        unsigned char buffer[65536];
+        int nRead;
+        while ((nRead = gzread(indexFile, buffer, sizeof(buffer))) > 0) {
+            bytes.insert(bytes.end(), buffer, buffer + nRead);
+        }
+        gzclose(indexFile);
+        if (nRead < 0 || bytes.size() < 4) {
+            throw InvalidRegionIndex(this->indexFileName_);
+        }
+
+        if (string(bytes.begin(), bytes.begin() + 4) == string("TBI\1", 4)) {
+            this->parseTbi(bytes);
+        } else if (string(bytes.begin(), bytes.begin() + 4) ==
+                   string("CSI\1", 4)) {
+            this->parseCsi(bytes);
+        } else {
+            throw InvalidRegionIndex(this->indexFileName_);
+        }
+        return this->names_.size() > 0;
+    }
+    return false;
+}
+
+
+// Chromosome names, after the tabix format, column and meta fields
+size_t TabixIndex::parseNames(const vector <unsigned char> &bytes,
+                              size_t cur, size_t end) {
+    IndexBytes reader(bytes, this->indexFileName_);
+    if (cur + 28 > end) {
+        throw InvalidRegionIndex(this->indexFileName_);
+    }
+    cur += 24;  // format, col_seq, col_beg, col_end, meta and skip
+    size_t namesLength = reader.readCount(cur);
+    if (cur + namesLength > end) {
+        throw InvalidRegionIndex(this->indexFileName_);
+    }
+    size_t nameStart = cur;
+    for (size_t i = cur; i < cur + namesLength; i++) {
+        if (bytes[i] == '\0') {
+            this->names_.push_back(string(bytes.begin() + nameStart,
+                                          bytes.begin() + i));
+            nameStart = i + 1;
+        }
+    }
+    return cur + namesLength;
+}
+
+
+void TabixIndex::parseTbi(const vector <unsigned char> &bytes) {
+    IndexBytes reader(bytes, this->indexFileName_);
+    size_t cur = 4;
+    this->minShift_ = 14;
+    this->depth_ = 5;
+    size_t nRef = reader.readCount(cur);
+    cur = this->parseNames(bytes, cur, bytes.size());
+    if (this->names_.size() != nRef) {
+        throw InvalidRegionIndex(this->indexFileName_);
+    }
+
+    this->bins_.resize(nRef);
+    this->linearIndex_.resize(nRef);
+    for (size_t refI = 0; refI < nRef; refI++) {
+        size_t nBin = reader.readCount(cur);
+        this->bins_[refI].resize(nBin);
+        for (IndexBin &bin : this->bins_[refI]) {
+            bin.bin = static_cast<uint32_t>(reader.read(cur, 4));
+            bin.chunks.resize(reader.readCount(cur));
+            for (IndexChunk &chunk : bin.chunks) {
+                chunk.beg = reader.read(cur, 8);
+                chunk.end = reader.read(cur, 8);
+            }
+        }
+        this->linearIndex_[refI].resize(reader.readCount(cur));
+        for (uint64_t &offset : this->linearIndex_[refI]) {
+            offset = reader.read(cur, 8);
+        }
+    }
+}
+
+
+void TabixIndex::parseCsi(const vector <unsigned char> &bytes) {
+    IndexBytes reader(bytes, this->indexFileName_);
+    size_t cur = 4;
+    this->minShift_ = reader.readInt32(cur);
+    this->depth_ = reader.readInt32(cur);
+    if (this->minShift_ < 0 || this->minShift_ > 32 || this->depth_ < 0 ||
+        this->minShift_ + 3 * this->depth_ > 62) {
+        throw InvalidRegionIndex(this->indexFileName_);
+    }
+    size_t auxLength = reader.readCount(cur);
+    size_t auxEnd = cur + auxLength;
+    // Without the tabix fields in aux, the chromosomes have no names
+    if (auxLength >= 28) {
+        this->parseNames(bytes, cur, auxEnd);
+    }
+    cur = auxEnd;
+    size_t nRef = reader.readCount(cur);
+    if (this->names_.size() != nRef) {
+        this->names_.clear();
+        return;
+    }
+
+    this->bins_.resize(nRef);
+    for (size_t refI = 0; refI < nRef; refI++) {
+        size_t nBin = reader.readCount(cur);
+        this->bins_[refI].resize(nBin);
+        for (IndexBin &bin : this->bins_[refI]) {
+            bin.bin = static_cast<uint32_t>(reader.read(cur, 4));
+            reader.read(cur, 8);  // loffset
+            bin.chunks.resize(reader.readCount(cur));
+            for (IndexChunk &chunk : bin.chunks) {
+                chunk.beg = reader.read(cur, 8);
+                chunk.end = reader.read(cur, 8);
+            }
+        }
+    }
+}
+
+
+int TabixIndex::chromIndex(const string &chrom) const {
+    for (size_t i = 0; i < this->names_.size(); i++) {
+        if (this->names_[i] == chrom) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+
+// Bins overlapping [beg, end), 0-based, as in the SAM specification
+void TabixIndex::regionToBins(int beg, int end,
+                              vector <uint32_t> &bins) const {
+    int64_t lastPos = static_cast<int64_t>(end) - 1;
+    int shift = this->minShift_ + 3 * this->depth_;
+    uint64_t levelStart = 0;
+    for (int level = 0; level <= this->depth_; level++) {
+        uint64_t first = levelStart + (static_cast<uint64_t>(beg) >> shift);
+        uint64_t last = levelStart + (static_cast<uint64_t>(lastPos) >> shift);
+        for (uint64_t bin = first; bin <= last; bin++) {
+            bins.push_back(static_cast<uint32_t>(bin));
+        }
+        levelStart += static_cast<uint64_t>(1) << (3 * level);
+        shift -= 3;
+    }
+}
+
+
+bool TabixIndex::regionOffset(const GenomicRegion &region,
+                              uint64_t &offset) const {
+    int chromI = this->chromIndex(region.chrom);
+    if (chromI < 0) {
+        return false;
+    }
+    int64_t maxPos = static_cast<int64_t>(1) <<
+                     (this->minShift_ + 3 * this->depth_);
+    int beg = region.start - 1;
+    int end = static_cast<int>(min(static_cast<int64_t>(region.end), maxPos));
+    if (beg >= end) {
+        return false;
+    }
+
+    vector <uint32_t> bins;
+    this->regionToBins(beg, end, bins);
+    std::sort(bins.begin(), bins.end());
+
+    // Chunks ending before the first record at beg hold nothing of the region
+    uint64_t minOffset = 0;
+    if (this->linearIndex_.size() > 0 &&
+        this->linearIndex_[chromI].size() > 0) {
+        const vector <uint64_t> &linear = this->linearIndex_[chromI];
+        size_t window = static_cast<size_t>(beg >> this->minShift_);
+        minOffset = linear[min(window, linear.size() - 1)];
+    }
+
+    bool found = false;
+    for (const IndexBin &bin : this->bins_[chromI]) {
+        if (!std::binary_search(bins.begin(), bins.end(), bin.bin)) {
+            continue;
+        }
+        for (const IndexChunk &chunk : bin.chunks) {
+            if (chunk.end > minOffset && (!found || chunk.beg < offset)) {
+                offset = chunk.beg;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+
+bool RegionReader::open(const string &fileName,
+                        const vector <GenomicRegion> &regions,
+                        size_t nThreads) {
+    this->close();
+    if (!BgzfReader::isBgzf(fileName) || !this->index_.load(fileName) ||
+        !this->file_.open(fileName, nThreads)) {
+        return false;
+    }
+
+    // Regions in file order, then merged where they overlap or touch
+    vector < std::pair <int, GenomicRegion> > ordered;
+    for (const GenomicRegion &region : regions) {
+        int chromI = this->index_.chromIndex(region.chrom);
+        if (chromI >= 0) {
+            ordered.push_back(std::make_pair(chromI, region));
+        }
+    }
+    std::sort(ordered.begin(), ordered.end(),
+        [](const std::pair <int, GenomicRegion> &a,
+           const std::pair <int, GenomicRegion> &b) {
+            return (a.first != b.first) ? a.first < b.first :
+                                          a.second.start < b.second.start;
+        });
+    this->regions_.clear();
+    for (size_t i = 0; i < ordered.size(); i++) {
+        const GenomicRegion &region = ordered[i].second;
+        if (i > 0 && ordered[i-1].first == ordered[i].first &&
+            region.start - 1 <= this->regions_.back().end) {
+            this->regions_.back().end = max(this->regions_.back().end,
+                                            region.end);
+        } else {
+            this->regions_.push_back(region);
+        }
+    }
+    this->regionI_ = 0;
+    this->inRegion_ = false;
+    return true;
+}
+
+
+bool RegionReader::getlineInRegions(string &line) {
+    while (this->regionI_ < this->regions_.size()) {
+        const GenomicRegion &region = this->regions_[this->regionI_];
+        if (!this->inRegion_) {
+            uint64_t offset;
+            if (!this->index_.regionOffset(region, offset)) {
+                this->regionI_++;
+                continue;
+            }
+            this->file_.seek(offset);
+            this->inRegion_ = true;
+        }
+
+        if (this->file_.getline(line) && line.size() > 0) {
+            std::string_view chrom;
+            int pos;
+            bool posParsed = chromAndPos(line, chrom, pos);
+            if (chrom == region.chrom) {
+                if (!posParsed || region.contains(chrom, pos)) {
+                    return true;
+                }
+                if (pos < region.start) {
+                    continue;
+                }
+            }
+        }
+        // Past the region, records are sorted
+        this->inRegion_ = false;
+        this->regionI_++;
+    }
+    line.clear();
+    return false;
+}
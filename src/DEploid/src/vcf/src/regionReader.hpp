@@ -0,0 +1,163 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample.
+ *
+ * Copyright (C) 2016-2017 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of dEploid.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdint>
+#include <string>       /* string */
+#include <string_view>
+#include <vector>       /* vector */
+#include "exceptions.hpp"
+#include "bgzfReader.hpp"
+
+#ifndef DEPLOID_SRC_REGIONREADER_HPP_
+#define DEPLOID_SRC_REGIONREADER_HPP_
+
+using std::string;
+using std::vector;
+
+
+struct InvalidRegion : public InvalidInput{
+    explicit InvalidRegion(string str):InvalidInput(str) {
+        this->reason = "Invalid region, expects CHROM or CHROM:START-END: ";
+        throwMsg = this->reason + this->src;
+    }
+    ~InvalidRegion() throw() {}
+};
+
+
+struct InvalidRegionIndex : public InvalidInput{
+    explicit InvalidRegionIndex(string str):InvalidInput(str) {
+        this->reason = "Corrupted tabix or csi index: ";
+        throwMsg = this->reason + this->src;
+    }
+    ~InvalidRegionIndex() throw() {}
+};
+
+
+struct NoSitesInRegions : public InvalidInput{
+    explicit NoSitesInRegions(string str):InvalidInput(str) {
+        this->reason = "No sites were found in the regions, check: ";
+        throwMsg = this->reason + this->src;
+    }
+    ~NoSitesInRegions() throw() {}
+};
+
+
+/*! \brief Genomic region, 1-based and inclusive */
+struct GenomicRegion {
+    string chrom;
+    int start;
+    int end;
+    // CHROM, CHROM:START or CHROM:START-END
+    explicit GenomicRegion(const string &region);
+    GenomicRegion(const string &chrom, int start, int end)
+        : chrom(chrom), start(start), end(end) {}
+    bool contains(std::string_view chrom, int pos) const {
+        return chrom == this->chrom && pos >= this->start && pos <= this->end;
+    }
+    string str() const;
+};
+
+
+// Whether a data line, starting with CHROM and POS, is in any of the regions.
+// Lines whose POS does not parse are kept, for their reader to report.
+bool lineInRegions(const vector <GenomicRegion> &regions,
+                   std::string_view line);
+
+
+/*! \brief Tabix (.tbi) or CSI (.csi) index of a bgzipped file */
+class TabixIndex {
+#ifdef UNITTEST
+  friend class TestVCF;
+#endif
+ public:
+    TabixIndex() : minShift_(14), depth_(5) {}
+    ~TabixIndex() {}
+
+    // Looks for fileName.tbi, then fileName.csi. Returns false if neither
+    // exists, or the index does not name its chromosomes.
+    bool load(const string &fileName);
+    // Virtual offset to start reading the region from, false if the index
+    // has no records in it
+    bool regionOffset(const GenomicRegion &region, uint64_t &offset) const;
+    // Position of chrom in the index, which is its order in the file, or -1
+    int chromIndex(const string &chrom) const;
+
+ private:
+    struct IndexChunk {
+        uint64_t beg;
+        uint64_t end;
+    };
+    struct IndexBin {
+        uint32_t bin;
+        vector <IndexChunk> chunks;
+    };
+
+    string indexFileName_;
+    int minShift_;
+    int depth_;
+    vector <string> names_;
+    vector < vector <IndexBin> > bins_;
+    // Tabix linear index, empty for CSI
+    vector < vector <uint64_t> > linearIndex_;
+
+    void parseTbi(const vector <unsigned char> &bytes);
+    void parseCsi(const vector <unsigned char> &bytes);
+    size_t parseNames(const vector <unsigned char> &bytes, size_t cur,
+                      size_t end);
+    void regionToBins(int beg, int end, vector <uint32_t> &bins) const;
+};
+
+
+/*! \brief Line reader over the regions of an indexed, bgzipped file
+ *
+ * Regions are put in file order and merged, then each is read from the
+ * offset given by the index, so only the blocks holding it are inflated.
+ */
+class RegionReader {
+#ifdef UNITTEST
+  friend class TestVCF;
+#endif
+ public:
+    RegionReader() : regionI_(0), inRegion_(false) {}
+    ~RegionReader() {}
+
+    // Returns false if the file is not bgzipped or has no index
+    bool open(const string &fileName, const vector <GenomicRegion> &regions,
+              size_t nThreads = 1);
+    void close() { this->file_.close(); }
+    // Lines from the start of the file, for the header
+    bool getline(string &line) { return this->file_.getline(line); }
+    // Next data line in the regions, false once they are exhausted
+    bool getlineInRegions(string &line);
+
+ private:
+    BgzfReader file_;
+    TabixIndex index_;
+    vector <GenomicRegion> regions_;
+    size_t regionI_;
+    bool inRegion_;
+};
+
+#endif  // DEPLOID_SRC_REGIONREADER_HPP_
@@ -27,8 +27,17 @@
 #include <iostream>
 #include <algorithm>
 #include <iterator>     // std::distance
+#include <charconv>     // std::from_chars
+#include <cstring>      // memchr
+#include <condition_variable>
+#include <deque>
+#include <memory>       // std::unique_ptr
+#include <mutex>
+#include <thread>
 #include "exceptions.hpp"
 #include "txtReader.hpp"
+#include "mappedFile.hpp"
+#include "parallel.hpp"
 
 using std::min;
 
@@ -36,6 +45,44 @@ void TxtReader::readFromFileBase(const char inchar[]) {
     this->fileName_ = string(inchar);
     this->checkFileCompressed();
 
+    tmpChromInex_ = -1;
+    // Regions are read through the index when there is one, otherwise rows
+    // outside them are dropped as the rows are collected
+    RegionReader regionReader;
+    if (this->regions_.size() > 0 && this->isCompressed() &&
+        regionReader.open(this->fileName_, this->regions_, this->nThreads_)) {
+        this->readFromRegions(regionReader);
+    } else if (this->isCompressed() &&
+               (this->nThreads_ > 1 || this->regions_.size() > 0)) {
+        this->readFromStreamInBatches();
+    } else if (this->isCompressed()) {
+        this->readFromStream();
+    } else {
+        this->readFromMappedFile();
+    }
+
+    if (this->regions_.size() > 0 && this->content_.size() == 0) {
+        throw NoSitesInRegions(this->fileName_);
+    }
+
+    this->position_.push_back(this->tmpPosition_);
+
+    this->nLoci_ = this->content_.size();
+    this->nInfoLines_ = this->content_.back().size();
+
+    if (this->nInfoLines_ == 1) {
+        this->reshapeContentToInfo();
+    }
+
+    this->getIndexOfChromStarts();
+    assert(tmpChromInex_ > -1);
+    assert(chrom_.size() == position_.size());
+    assert(this->doneGetIndexOfChromStarts_ == true);
+    this->checkSortedPositions(this->fileName_);
+}
+
+
+void TxtReader::readFromStream() {
     if (this->isCompressed()) {
         this->inFileGz.open(this->fileName_.c_str(), std::ios::in);
     } else {
@@ -52,7 +99,6 @@ void TxtReader::readFromFileBase(const char inchar[]) {
         }
     }
 
-    tmpChromInex_ = -1;
     string tmp_line;
     // skip the first line, which is the header
     if (this->isCompressed()) {
@@ -62,13 +108,11 @@ void TxtReader::readFromFileBase(const char inchar[]) {
     }
     this->extractHeader(tmp_line);
 
-    if (this->isCompressed()) {
-        getline(inFileGz, tmp_line);
-    } else {
-        getline(inFile, tmp_line);
-    }
+    bool moreLines = this->isCompressed() ?
+        static_cast<bool>(getline(inFileGz, tmp_line)) :
+        static_cast<bool>(getline(inFile, tmp_line));
 
-    while (inFile.good() && tmp_line.size() > 0) {
+    while (moreLines && tmp_line.size() > 0) {
         size_t field_start = 0;
         size_t field_end = 0;
         size_t field_index = 0;
@@ -96,11 +140,9 @@ void TxtReader::readFromFileBase(const char inchar[]) {
         }
         this->content_.push_back(contentRow);
 
-        if (this->isCompressed()) {
-            getline(inFileGz, tmp_line);
-        } else {
-            getline(inFile, tmp_line);
-        }
+        moreLines = this->isCompressed() ?
+            static_cast<bool>(getline(inFileGz, tmp_line)) :
+            static_cast<bool>(getline(inFile, tmp_line));
     }
 
     if (this->isCompressed()) {
@@ -108,21 +150,267 @@ void TxtReader::readFromFileBase(const char inchar[]) {
     } else {
         this->inFile.close();
     }
+}
 
-    this->position_.push_back(this->tmpPosition_);
 
-    this->nLoci_ = this->content_.size();
-    this->nInfoLines_ = this->content_.back().size();
+static inline bool isFieldDelimiter(char c) {
+    return (c == ' ') || (c == ',') || (c == '\t');
+}
 
-    if (this->nInfoLines_ == 1) {
-        this->reshapeContentToInfo();
+
+static inline const char * findLineEnd(const char * first, const char * last) {
+    const char * lineEnd = static_cast<const char *>(
+        memchr(first, '\n', last - first));
+    return (lineEnd == NULL) ? last : lineEnd;
+}
+
+
+static inline const char * findFieldEnd(const char * first,
+                                        const char * last) {
+    while (first < last && !isFieldDelimiter(*first)) {
+        first++;
     }
+    return first;
+}
 
-    this->getIndexOfChromStarts();
-    assert(tmpChromInex_ > -1);
-    assert(chrom_.size() == position_.size());
-    assert(this->doneGetIndexOfChromStarts_ == true);
-    this->checkSortedPositions(this->fileName_);
+
+// Same value as strtod, which handles anything from_chars does not accept
+static inline double parseDouble(const char * first, const char * last) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    double value;
+    std::from_chars_result res = std::from_chars(first, last, value);
+    if (res.ec == std::errc() && res.ptr == last) {
+        return value;
+    }
+#endif
+    return strtod(string(first, last).c_str(), NULL);
+}
+
+
+// Uncompressed files are tokenised in place: rows are located first, then
+// parsed straight into their preallocated rows.
+void TxtReader::readFromMappedFile() {
+    MappedFile file(this->fileName_);
+    const char * cur = file.data();
+    const char * end = file.end();
+
+    // the first line is the header
+    const char * lineEnd = findLineEnd(cur, end);
+    this->extractHeader(string(cur, lineEnd));
+    cur = (lineEnd < end) ? lineEnd + 1 : end;
+
+    vector <RowSpan> rows;
+    while (cur < end) {
+        lineEnd = findLineEnd(cur, end);
+        if (lineEnd == cur) {
+            break;
+        }
+        if (this->isInRegions(cur, lineEnd)) {
+            rows.push_back(RowSpan(cur, lineEnd));
+        }
+        cur = (lineEnd < end) ? lineEnd + 1 : end;
+    }
+
+    size_t firstRow = this->content_.size();
+    this->content_.resize(firstRow + rows.size());
+    this->tmpPosition_.reserve(rows.size());
+    this->parseRows(rows, firstRow);
+}
+
+
+// Gzipped files are decompressed on their own thread, which hands batches of
+// lines over to the parsers.
+void TxtReader::readFromStreamInBatches() {
+    this->inFileGz.open(this->fileName_.c_str(), std::ios::in);
+    if (!inFileGz.good()) {
+        throw InvalidInputFile(this->fileName_);
+    }
+
+    string tmp_line;
+    // skip the first line, which is the header
+    getline(inFileGz, tmp_line);
+    this->extractHeader(tmp_line);
+
+    const size_t batchSize = 4096;
+    const size_t maxQueuedBatches = 4;
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::deque < vector <string> > queue;
+    bool doneReading = false;
+    bool stopReading = false;
+
+    std::thread decompressor([&]() {
+        vector <string> batch;
+        string line;
+        while (true) {
+            // At the end of the file getline fails and leaves the last line
+            // in place, so the stream state is checked, not the line
+            bool lastBatch = !getline(inFileGz, line) || line.size() == 0;
+            if (!lastBatch) {
+                batch.push_back(line);
+            }
+            if (batch.size() == batchSize || lastBatch) {
+                std::unique_lock <std::mutex> lock(queueMutex);
+                queueChanged.wait(lock, [&]() {
+                    return queue.size() < maxQueuedBatches || stopReading; });
+                if (stopReading) {
+                    return;
+                }
+                queue.push_back(vector <string> ());
+                queue.back().swap(batch);
+                doneReading = lastBatch;
+                queueChanged.notify_all();
+            }
+            if (lastBatch) {
+                return;
+            }
+        }
+    });
+
+    try {
+        vector <RowSpan> rows;
+        while (true) {
+            vector <string> batch;
+            {
+                std::unique_lock <std::mutex> lock(queueMutex);
+                queueChanged.wait(lock, [&]() {
+                    return !queue.empty() || doneReading; });
+                if (queue.empty()) {
+                    break;
+                }
+                batch.swap(queue.front());
+                queue.pop_front();
+                queueChanged.notify_all();
+            }
+
+            rows.clear();
+            for (const string &line : batch) {
+                if (this->isInRegions(line.data(), line.data() + line.size())) {
+                    rows.push_back(RowSpan(line.data(),
+                                           line.data() + line.size()));
+                }
+            }
+            size_t firstRow = this->content_.size();
+            this->content_.resize(firstRow + rows.size());
+            this->parseRows(rows, firstRow);
+        }
+    } catch (...) {
+        {
+            std::lock_guard <std::mutex> lock(queueMutex);
+            stopReading = true;
+        }
+        queueChanged.notify_all();
+        decompressor.join();
+        this->inFileGz.close();
+        throw;
+    }
+
+    decompressor.join();
+    this->inFileGz.close();
+}
+
+
+// Only the blocks holding the regions are inflated; rows are then parsed in
+// batches as for gzipped files.
+void TxtReader::readFromRegions(RegionReader &regionReader) {
+    string tmp_line;
+    // the first line is the header
+    regionReader.getline(tmp_line);
+    this->extractHeader(tmp_line);
+
+    const size_t batchSize = 4096;
+    vector <string> batch;
+    vector <RowSpan> rows;
+    bool moreLines = true;
+    while (moreLines) {
+        batch.clear();
+        while (batch.size() < batchSize &&
+               (moreLines = regionReader.getlineInRegions(tmp_line))) {
+            batch.push_back(tmp_line);
+        }
+
+        rows.clear();
+        for (const string &line : batch) {
+            rows.push_back(RowSpan(line.data(), line.data() + line.size()));
+        }
+        size_t firstRow = this->content_.size();
+        this->content_.resize(firstRow + rows.size());
+        this->parseRows(rows, firstRow);
+    }
+    regionReader.close();
+}
+
+
+// Rows are parsed in waves of chunks, one chunk per task. CHROM and POS are
+// then added in row order, so chromosome changes and bad positions are found
+// across chunk joins and errors do not depend on the number of threads.
+void TxtReader::parseRows(const vector <RowSpan> &rows, size_t firstRow) {
+    if (rows.size() == 0) {
+        return;
+    }
+    size_t nCols = static_cast<size_t>(std::count_if(rows[0].first,
+                                                     rows[0].second,
+                                                     isFieldDelimiter)) + 1;
+    nCols = (nCols > 2) ? nCols - 2 : 0;
+
+    const size_t rowsPerTask = 1024;
+    size_t waveSize = rowsPerTask * std::max(this->nThreads_,
+                                             static_cast<size_t>(1));
+    vector <TxtRowKey> keys(min(waveSize, rows.size()));
+    for (size_t waveStart = 0; waveStart < rows.size();
+         waveStart += waveSize) {
+        size_t waveEnd = min(waveStart + waveSize, rows.size());
+        size_t nTasks = (waveEnd - waveStart + rowsPerTask - 1) / rowsPerTask;
+        runInParallel(nTasks, this->nThreads_, [&](size_t task) {
+            size_t taskStart = waveStart + task * rowsPerTask;
+            size_t taskEnd = min(taskStart + rowsPerTask, waveEnd);
+            for (size_t rowI = taskStart; rowI < taskEnd; rowI++) {
+                vector <double> &contentRow = this->content_[firstRow + rowI];
+                contentRow.reserve(nCols);
+                this->parseRow(rows[rowI], contentRow, keys[rowI - waveStart]);
+            }
+        });
+
+        for (size_t rowI = waveStart; rowI < waveEnd; rowI++) {
+            const TxtRowKey &key = keys[rowI - waveStart];
+            this->extractChrom(key.chromFirst, key.chromLast);
+            if (key.posParsed) {
+                this->tmpPosition_.push_back(key.pos);
+            } else if (key.posFirst != NULL) {
+                this->extractPOS(string(key.posFirst, key.posLast));
+            }
+        }
+    }
+}
+
+
+void TxtReader::parseRow(const RowSpan &row, vector <double> &contentRow,
+                         TxtRowKey &key) const {
+    key.posFirst = NULL;
+    key.posLast = NULL;
+    key.posParsed = false;
+    size_t field_index = 0;
+    const char * field_start = row.first;
+    while (true) {
+        const char * field_end = findFieldEnd(field_start, row.second);
+        if (field_index > 1) {
+            contentRow.push_back(parseDouble(field_start, field_end));
+        } else if (field_index == 0) {
+            key.chromFirst = field_start;
+            key.chromLast = field_end;
+        } else if (field_index == 1) {
+            key.posFirst = field_start;
+            key.posLast = field_end;
+            std::from_chars_result res = std::from_chars(field_start,
+                                                         field_end, key.pos);
+            key.posParsed = (res.ec == std::errc() && res.ptr == field_end);
+        }
+        field_index++;
+        if (field_end == row.second) {
+            break;
+        }
+        field_start = field_end + 1;
+    }
 }
 
 
@@ -189,22 +477,37 @@ void TxtReader::extractChrom(const string & tmp_str) {
 }
 
 
-void TxtReader::extractPOS(const string & tmp_str) {
+void TxtReader::extractChrom(const char * first, const char * last) {
+    if (tmpChromInex_ >= 0 &&
+            this->chrom_.back().compare(0, string::npos, first,
+                                        last - first) == 0) {
+        return;
+    }
+    this->extractChrom(string(first, last));
+}
+
+
+static int parsePOS(const string & tmp_str, const string & fileName) {
     if (tmp_str.find("e") != std::string::npos) {
-        throw BadScientificNotation(tmp_str, this->fileName_);
+        throw BadScientificNotation(tmp_str, fileName);
     }
 
     if (tmp_str.find("E") != std::string::npos) {
-        throw BadScientificNotation(tmp_str, this->fileName_);
+        throw BadScientificNotation(tmp_str, fileName);
     }
 
     int ret;
     try {
         ret = stoi(tmp_str.c_str(), NULL);
     } catch ( const std::exception &e) {
-        throw BadConversion(tmp_str, this->fileName_);
+        throw BadConversion(tmp_str, fileName);
     }
-    this->tmpPosition_.push_back(ret);
+    return ret;
+}
+
+
+void TxtReader::extractPOS(const string & tmp_str) {
+    this->tmpPosition_.push_back(parsePOS(tmp_str, this->fileName_));
 }
 
 
@@ -222,10 +525,8 @@ void TxtReader::removeMarkers() {
         this->keptContent_.push_back(this->content_[value]);
     }
 
-    this->content_.clear();
-    assert(this->content_.size() == static_cast<size_t>(0));
-    this->content_ = this->keptContent_;
-    this->keptContent_.clear();
+    this->content_.swap(this->keptContent_);
+    vector < vector <double> >().swap(this->keptContent_);
 
     if (this->nInfoLines_ == 1) {
         this->info_.clear();
@@ -233,3 +534,369 @@ void TxtReader::removeMarkers() {
     }
     this->nLoci_ = this->content_.size();
 }
+
+
+static bool isBedFileName(const string &fileName) {
+    for (const string &suffix : {string(".bed"), string(".bed.gz")}) {
+        if (fileName.size() >= suffix.size() &&
+            fileName.compare(fileName.size() - suffix.size(), suffix.size(),
+                             suffix) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void ExcludeMarker::readFromFile(const char inchar[]) {
+    if (isBedFileName(inchar)) {
+        this->fileName_ = string(inchar);
+        this->readFromBedFile();
+    } else {
+        this->readFromFileBase(inchar);
+        this->buildIntervalsFromPositions();
+    }
+}
+
+
+void ExcludeMarker::readFromBedFile() {
+    this->checkFileCompressed();
+    igzstream inFileBed;
+    ifstream inFileTxt;
+    std::istream * inFile = &inFileTxt;
+    if (this->isCompressed()) {
+        inFileBed.open(this->fileName_.c_str(), std::ios::in);
+        inFile = &inFileBed;
+    } else {
+        inFileTxt.open(this->fileName_.c_str(), std::ios::in);
+    }
+    if (!inFile->good()) {
+        throw InvalidInputFile(this->fileName_);
+    }
+
+    this->chrom_.clear();
+    this->intervals_.clear();
+    size_t chromI = 0;
+    string line;
+    while (getline(*inFile, line)) {
+        if (line.size() > 0 && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.size() == 0 || line[0] == '#' ||
+            line.compare(0, 5, "track") == 0 ||
+            line.compare(0, 7, "browser") == 0) {
+            continue;
+        }
+        // CHROM, START and END, further fields are ignored
+        std::string_view fields[3];
+        size_t fieldStart = 0;
+        for (size_t fieldI = 0; fieldI < 3; fieldI++) {
+            fieldStart = min(line.find_first_not_of(" \t", fieldStart),
+                             line.size());
+            size_t fieldEnd = min(line.find_first_of(" \t", fieldStart),
+                                  line.size());
+            fields[fieldI] = std::string_view(line).substr(
+                fieldStart, fieldEnd - fieldStart);
+            fieldStart = fieldEnd;
+        }
+        int start, end;
+        std::from_chars_result startRes = std::from_chars(
+            fields[1].data(), fields[1].data() + fields[1].size(), start);
+        std::from_chars_result endRes = std::from_chars(
+            fields[2].data(), fields[2].data() + fields[2].size(), end);
+        if (fields[0].size() == 0 || fields[1].size() == 0 ||
+            fields[2].size() == 0 || startRes.ec != std::errc() ||
+            startRes.ptr != fields[1].data() + fields[1].size() ||
+            endRes.ec != std::errc() ||
+            endRes.ptr != fields[2].data() + fields[2].size() ||
+            start < 0 || end < start) {
+            throw InvalidBedInterval(line);
+        }
+        if (start == end) {
+            continue;
+        }
+
+        // Lines of a chromosome usually follow each other
+        if (chromI == this->chrom_.size() ||
+            this->chrom_[chromI] != fields[0]) {
+            chromI = std::distance(this->chrom_.begin(), std::find(
+                this->chrom_.begin(), this->chrom_.end(), fields[0]));
+            if (chromI == this->chrom_.size()) {
+                this->chrom_.push_back(string(fields[0]));
+                this->intervals_.push_back(vector <ExcludedInterval>());
+            }
+        }
+        this->intervals_[chromI].push_back(ExcludedInterval(start + 1, end));
+    }
+
+    this->sortAndMergeIntervals();
+    this->position_.assign(this->chrom_.size(), vector <int>());
+    this->nLoci_ = 0;
+    this->nInfoLines_ = 0;
+    this->getIndexOfChromStarts();
+}
+
+
+void ExcludeMarker::buildIntervalsFromPositions() {
+    this->intervals_.clear();
+    for (auto const& positionOfChrom : this->position_) {
+        vector <ExcludedInterval> intervals;
+        intervals.reserve(positionOfChrom.size());
+        for (int position : positionOfChrom) {
+            intervals.push_back(ExcludedInterval(position, position));
+        }
+        this->intervals_.push_back(intervals);
+    }
+    this->sortAndMergeIntervals();
+}
+
+
+// Overlapping and adjacent intervals are merged, so that each position is in
+// at most one interval
+void ExcludeMarker::sortAndMergeIntervals() {
+    for (vector <ExcludedInterval> &intervals : this->intervals_) {
+        if (!std::is_sorted(intervals.begin(), intervals.end())) {
+            std::sort(intervals.begin(), intervals.end());
+        }
+        size_t nMerged = 0;
+        for (size_t i = 0; i < intervals.size(); i++) {
+            if (nMerged > 0 &&
+                intervals[i].first <= intervals[nMerged - 1].second + 1) {
+                intervals[nMerged - 1].second = std::max(
+                    intervals[nMerged - 1].second, intervals[i].second);
+            } else {
+                intervals[nMerged++] = intervals[i];
+            }
+        }
+        intervals.resize(nMerged);
+        intervals.shrink_to_fit();
+    }
+}
+
+
+const vector <ExcludedInterval> * ExcludeMarker::findIntervals(
+    std::string_view chrom) const {
+    for (size_t chromI = 0; chromI < this->chrom_.size(); chromI++) {
+        if (this->chrom_[chromI] == chrom) {
+            return &this->intervals_[chromI];
+        }
+    }
+    return NULL;
+}
+
+
+bool ExcludeMarker::isExcluded(const vector <ExcludedInterval> &intervals,
+                               int pos) {
+    // The first interval ending at or after pos
+    vector <ExcludedInterval>::const_iterator it = std::lower_bound(
+        intervals.begin(), intervals.end(), pos,
+        [](const ExcludedInterval &interval, int value) {
+            return interval.second < value; });
+    return it != intervals.end() && it->first <= pos;
+}
+
+
+// Data lines of a text file, from the line after the header up to the first
+// empty line, and in the regions if any are given
+class TxtLineSource {
+ public:
+    TxtLineSource(const string &fileName,
+                  const vector <GenomicRegion> &regions, size_t nThreads);
+    bool getline(std::string_view &line);
+
+ private:
+    TxtLineSource(const TxtLineSource &);
+    TxtLineSource & operator=(const TxtLineSource &);
+
+    const vector <GenomicRegion> &regions_;
+    std::unique_ptr <MappedFile> mappedFile_;
+    const char * cur_;
+    igzstream inFileGz_;
+    RegionReader regionReader_;
+    bool useRegionReader_;
+    string line_;
+
+    bool nextLine(std::string_view &line);
+};
+
+
+TxtLineSource::TxtLineSource(const string &fileName,
+                             const vector <GenomicRegion> &regions,
+                             size_t nThreads)
+    : regions_(regions), cur_(NULL), useRegionReader_(false) {
+    FILE * f = fopen(fileName.c_str(), "rb");
+    if (f == NULL) {
+        throw InvalidInputFile(fileName);
+    }
+    unsigned char magic[2] = {0, 0};
+    size_t nMagic = fread(magic, 1, 2, f);
+    fclose(f);
+
+    if (nMagic < 2 || magic[0] != 0x1f || magic[1] != 0x8b) {
+        this->mappedFile_.reset(new MappedFile(fileName));
+        this->cur_ = this->mappedFile_->data();
+    } else if (regions.size() > 0 &&
+               this->regionReader_.open(fileName, regions, nThreads)) {
+        this->useRegionReader_ = true;
+    } else {
+        this->inFileGz_.open(fileName.c_str(), std::ios::in);
+        if (!this->inFileGz_.good()) {
+            throw InvalidInputFile(fileName);
+        }
+    }
+
+    // skip the first line, which is the header
+    if (this->useRegionReader_) {
+        this->regionReader_.getline(this->line_);
+    } else {
+        std::string_view header;
+        this->nextLine(header);
+    }
+}
+
+
+bool TxtLineSource::nextLine(std::string_view &line) {
+    if (this->useRegionReader_) {
+        if (!this->regionReader_.getlineInRegions(this->line_)) {
+            return false;
+        }
+        line = this->line_;
+    } else if (this->mappedFile_) {
+        const char * end = this->mappedFile_->end();
+        if (this->cur_ >= end) {
+            return false;
+        }
+        const char * lineEnd = findLineEnd(this->cur_, end);
+        line = std::string_view(this->cur_, lineEnd - this->cur_);
+        this->cur_ = (lineEnd < end) ? lineEnd + 1 : end;
+    } else {
+        if (!std::getline(this->inFileGz_, this->line_)) {
+            return false;
+        }
+        line = this->line_;
+    }
+    return true;
+}
+
+
+bool TxtLineSource::getline(std::string_view &line) {
+    while (this->nextLine(line) && line.size() > 0) {
+        if (this->useRegionReader_ || this->regions_.size() == 0 ||
+            lineInRegions(this->regions_, line)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// CHROM, POS and the first value of a data line
+static void parseSite(std::string_view line, const string &fileName,
+                      std::string_view &chrom, int &pos, double &value) {
+    const char * first = line.data();
+    const char * last = first + line.size();
+    const char * chromEnd = findFieldEnd(first, last);
+    chrom = std::string_view(first, chromEnd - first);
+    if (chromEnd == last) {
+        throw BadConversion(string(line), fileName);
+    }
+    const char * posFirst = chromEnd + 1;
+    const char * posEnd = findFieldEnd(posFirst, last);
+    std::from_chars_result res = std::from_chars(posFirst, posEnd, pos);
+    if (res.ec != std::errc() || res.ptr != posEnd) {
+        pos = parsePOS(string(posFirst, posEnd), fileName);
+    }
+    if (posEnd == last) {
+        throw BadConversion(string(line), fileName);
+    }
+    const char * valueFirst = posEnd + 1;
+    value = parseDouble(valueFirst, findFieldEnd(valueFirst, last));
+}
+
+
+void AlignedTxtReader::readFromFiles(const string &refFileName,
+                                     const string &altFileName,
+                                     const string &plafFileName,
+                                     const ExcludeMarker * excludedMarkers) {
+    const string * fileNames[3] = {&refFileName, &altFileName, &plafFileName};
+    TxtLineSource ref(refFileName, this->regions_, this->nThreads_);
+    TxtLineSource alt(altFileName, this->regions_, this->nThreads_);
+    TxtLineSource plaf(plafFileName, this->regions_, this->nThreads_);
+    TxtLineSource * sources[3] = {&ref, &alt, &plaf};
+    vector <double> * values[3] = {&this->refCount_, &this->altCount_,
+                                   &this->plaf_};
+
+    this->chrom_.clear();
+    this->position_.clear();
+    for (vector <double> * value : values) {
+        value->clear();
+    }
+
+    const vector <ExcludedInterval> * excluded = NULL;
+    vector <int> positionOfChrom;
+    int previousPosition = 0;
+    size_t nSitesRead = 0;
+    std::string_view lines[3];
+    while (true) {
+        bool hasLine[3];
+        for (size_t fileI = 0; fileI < 3; fileI++) {
+            hasLine[fileI] = sources[fileI]->getline(lines[fileI]);
+        }
+        for (size_t fileI = 1; fileI < 3; fileI++) {
+            if (hasLine[fileI] != hasLine[0]) {
+                throw SitesMisaligned(*fileNames[fileI]);
+            }
+        }
+        if (!hasLine[0]) {
+            break;
+        }
+
+        std::string_view chrom[3];
+        int pos[3];
+        double value[3];
+        for (size_t fileI = 0; fileI < 3; fileI++) {
+            parseSite(lines[fileI], *fileNames[fileI], chrom[fileI],
+                      pos[fileI], value[fileI]);
+            if (chrom[fileI] != chrom[0] || pos[fileI] != pos[0]) {
+                throw SitesMisaligned(*fileNames[fileI]);
+            }
+        }
+        nSitesRead++;
+
+        if (this->chrom_.size() == 0 || this->chrom_.back() != chrom[0]) {
+            if (this->chrom_.size() > 0) {
+                this->position_.push_back(positionOfChrom);
+                positionOfChrom.clear();
+            }
+            this->chrom_.push_back(string(chrom[0]));
+            excluded = (excludedMarkers == NULL) ? NULL :
+                       excludedMarkers->findIntervals(chrom[0]);
+            previousPosition = 0;
+        }
+        // Excluded sites must be sorted too
+        if (pos[0] < previousPosition) {
+            throw PositionUnsorted(refFileName);
+        }
+        previousPosition = pos[0];
+        if (excluded != NULL &&
+            ExcludeMarker::isExcluded(*excluded, pos[0])) {
+            continue;
+        }
+        positionOfChrom.push_back(pos[0]);
+        for (size_t fileI = 0; fileI < 3; fileI++) {
+            values[fileI]->push_back(value[fileI]);
+        }
+    }
+
+    if (nSitesRead == 0) {
+        if (this->regions_.size() > 0) {
+            throw NoSitesInRegions(refFileName);
+        }
+        throw InvalidInputFile(refFileName);
+    }
+    this->position_.push_back(positionOfChrom);
+
+    this->nLoci_ = this->refCount_.size();
+    this->setDoneGetIndexOfChromStarts(false);
+    this->getIndexOfChromStarts();
+}
@@ -29,9 +29,23 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <utility>  // std::pair
 #include "variantIndex.hpp"
 #include "exceptions.hpp"
 #include "gzstream/gzstream.h"
+#include "regionReader.hpp"
+
+// CHROM and POS fields of one row, as found by a parser thread
+struct TxtRowKey {
+    const char * chromFirst;
+    const char * chromLast;
+    const char * posFirst;
+    const char * posLast;
+    int pos;
+    bool posParsed;
+};
+
 
 class TxtReader : public VariantIndex {
     #ifdef UNITTEST
@@ -44,6 +58,7 @@ class TxtReader : public VariantIndex {
     friend class UpdatePairHap;
     friend class UpdateHap;
     friend class Panel;
+    friend class ExcludeMarker;
     friend class DEploidIO;
  private:
     // Members
@@ -68,13 +83,36 @@ class TxtReader : public VariantIndex {
 
     // Methods
     void extractChrom(const string & tmp_str);
+    void extractChrom(const char * first, const char * last);
     void extractPOS(const string & tmp_str);
+    void readFromStream();
+    void readFromStreamInBatches();
+    void readFromMappedFile();
+    void readFromRegions(RegionReader &regionReader);
+
+    // Only the rows in regions_ are read, if any are given
+    vector <GenomicRegion> regions_;
+    bool isInRegions(const char * first, const char * last) const {
+        return this->regions_.size() == 0 ||
+               lineInRegions(this->regions_, std::string_view(first,
+                                                              last - first));
+    }
+
+    // Rows are parsed by up to nThreads_ threads
+    size_t nThreads_;
+    typedef std::pair <const char *, const char *> RowSpan;
+    void parseRows(const vector <RowSpan> &rows, size_t firstRow);
+    void parseRow(const RowSpan &row, vector <double> &contentRow,
+                  TxtRowKey &key) const;
     void extractHeader(const string &line);
     void reshapeContentToInfo();
 
  public:  // move the following to private
     vector < vector < double > > content_;
-    TxtReader() {}
+    TxtReader() : nThreads_(1) {}
+    void setNThreads(const size_t setTo) { this->nThreads_ = setTo; }
+    void setRegions(const vector <GenomicRegion> &regions) {
+        this->regions_ = regions; }
     virtual void readFromFile(const char inchar[]) {
         this->readFromFileBase(inchar); }
     void readFromFileBase(const char inchar[]);
@@ -85,10 +123,82 @@ class TxtReader : public VariantIndex {
 
 
 
+struct InvalidBedInterval : public InvalidInput{
+    explicit InvalidBedInterval(string str):InvalidInput(str) {
+        this->reason = "Invalid BED interval: ";
+        throwMsg = this->reason + this->src;
+    }
+    ~InvalidBedInterval() throw() {}
+};
+
+
+// Excluded positions from first to second, 1-based and inclusive
+typedef std::pair <int, int> ExcludedInterval;
+
+
 class ExcludeMarker : public TxtReader {
+    #ifdef UNITTEST
+    friend class TestTxtReader;
+    #endif
  public:
     ExcludeMarker():TxtReader() {}
     ~ExcludeMarker() {}
+
+    // Lists of CHROM and POS, or BED files (.bed or .bed.gz) of 0-based,
+    // half-open intervals
+    void readFromFile(const char inchar[]);
+    // Sorted and disjoint excluded intervals of chrom, NULL if none
+    const vector <ExcludedInterval> * findIntervals(
+        std::string_view chrom) const;
+    static bool isExcluded(const vector <ExcludedInterval> &intervals,
+                           int pos);
+
+ private:
+    // One list per chrom_, positions read from a list are merged into runs
+    vector < vector <ExcludedInterval> > intervals_;
+    void readFromBedFile();
+    void buildIntervalsFromPositions();
+    void sortAndMergeIntervals();
+};
+
+
+struct SitesMisaligned : public InvalidInput{
+    explicit SitesMisaligned(string str):InvalidInput(str) {
+        this->reason = "Sites (CHROM and POS) differ from the ref count in: ";
+        throwMsg = this->reason + this->src;
+    }
+    ~SitesMisaligned() throw() {}
+};
+
+
+/*! \brief Reader of the ref count, alt count and PLAF files together
+ *
+ * The three files are read line by line in lockstep, so they must list the
+ * same sites in the same order. The sites are kept once, and the first
+ * value of each line is taken.
+ */
+class AlignedTxtReader : public VariantIndex {
+    #ifdef UNITTEST
+    friend class TestTxtReader;
+    #endif
+    friend class DEploidIO;
+ public:
+    AlignedTxtReader() : nThreads_(1) {}
+    ~AlignedTxtReader() {}
+    void setNThreads(const size_t setTo) { this->nThreads_ = setTo; }
+    void setRegions(const vector <GenomicRegion> &regions) {
+        this->regions_ = regions; }
+    // Sites in excludedMarkers, if given, are dropped as they are read
+    void readFromFiles(const string &refFileName, const string &altFileName,
+                       const string &plafFileName,
+                       const ExcludeMarker * excludedMarkers);
+
+ private:
+    vector <double> refCount_;
+    vector <double> altCount_;
+    vector <double> plaf_;
+    vector <GenomicRegion> regions_;
+    size_t nThreads_;
 };
 
 
@@ -23,7 +23,7 @@
  *
  */
 
-#include <algorithm>  // find
+#include <algorithm>  // lower_bound
 #include <iostream>
 #include "exceptions.hpp"
 #include "txtReader.hpp"
@@ -33,6 +33,29 @@ using std::min;
 using std::endl;
 
 
+// Flags the sites of givenIndex among nSites sites, so that each site is
+// looked up in constant time
+static vector <bool> flagGivenIndex(const vector <size_t> &givenIndex,
+                                    size_t nSites) {
+    vector <bool> isGiven(nSites, false);
+    for (size_t siteI : givenIndex) {
+        if (siteI < nSites) {
+            isGiven[siteI] = true;
+        }
+    }
+    return isGiven;
+}
+
+
+static size_t countSites(const vector < vector <int> > &position) {
+    size_t nSites = 0;
+    for (auto const& positionOfChrom : position) {
+        nSites += positionOfChrom.size();
+    }
+    return nSites;
+}
+
+
 VariantIndex::VariantIndex() {
     this->init();
 }
@@ -47,26 +70,39 @@ void VariantIndex::findWhoToBeKept(ExcludeMarker* excludedMarkers) {
         vector < size_t > tmpindexOfPosToBeKept;
 
         // detemine if something needs to be removed from the current chrom.
-        vector<string>::iterator chromIt = find(excludedMarkers->chrom_.begin(),
-                                                excludedMarkers->chrom_.end(),
-                                                this->chrom_[chromI]);
+        const vector <ExcludedInterval> * excluded =
+            excludedMarkers->findIntervals(this->chrom_[chromI]);
 
+        // Sorted positions are walked along with the excluded intervals, a
+        // position going backwards restarts the walk
         size_t hapIndex = indexOfChromStarts_[chromI];
-        size_t chromIndexInExclude = std::distance(
-                                        excludedMarkers->chrom_.begin(),
-                                        chromIt);
+        vector <ExcludedInterval>::const_iterator excludedIt;
+        if (excluded != NULL) {
+            excludedIt = excluded->begin();
+        }
+        int previousPosition = 0;
         for (size_t posI = 0; posI < this->position_[chromI].size(); posI++) {
-            if (chromIt == excludedMarkers->chrom_.end()) {
-                indexOfContentToBeKept.push_back(hapIndex);
-                tmpindexOfPosToBeKept.push_back(posI);
-            } else if (
-              std::find(excludedMarkers->position_[chromIndexInExclude].begin(),
-                        excludedMarkers->position_[chromIndexInExclude].end(),
-                        this->position_[chromI][posI]) ==
-                        excludedMarkers->position_[chromIndexInExclude].end()) {
+            int position = this->position_[chromI][posI];
+            bool isExcluded = false;
+            if (excluded != NULL) {
+                if (position < previousPosition) {
+                    excludedIt = std::lower_bound(excluded->begin(),
+                        excluded->end(), position,
+                        [](const ExcludedInterval &interval, int value) {
+                            return interval.second < value; });
+                }
+                while (excludedIt != excluded->end() &&
+                       excludedIt->second < position) {
+                    ++excludedIt;
+                }
+                isExcluded = (excludedIt != excluded->end() &&
+                              excludedIt->first <= position);
+            }
+            if (!isExcluded) {
                 indexOfContentToBeKept.push_back(hapIndex);
                 tmpindexOfPosToBeKept.push_back(posI);
             }
+            previousPosition = position;
             hapIndex++;
         }
         indexOfPosToBeKept.push_back(tmpindexOfPosToBeKept);
@@ -101,14 +137,15 @@ void VariantIndex::findWhoToBeKeptGivenIndex(
 
     vector < vector < int > > oldposition = this->position_;
     this->position_.clear();
+    vector <bool> isGiven = flagGivenIndex(givenIndex,
+                                           countSites(oldposition));
 
     for (size_t chromI = 0; chromI < oldChrom.size(); chromI++) {
         dout << "   Going through chrom "<< oldChrom[chromI] << endl;
         size_t hapIndex = indexOfChromStarts_[chromI];
         vector <int> newTrimmedPos;
         for (size_t posI = 0; posI < oldposition[chromI].size(); posI++) {
-            if (std::find(givenIndex.begin(), givenIndex.end(), hapIndex)
-                    != givenIndex.end()) {
+            if (hapIndex < isGiven.size() && isGiven[hapIndex]) {
                 if (newTrimmedPos.size() == 0) {
                     this->chrom_.push_back(oldChrom[chromI]);
                 }
@@ -138,6 +175,8 @@ void VariantIndex::findWhoToBeKeptGivenIndexHalf(
 
     vector < vector < int > > oldposition = this->position_;
     this->position_.clear();
+    vector <bool> isGiven = flagGivenIndex(givenIndex,
+                                           countSites(oldposition));
 
     for (size_t chromI = 0; chromI < oldChrom.size(); chromI++) {
         // if (chromI%2 == 0) {
@@ -146,8 +185,7 @@ void VariantIndex::findWhoToBeKeptGivenIndexHalf(
             size_t hapIndex = indexOfChromStarts_[chromI];
             vector <int> newTrimmedPos;
             for (size_t posI = 0; posI < oldposition[chromI].size(); posI++) {
-                if (std::find(givenIndex.begin(), givenIndex.end(), hapIndex)
-                        != givenIndex.end()) {
+                if (hapIndex < isGiven.size() && isGiven[hapIndex]) {
                     if (newTrimmedPos.size() == 0) {
                         this->chrom_.push_back(oldChrom[chromI]);
                     }
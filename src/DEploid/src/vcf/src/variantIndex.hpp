@@ -43,10 +43,12 @@ class VariantIndex {
     friend class TestPanel;
     friend class TestTxtReader;
     friend class TestInitialHaplotypes;
+    friend class TestVariantIndex;
     #endif
     friend class DEploidIO;
     friend class TxtReader;
     friend class ExcludeMarker;
+    friend class AlignedTxtReader;
     friend class Panel;
     friend class IBDrecombProbs;
     friend class VcfReader;
@@ -23,25 +23,41 @@
  *
  */
 
-#include <algorithm>     // std::min
+#include <algorithm>     // std::min, std::count
 #include <cassert>       // assert
+#include <charconv>      // std::from_chars
 #include <iostream>      // std::cout
+#include <utility>       // std::pair
 #include "vcfReader.hpp"
+#include "txtReader.hpp"
 #include "global.hpp"
 
 // using namespace std;
 using std::min;
 
+static void extractAdCounts(std::string_view field, int adFieldIndex,
+                            int &ref, int &alt);
+
 /*! Initialize vcf file, search for the end of the vcf header.
  *  Extract the first block of data ( "buffer_length" lines ) into buff
  */
-VcfReader::VcfReader(string fileName, string sampleName, bool extractPlaf) {
+VcfReader::VcfReader(string fileName, string sampleName, bool extractPlaf,
+    size_t nThreads, const VcfReadFilter &filter,
+    const vector <string> * batchSamples) {
     /*! Initialize by read in the vcf header file */
+    this->nThreads_ = nThreads;
+    this->doBatch_ = (batchSamples != NULL);
+    this->filter_ = filter;
+    this->foundLegitVqslod_ = false;
+    this->legitVqslodThreshold_ = 0.0;
     this->init(fileName);
     this->sampleName_ = sampleName;
     this->extractPlaf_ = extractPlaf;
     this->sampleColumnIndex_ = 0;
     this->readHeader();
+    if (this->doBatch_) {
+        this->initBatchSamples(*batchSamples);
+    }
     this->readVariants();
     this->getChromList();
     this->getIndexOfChromStarts();
@@ -50,6 +66,25 @@ VcfReader::VcfReader(string fileName, string sampleName, bool extractPlaf) {
 }
 
 
+VcfReader::VcfReader(const string &fileName, const string &sampleName,
+    const vector <string> &chrom, const vector < vector <int> > &position) {
+    this->nThreads_ = 1;
+    this->doBatch_ = false;
+    this->foundLegitVqslod_ = false;
+    this->legitVqslodThreshold_ = 0.0;
+    this->fileName_ = fileName;
+    this->isCompressed_ = false;
+    this->isBgzf_ = false;
+    this->useRegionIndex_ = false;
+    this->sampleName_ = sampleName;
+    this->extractPlaf_ = false;
+    this->sampleColumnIndex_ = 0;
+    this->chrom_ = chrom;
+    this->position_ = position;
+    this->getIndexOfChromStarts();
+}
+
+
 void VcfReader::checkFileCompressed() {
     FILE *f = NULL;
     f = fopen(this->fileName_.c_str(), "rb");
@@ -73,7 +108,17 @@ void VcfReader::init(string fileName) {
 
     this->checkFileCompressed();
 
-    if ( this->isCompressed() ) {
+    // bgzipped vcfs are inflated block by block on nThreads_ threads, other
+    // gzipped files go through igzstream
+    this->useRegionIndex_ = this->isCompressed() &&
+        this->filter_.regions.size() > 0 &&
+        this->inFileRegions.open(this->fileName_, this->filter_.regions,
+                                 this->nThreads_);
+    this->isBgzf_ = this->useRegionIndex_ || (this->isCompressed() &&
+                    this->inFileBgzf.open(this->fileName_, this->nThreads_));
+    if ( this->isBgzf_ ) {
+        return;
+    } else if ( this->isCompressed() ) {
         this->inFileGz.open(this->fileName_.c_str(), std::ios::in);
     } else {
         this->inFile.open(this->fileName_.c_str(), std::ios::in);
@@ -81,15 +126,39 @@ void VcfReader::init(string fileName) {
 }
 
 
-void VcfReader::finalize() {
-    for (size_t i = 0; i < this->variants.size(); i++) {
-        this->refCount.push_back(static_cast<double>(this->variants[i].ref));
-        this->altCount.push_back(static_cast<double>(this->variants[i].alt));
-        this->vqslod.push_back(this->variants[i].vqslod);
-        this->plaf.push_back(this->variants[i].plaf);
+void VcfReader::readLine() {
+    if (this->useRegionIndex_) {
+        this->inFileRegions.getline(this->tmpLine_);
+    } else if (this->isBgzf_) {
+        this->inFileBgzf.getline(this->tmpLine_);
+    } else if (this->isCompressed()) {
+        // getline leaves the line as it was when nothing is left to read
+        if (!getline(inFileGz, this->tmpLine_)) {
+            this->tmpLine_.clear();
+        }
+    } else {
+        if (!getline(inFile, this->tmpLine_)) {
+            this->tmpLine_.clear();
+        }
     }
+}
 
-    if ( this->isCompressed() ) {
+
+void VcfReader::finalize() {
+    this->refCount.insert(this->refCount.end(), this->variants.ref.begin(),
+                          this->variants.ref.end());
+    this->altCount.insert(this->altCount.end(), this->variants.alt.begin(),
+                          this->variants.alt.end());
+    this->vqslod.insert(this->vqslod.end(), this->variants.vqslod.begin(),
+                        this->variants.vqslod.end());
+    this->plaf.insert(this->plaf.end(), this->variants.plaf.begin(),
+                      this->variants.plaf.end());
+
+    if ( this->useRegionIndex_ ) {
+        this->inFileRegions.close();
+    } else if ( this->isBgzf_ ) {
+        this->inFileBgzf.close();
+    } else if ( this->isCompressed() ) {
         this->inFileGz.close();
     } else {
         this->inFile.close();
@@ -98,7 +167,9 @@ void VcfReader::finalize() {
 
 
 void VcfReader::readHeader() {
-    if (this->isCompressed()) {
+    if (this->isBgzf_) {
+        // open() has already checked the file
+    } else if (this->isCompressed()) {
         if (!inFileGz.good()) {
             throw InvalidInputFile(this->fileName_);
         }
@@ -108,21 +179,13 @@ void VcfReader::readHeader() {
         }
     }
 
-    if (this->isCompressed()) {
-        getline(inFileGz, this->tmpLine_);
-    } else {
-        getline(inFile, this->tmpLine_);
-    }
+    this->readLine();
 
     while (this->tmpLine_.size() > 0) {
         if (this->tmpLine_[0] == '#') {
             if (this->tmpLine_[1] == '#') {
                 this->headerLines.push_back(this->tmpLine_);
-                if (this->isCompressed()) {
-                    getline(inFileGz, this->tmpLine_);
-                } else {
-                    getline(inFile, this->tmpLine_);
-                }
+                this->readLine();
             } else {
                 this->checkFeilds();
                 break;  // end of the header
@@ -168,9 +231,15 @@ void VcfReader::checkFeilds() {
             this->sampleName_ = this->tmpStr_;
         }
 
-        if (this->tmpStr_ == this->sampleName_) {
+        if (this->doBatch_ && field_index >= 9) {
+            this->headerSampleNames_.push_back(this->tmpStr_);
+        }
+
+        if (sampleColumnIndex_ == 0 && this->tmpStr_ == this->sampleName_) {
             sampleColumnIndex_ = field_index;
-            break;
+            if (!this->doBatch_) {
+                break;
+            }
         }
 
         feild_start = field_end+1;
@@ -185,68 +254,203 @@ void VcfReader::checkFeilds() {
 }
 
 
-void VcfReader::readVariants() {
-    if (this->isCompressed()) {
-        getline(inFileGz, this->tmpLine_);
-    } else {
-        getline(inFile, this->tmpLine_);
-    }
-    while (inFile.good() && this->tmpLine_.size() > 0) {
-        VariantLine newVariant(this->tmpLine_, this->sampleColumnIndex_,
-            this->extractPlaf_);
-        // check variantLine quality
-        this->variants.push_back(newVariant);
-        if (this->isCompressed()) {
-            getline(inFileGz, this->tmpLine_);
-        } else {
-            getline(inFile, this->tmpLine_);
+void VcfReader::initBatchSamples(const vector <string> &batchSamples) {
+    this->batchSampleNames_ = batchSamples.empty() ? this->headerSampleNames_
+                                                   : batchSamples;
+    vector < std::pair <size_t, size_t> > columns;
+    for (size_t sampleI = 0; sampleI < this->batchSampleNames_.size();
+         sampleI++) {
+        vector <string>::const_iterator found = std::find(
+            this->headerSampleNames_.begin(), this->headerSampleNames_.end(),
+            this->batchSampleNames_[sampleI]);
+        if (found == this->headerSampleNames_.end()) {
+            throw InvalidSampleInVcf(this->batchSampleNames_[sampleI],
+                                     this->fileName_);
         }
+        columns.push_back(std::make_pair(
+            9 + (found - this->headerSampleNames_.begin()), sampleI));
+    }
+    std::sort(columns.begin(), columns.end());
+
+    this->batchColumnIndex_.clear();
+    this->batchSampleAtColumn_.clear();
+    for (auto const& column : columns) {
+        this->batchColumnIndex_.push_back(column.first);
+        this->batchSampleAtColumn_.push_back(column.second);
     }
+    this->batchRef_ = vector <int> (this->batchSampleNames_.size(), 0);
+    this->batchAlt_ = vector <int> (this->batchSampleNames_.size(), 0);
+    this->variants.batchRef.resize(this->batchSampleNames_.size());
+    this->variants.batchAlt.resize(this->batchSampleNames_.size());
 }
 
 
-void VcfReader::getChromList() {
-    this->chrom_.clear();
-    this->position_.clear();
+// The sample columns are walked once, and the counts of the batch samples
+// parsed on the way
+void VcfReader::extractBatchCounts(std::string_view line) {
+    size_t columnI = 0;
+    size_t fieldStart = 0;
+    size_t fieldIndex = 0;
+    while (columnI < this->batchColumnIndex_.size()) {
+        size_t fieldEnd = min(line.find('	', fieldStart), line.size());
+        while (columnI < this->batchColumnIndex_.size() &&
+               this->batchColumnIndex_[columnI] == fieldIndex) {
+            size_t sampleI = this->batchSampleAtColumn_[columnI];
+            extractAdCounts(line.substr(fieldStart, fieldEnd - fieldStart),
+                            this->tmpVariant_.adFieldIndex_,
+                            this->batchRef_[sampleI],
+                            this->batchAlt_[sampleI]);
+            columnI++;
+        }
+        if (fieldEnd == line.size()) {
+            break;
+        }
+        fieldStart = fieldEnd + 1;
+        fieldIndex++;
+    }
+    this->variants.pushBatchCounts(this->batchRef_, this->batchAlt_);
+}
 
-    assert(this->chrom_.size() == (size_t)0);
-    assert(this->position_.size() == (size_t)0);
 
+void VcfReader::batchCounts(size_t batchSampleI, vector <double> &refCount,
+                            vector <double> &altCount) const {
+    refCount.assign(this->variants.batchRef[batchSampleI].begin(),
+                    this->variants.batchRef[batchSampleI].end());
+    altCount.assign(this->variants.batchAlt[batchSampleI].begin(),
+                    this->variants.batchAlt[batchSampleI].end());
+}
+
+
+void VcfReader::readVariants() {
+    const vector <ExcludedInterval> * excludedIntervals = NULL;
+    size_t recordIndex = 0;
     string previousChrom("");
-    vector <int> positionOfChrom_;
-
-    for (size_t i = 0; i < this->variants.size() ; i++) {
-        if (previousChrom != this->variants[i].chromStr &&
-            previousChrom.size() > (size_t)0) {
-            this->chrom_.push_back(previousChrom);
-            this->position_.push_back(positionOfChrom_);
-            positionOfChrom_.clear();
+    this->chrom_.clear();
+    this->chromEnds_.clear();
+    this->legitVqslodAt.clear();
+
+    this->readVariantLine();
+    while (this->tmpLine_.size() > 0) {
+        std::string_view line(this->tmpLine_);
+        std::string_view chrom = line.substr(0, line.find('\t'));
+        // Chromosomes are listed from every line, so that those with all
+        // their sites excluded are kept, as findAndKeepMarkers does
+        if (previousChrom != chrom) {
+            if (previousChrom.size() > (size_t)0) {
+                this->chrom_.push_back(previousChrom);
+                this->chromEnds_.push_back(this->variants.size());
+            }
+            previousChrom.assign(chrom.data(), chrom.size());
+            excludedIntervals = this->findExcludedIntervals(chrom);
+        }
+
+        if (!this->isExcluded(line, excludedIntervals)) {
+            this->tmpVariant_.init(line, this->sampleColumnIndex_,
+                this->extractPlaf_, &this->formatCache_);
+            // check variantLine quality
+            if (this->filter_.findLegitVqslod &&
+                this->tmpVariant_.vqslod > this->filter_.vqslodThreshold) {
+                this->legitVqslodAt.push_back(this->variants.size());
+            }
+            this->variants.push_back(this->tmpVariant_, recordIndex);
+            if (this->doBatch_) {
+                this->extractBatchCounts(line);
+            }
         }
-        positionOfChrom_.push_back(
-            stoi(this->variants[i].posStr.c_str(), NULL));
-        previousChrom = this->variants[i].chromStr;
+        recordIndex++;
+        this->readVariantLine();
+    }
+    if (this->filter_.regions.size() > 0 && this->variants.size() == 0) {
+        throw NoSitesInRegions(this->fileName_);
     }
 
     this->chrom_.push_back(previousChrom);
-    this->position_.push_back(positionOfChrom_);
+    this->chromEnds_.push_back(this->variants.size());
+    this->foundLegitVqslod_ = this->filter_.findLegitVqslod;
+    this->legitVqslodThreshold_ = this->filter_.vqslodThreshold;
+}
+
+
+void VcfReader::readVariantLine() {
+    if (this->useRegionIndex_) {
+        this->inFileRegions.getlineInRegions(this->tmpLine_);
+        return;
+    }
+    this->readLine();
+    while (this->filter_.regions.size() > 0 && this->tmpLine_.size() > 0 &&
+           !lineInRegions(this->filter_.regions, this->tmpLine_)) {
+        this->readLine();
+    }
+}
+
+
+const vector <ExcludedInterval> * VcfReader::findExcludedIntervals(
+    std::string_view chrom) const {
+    if (this->filter_.excludedMarkers == NULL) {
+        return NULL;
+    }
+    return this->filter_.excludedMarkers->findIntervals(chrom);
+}
+
+
+// Positions that do not parse are kept, and reported by getChromList
+bool VcfReader::isExcluded(std::string_view line,
+    const vector <ExcludedInterval> * excludedIntervals) const {
+    if (excludedIntervals == NULL) {
+        return false;
+    }
+    size_t posStart = line.find('\t');
+    if (posStart == std::string_view::npos) {
+        return false;
+    }
+    posStart++;
+    std::string_view posStr = line.substr(posStart,
+                                          line.find('\t', posStart) - posStart);
+    int pos;
+    std::from_chars_result res = std::from_chars(
+        posStr.data(), posStr.data() + posStr.size(), pos);
+    if (res.ec != std::errc() || res.ptr != posStr.data() + posStr.size()) {
+        try {
+            pos = stoi(string(posStr), NULL);
+        } catch (const std::exception &e) {
+            return false;
+        }
+    }
+    return ExcludeMarker::isExcluded(*excludedIntervals, pos);
+}
+
+
+void VcfReader::getChromList() {
+    this->position_.clear();
+    assert(this->position_.size() == (size_t)0);
+    assert(this->chromEnds_.size() == this->chrom_.size());
+
+    size_t siteI = 0;
+    for (size_t chromI = 0; chromI < this->chrom_.size(); chromI++) {
+        vector <int> positionOfChrom_;
+        for (; siteI < this->chromEnds_[chromI]; siteI++) {
+            positionOfChrom_.push_back(
+                stoi(string(this->variants.pos(siteI)), NULL));
+        }
+        this->position_.push_back(positionOfChrom_);
+    }
     assert(this->position_.size() == this->chrom_.size());
 }
 
 
 void VcfReader::removeMarkers() {
-    assert(this->keptVariants.size() == (size_t)0);
-    for (auto const &value : this->indexOfContentToBeKept) {
-        this->keptVariants.push_back(this->variants[value]);
-    }
-    this->variants.clear();
-    this->variants = this->keptVariants;
-    this->keptVariants.clear();
+    this->variants.keepSites(this->indexOfContentToBeKept);
+    this->foundLegitVqslod_ = false;
     this->nLoci_ = this->variants.size();
     dout << " Vcf number of loci kept = " << this->nLoci_ << std::endl;
 }
 
 
 void VcfReader::findLegitSnpsGivenVQSLOD(double vqslodThreshold) {
+    if (this->foundLegitVqslod_ &&
+        this->legitVqslodThreshold_ == vqslodThreshold) {
+        return;  // already found while reading the variants
+    }
     this->legitVqslodAt.clear();
     assert(legitVqslodAt.size() == 0);
     for (size_t i = 0; i < this->vqslod.size(); i++) {
@@ -254,10 +458,13 @@ void VcfReader::findLegitSnpsGivenVQSLOD(double vqslodThreshold) {
             this->legitVqslodAt.push_back(i);
         }
     }
+    this->foundLegitVqslod_ = true;
+    this->legitVqslodThreshold_ = vqslodThreshold;
 }
 
 
 void VcfReader::findLegitSnpsGivenVQSLODHalf(double vqslodThreshold) {
+    this->foundLegitVqslod_ = false;
     this->legitVqslodAt.clear();
     assert(legitVqslodAt.size() == 0);
 
@@ -278,131 +485,205 @@ void VcfReader::findLegitSnpsGivenVQSLODHalf(double vqslodThreshold) {
 }
 
 
-VariantLine::VariantLine(string tmpLine, size_t sampleColumnIndex,
-    bool extractPlaf) {
-    this->init(tmpLine, sampleColumnIndex, extractPlaf);
-
-    while (fieldEnd_ < this->tmpLine_.size()) {
-        fieldEnd_ = min(this->tmpLine_.find('\t', feildStart_),
-                        this->tmpLine_.find('\n', feildStart_));
-        this->tmpStr_ = this->tmpLine_.substr(feildStart_,
-                                              fieldEnd_-feildStart_);
-        switch (fieldIndex_) {
-            case 0: this->extract_field_CHROM();   break;
-            case 1: this->extract_field_POS();    break;
-            case 2: this->extract_field_ID();     break;
-            case 3: this->extract_field_REF() ;   break;
-            case 4: this->extract_field_ALT() ;   break;
-            case 5: this->extract_field_QUAL() ;   break;
-            case 6: this->extract_field_FILTER();  break;
-            case 7: this->extract_field_INFO();    break;
-            case 8: this->extract_field_FORMAT();  break;
-        }
-
-        if (fieldIndex_ == this->sampleColumnIndex_) {
-            this->extract_field_VARIANT();
-            break;
+void VariantColumns::push_back(const VariantLine &variant,
+                               size_t recordIndex) {
+    this->recordIndex.push_back(recordIndex);
+    this->ref.push_back(variant.ref);
+    this->alt.push_back(variant.alt);
+    this->vqslod.push_back(variant.vqslod);
+    this->plaf.push_back(variant.plaf);
+
+    this->fixedFieldsStart_.push_back(this->fixedFields_.size());
+    const string * fields[] = {&variant.chromStr, &variant.posStr,
+                               &variant.idStr, &variant.refStr,
+                               &variant.altStr, &variant.qualStr,
+                               &variant.filterStr, &variant.infoStr};
+    for (size_t i = 0; i < 8; i++) {
+        if (i > 0) {
+            this->fixedFields_ += '\t';
         }
-        feildStart_ = fieldEnd_+1;
-        fieldIndex_++;
+        this->fixedFields_ += *fields[i];
     }
+    this->fixedFieldsEnd_.push_back(this->fixedFields_.size());
 }
 
 
-void VariantLine::init(string tmpLine, size_t sampleColumnIndex,
-    bool extractPlaf) {
-    this->tmpLine_ = tmpLine;
-    this->feildStart_ = 0;
-    this->fieldEnd_ = 0;
-    this->fieldIndex_  = 0;
-    this->adFieldIndex_ = -1;
-    this->sampleColumnIndex_ = sampleColumnIndex;
-    this->extractPlaf_ = extractPlaf;
+void VariantColumns::pushBatchCounts(const vector <int> &ref,
+                                     const vector <int> &alt) {
+    for (size_t sampleI = 0; sampleI < ref.size(); sampleI++) {
+        this->batchRef[sampleI].push_back(ref[sampleI]);
+        this->batchAlt[sampleI].push_back(alt[sampleI]);
+    }
 }
 
 
-void VariantLine::extract_field_CHROM() {
-    this->chromStr = this->tmpStr_;
+void VariantColumns::keepSites(const vector <size_t> &index) {
+    for (size_t i = 0; i < index.size(); i++) {
+        assert(index[i] >= i && index[i] < this->size());
+        this->recordIndex[i] = this->recordIndex[index[i]];
+        this->ref[i] = this->ref[index[i]];
+        this->alt[i] = this->alt[index[i]];
+        this->vqslod[i] = this->vqslod[index[i]];
+        this->plaf[i] = this->plaf[index[i]];
+        this->fixedFieldsStart_[i] = this->fixedFieldsStart_[index[i]];
+        this->fixedFieldsEnd_[i] = this->fixedFieldsEnd_[index[i]];
+        for (size_t sampleI = 0; sampleI < this->batchRef.size(); sampleI++) {
+            this->batchRef[sampleI][i] = this->batchRef[sampleI][index[i]];
+            this->batchAlt[sampleI][i] = this->batchAlt[sampleI][index[i]];
+        }
+    }
+    this->recordIndex.resize(index.size());
+    this->ref.resize(index.size());
+    this->alt.resize(index.size());
+    this->vqslod.resize(index.size());
+    this->plaf.resize(index.size());
+    this->fixedFieldsStart_.resize(index.size());
+    this->fixedFieldsEnd_.resize(index.size());
+    for (size_t sampleI = 0; sampleI < this->batchRef.size(); sampleI++) {
+        this->batchRef[sampleI].resize(index.size());
+        this->batchAlt[sampleI].resize(index.size());
+    }
 }
 
 
-void VariantLine::extract_field_POS() {
-    this->posStr = this->tmpStr_;
+std::string_view VariantColumns::fixedFields(size_t siteI) const {
+    return std::string_view(this->fixedFields_).substr(
+        this->fixedFieldsStart_[siteI],
+        this->fixedFieldsEnd_[siteI] - this->fixedFieldsStart_[siteI]);
 }
 
 
-void VariantLine::extract_field_ID() {
-    this->idStr = this->tmpStr_;
+std::string_view VariantColumns::chrom(size_t siteI) const {
+    std::string_view fields = this->fixedFields(siteI);
+    return fields.substr(0, fields.find('\t'));
 }
 
 
-void VariantLine::extract_field_REF() {
-    this->refStr = this->tmpStr_;
+std::string_view VariantColumns::pos(size_t siteI) const {
+    std::string_view fields = this->fixedFields(siteI);
+    size_t posStart = fields.find('\t') + 1;
+    return fields.substr(posStart, fields.find('\t', posStart) - posStart);
 }
 
 
-void VariantLine::extract_field_ALT() {
-    this->altStr = this->tmpStr_;
+VariantLine::VariantLine(string tmpLine, size_t sampleColumnIndex,
+    bool extractPlaf) {
+    this->init(std::string_view(tmpLine), sampleColumnIndex, extractPlaf,
+               NULL);
 }
 
 
-void VariantLine::extract_field_QUAL() {  // Check for PASS
-    this->qualStr = this->tmpStr_;
+VariantLine::VariantLine(std::string_view line, size_t sampleColumnIndex,
+    bool extractPlaf, VcfFormatCache * formatCache) {
+    this->init(line, sampleColumnIndex, extractPlaf, formatCache);
 }
 
 
-void VariantLine::extract_field_FILTER() {
-    this->filterStr = this->tmpStr_;
-}
+void VariantLine::init(std::string_view line, size_t sampleColumnIndex,
+    bool extractPlaf, VcfFormatCache * formatCache) {
+    this->adFieldIndex_ = -1;
+    this->sampleColumnIndex_ = sampleColumnIndex;
+    this->extractPlaf_ = extractPlaf;
 
-void VariantLine::extract_field_INFO() {
-    this->infoStr = this->tmpStr_;
-    bool vqslodNotFound = true;
-    size_t feild_start = 0;
-    size_t field_end = 0;
-    int field_index = 0;
+    // Fields are views into the line, only the ones kept are copied
+    size_t feildStart = 0;
+    size_t fieldEnd = 0;
+    size_t fieldIndex = 0;
+    while (fieldEnd < line.size()) {
+        fieldEnd = min(line.find('\t', feildStart), line.size());
+        std::string_view field = line.substr(feildStart,
+                                             fieldEnd - feildStart);
+        switch (fieldIndex) {
+            case 0: this->chromStr.assign(field.data(), field.size()); break;
+            case 1: this->posStr.assign(field.data(), field.size());   break;
+            case 2: this->idStr.assign(field.data(), field.size());    break;
+            case 3: this->refStr.assign(field.data(), field.size());   break;
+            case 4: this->altStr.assign(field.data(), field.size());   break;
+            case 5: this->qualStr.assign(field.data(), field.size());  break;
+            case 6: this->filterStr.assign(field.data(), field.size()); break;
+            case 7: this->extract_field_INFO(field);    break;
+            case 8: this->extract_field_FORMAT(field, formatCache);  break;
+        }
 
-    while (field_end < this->tmpStr_.size()) {
-        field_end = min(this->tmpStr_.find(';', feild_start),
-                        this->tmpStr_.find('\t', feild_start));
-        string filterFiledStr = this->tmpStr_.substr(feild_start,
-                                                     field_end-feild_start);
-        size_t eqIndex = filterFiledStr.find('=', 0);
-        string filterFiledName = filterFiledStr.substr(0, eqIndex);
-        if ( "VQSLOD" == filterFiledName ) {
-            vqslodNotFound = false;
-            vqslod = stod(filterFiledStr.substr(eqIndex+1,
-                                                filterFiledStr.size()));
+        if (fieldIndex == this->sampleColumnIndex_) {
+            this->extract_field_VARIANT(field);
+            break;
         }
+        feildStart = fieldEnd+1;
+        fieldIndex++;
+    }
+}
 
-        if ( ("AF" == filterFiledName) & (this->extractPlaf_) ) {
-            plaf = stod(filterFiledStr.substr(eqIndex+1,
-                                                filterFiledStr.size()));
+
+// Value of the last INFO entry named key. An entry without '=' is returned
+// whole, as the entry itself was parsed before.
+static bool findInfoValue(std::string_view info, std::string_view key,
+                          std::string_view &value) {
+    bool found = false;
+    for (size_t pos = info.find(key); pos != std::string_view::npos;
+         pos = info.find(key, pos + 1)) {
+        size_t nameEnd = pos + key.size();
+        if ( (pos > 0 && info[pos-1] != ';') ||
+             (nameEnd < info.size() && info[nameEnd] != '=' &&
+              info[nameEnd] != ';') ) {
+            continue;
+        }
+        size_t entryEnd = min(info.find(';', nameEnd), info.size());
+        if (nameEnd < info.size() && info[nameEnd] == '=') {
+            value = info.substr(nameEnd + 1, entryEnd - nameEnd - 1);
+        } else {
+            value = info.substr(pos, entryEnd - pos);
         }
+        found = true;
+    }
+    return found;
+}
 
-        feild_start = field_end+1;
-        field_index++;
+
+// Same value, or exception, as stod
+static double parseInfoDouble(std::string_view value) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    double ret;
+    std::from_chars_result res = std::from_chars(
+        value.data(), value.data() + value.size(), ret);
+    if (res.ec == std::errc() && res.ptr == value.data() + value.size()) {
+        return ret;
     }
+#endif
+    return stod(string(value));
+}
+
 
-    if (vqslodNotFound) {
-        throw VcfVQSLODNotFound(this->tmpStr_);
+void VariantLine::extract_field_INFO(std::string_view field) {
+    this->infoStr.assign(field.data(), field.size());
+    std::string_view value;
+    if (!findInfoValue(field, "VQSLOD", value)) {
+        throw VcfVQSLODNotFound(this->infoStr);
     }
+    vqslod = parseInfoDouble(value);
 
-    assert(vqslodNotFound == false);
+    if ( this->extractPlaf_ && findInfoValue(field, "AF", value) ) {
+        plaf = parseInfoDouble(value);
+    }
 }
 
 
-void VariantLine::extract_field_FORMAT() {
-    this->formatStr = this->tmpStr_;
+void VariantLine::extract_field_FORMAT(std::string_view field,
+                                       VcfFormatCache * formatCache) {
+    this->formatStr.assign(field.data(), field.size());
+    if (formatCache != NULL && formatCache->adFieldIndex > -1 &&
+        formatCache->formatStr == field) {
+        adFieldIndex_ = formatCache->adFieldIndex;
+        return;
+    }
+
     size_t feild_start = 0;
     size_t field_end = 0;
     size_t field_index = 0;
 
-    while (field_end < this->formatStr.size()) {
-        field_end = min(this->formatStr.find(':', feild_start),
-                        this->formatStr.find('\n', feild_start));
-        if ( "AD" == this->formatStr.substr(feild_start,
-                                            field_end-feild_start)) {
+    while (field_end < field.size()) {
+        field_end = min(field.find(':', feild_start), field.size());
+        if ( "AD" == field.substr(feild_start, field_end-feild_start) ) {
             adFieldIndex_ = field_index;
             break;
         }
@@ -410,9 +691,14 @@ void VariantLine::extract_field_FORMAT() {
         field_index++;
     }
     if (adFieldIndex_ == -1) {
-        throw VcfCoverageFieldNotFound(this->tmpStr_);
+        throw VcfCoverageFieldNotFound(this->formatStr);
     }
     assert(adFieldIndex_ > -1);
+
+    if (formatCache != NULL) {
+        formatCache->formatStr = this->formatStr;
+        formatCache->adFieldIndex = adFieldIndex_;
+    }
 }
 
 
@@ -423,27 +709,34 @@ int maybe_dot_to_integer(const string& s) {
         return stoi(s);
 }
 
-int n_fields(const string& s, char delim = ',') {
-    int count = 0;
-    for (auto ch : s)
-        if (ch == delim)
-            count++;
-    return count+1;
+
+// Same value, or exception, as maybe_dot_to_integer
+static int parseAdCount(std::string_view s) {
+    int value;
+    std::from_chars_result res = std::from_chars(s.data(),
+                                                 s.data() + s.size(), value);
+    if (res.ec == std::errc() && res.ptr == s.data() + s.size()) {
+        return value;
+    }
+    return maybe_dot_to_integer(string(s));
 }
 
-void VariantLine::extract_field_VARIANT() {
+
+// Reads the AD entry of a sample field into ref and alt, which are left
+// untouched if the field has no AD entry
+static void extractAdCounts(std::string_view field, int adFieldIndex,
+                            int &ref, int &alt) {
     size_t feild_start = 0;
     size_t field_end = 0;
     int field_index = 0;
 
-    while (field_end < this->tmpStr_.size()) {
-        field_end = min(this->tmpStr_.find(':', feild_start),
-                        this->tmpStr_.find('\n', feild_start));
-        if (field_index == adFieldIndex_) {
-            string adStr = this->tmpStr_.substr(feild_start,
-                                                field_end-feild_start);
+    while (field_end < field.size()) {
+        field_end = min(field.find(':', feild_start), field.size());
+        if (field_index == adFieldIndex) {
+            std::string_view adStr = field.substr(feild_start,
+                                                  field_end-feild_start);
             try {
-                int n = n_fields(adStr);
+                int n = std::count(adStr.begin(), adStr.end(), ',') + 1;
                 if (n != 2)
                     throw std::runtime_error(
                         "there should be exactly 2 AD entries, but found " +
@@ -451,17 +744,14 @@ void VariantLine::extract_field_VARIANT() {
                         ".\n   Wrong number of ALT alleles!.");
 
                 size_t commaIndex = adStr.find(',', 0);
-                auto ref_AD = adStr.substr(0, commaIndex);
-                auto alt_AD = adStr.substr(commaIndex+1, adStr.size());
-
-                ref = maybe_dot_to_integer(ref_AD);
-                alt = maybe_dot_to_integer(alt_AD);
+                ref = parseAdCount(adStr.substr(0, commaIndex));
+                alt = parseAdCount(adStr.substr(commaIndex+1));
                 break;
             }
             catch (const std::exception& e) {
               throw std::runtime_error(
                   "Error parsing vcf AD field: '" +
-                    adStr + "':  " + e.what() + "\n");
+                    string(adStr) + "':  " + e.what() + "\n");
             }
         }
         feild_start = field_end+1;
@@ -469,6 +759,12 @@ void VariantLine::extract_field_VARIANT() {
     }
 }
 
+
+void VariantLine::extract_field_VARIANT(std::string_view field) {
+    extractAdCounts(field, this->adFieldIndex_, this->ref, this->alt);
+}
+
+
 /*
 void VcfReader::findLegitSnpsGivenVQSLODandWsfGt0(double vqslodThreshold) {
     assert(legitVqslodAt.size() == 0);
@@ -25,11 +25,15 @@
 
 #include <stdlib.h>     /* strtol, strtod */
 #include <string>  /* string */
+#include <string_view>
 #include <vector>  /* vector */
 #include <fstream>
 #include "exceptions.hpp"
 #include "variantIndex.hpp"
+#include "txtReader.hpp"
 #include "gzstream/gzstream.h"
+#include "bgzfReader.hpp"
+#include "regionReader.hpp"
 
 #ifndef DEPLOID_SRC_VCFREADER_HPP_
 #define DEPLOID_SRC_VCFREADER_HPP_
@@ -84,34 +88,48 @@ struct VcfVQSLODNotFound : public VcfInvalidVariantEntry{
 };
 
 
+// Where AD sits in the last FORMAT seen; FORMAT is usually the same on every
+// line, so it is only parsed when it changes.
+struct VcfFormatCache {
+    string formatStr;
+    int adFieldIndex;
+    VcfFormatCache() : adFieldIndex(-1) {}
+};
+
+
+// Filters applied while the variant lines are read. Excluded sites, and
+// sites outside the regions if any are given, are never stored;
+// legitVqslodAt is filled on the way when findLegitVqslod is set.
+struct VcfReadFilter {
+    ExcludeMarker * excludedMarkers;
+    vector <GenomicRegion> regions;
+    bool findLegitVqslod;
+    double vqslodThreshold;
+    VcfReadFilter() : excludedMarkers(NULL), findLegitVqslod(false),
+                      vqslodThreshold(0.0) {}
+};
+
+
 class VariantLine{
   friend class VcfReader;
+  friend class VariantColumns;
   friend class DEploidIO;
  public:
+    VariantLine() {}
     explicit VariantLine(string tmpLine, size_t sampleColumnIndex,
         bool extractPlaf = false);
+    VariantLine(std::string_view line, size_t sampleColumnIndex,
+        bool extractPlaf, VcfFormatCache * formatCache);
     ~VariantLine() {}
 
  private:
-    string tmpLine_;
-    string tmpStr_;
-
-    void init(string tmpLine, size_t sampleColumnIndex, bool extractPlaf);
+    void init(std::string_view line, size_t sampleColumnIndex,
+        bool extractPlaf, VcfFormatCache * formatCache);
 
-    void extract_field_CHROM();
-    void extract_field_POS();
-    void extract_field_ID();
-    void extract_field_REF();
-    void extract_field_ALT();
-    void extract_field_QUAL();
-    void extract_field_FILTER();
-    void extract_field_INFO();
-    void extract_field_FORMAT();
-    void extract_field_VARIANT();
-
-    size_t feildStart_;
-    size_t fieldEnd_;
-    size_t fieldIndex_;
+    void extract_field_INFO(std::string_view field);
+    void extract_field_FORMAT(std::string_view field,
+                              VcfFormatCache * formatCache);
+    void extract_field_VARIANT(std::string_view field);
 
     string chromStr;
     string posStr;
@@ -133,6 +151,49 @@ class VariantLine{
 };
 
 
+/*! \brief Variants of a VCF file, stored column by column
+ *
+ * Counts, VQSLOD and AF are numeric columns. CHROM to INFO are only needed to
+ * write the vcf output, and are kept tab-joined in a single string arena.
+ * Removing sites compacts the columns and the arena offsets in place.
+ */
+class VariantColumns {
+#ifdef UNITTEST
+  friend class TestVCF;
+#endif
+  friend class VcfReader;
+  friend class DEploidIO;
+ public:
+    VariantColumns() {}
+    ~VariantColumns() {}
+
+    size_t size() const { return this->fixedFieldsStart_.size(); }
+    void push_back(const VariantLine &variant, size_t recordIndex);
+    void pushBatchCounts(const vector <int> &ref, const vector <int> &alt);
+    // index must be sorted
+    void keepSites(const vector <size_t> &index);
+
+    // CHROM, POS, ID, REF, ALT, QUAL, FILTER and INFO, tab separated
+    std::string_view fixedFields(size_t siteI) const;
+    std::string_view chrom(size_t siteI) const;
+    std::string_view pos(size_t siteI) const;
+
+ private:
+    vector <int> ref;
+    vector <int> alt;
+    // Counts of each sample of a batch, sample by sample
+    vector < vector <int> > batchRef;
+    vector < vector <int> > batchAlt;
+    vector <double> vqslod;
+    vector <double> plaf;
+    // Index of the site among the variant lines read, before any site was
+    // excluded
+    vector <size_t> recordIndex;
+    string fixedFields_;
+    vector <size_t> fixedFieldsStart_;
+    vector <size_t> fixedFieldsEnd_;
+};
+
 
 /*! \brief VCF file reader @ingroup group_data */
 class VcfReader : public VariantIndex {
@@ -142,8 +203,12 @@ class VcfReader : public VariantIndex {
   friend class DEploidIO;
  public:
     // Constructors and Destructors
+    // With batchSamples, the counts of these samples are also read, or of
+    // every sample of the vcf if the list is empty
     explicit VcfReader(string fileName, string sampleName,
-        bool extractPlaf = false);
+        bool extractPlaf = false, size_t nThreads = 1,
+        const VcfReadFilter &filter = VcfReadFilter(),
+        const vector <string> * batchSamples = NULL);
     // parse in exclude sites
     ~VcfReader() {}
 
@@ -155,13 +220,34 @@ class VcfReader : public VariantIndex {
     vector <double> plaf;
     void finalize();  // calling from python, need to be public
 
+    size_t nBatchSamples() const { return this->batchSampleNames_.size(); }
+    const string & batchSampleName(size_t batchSampleI) const {
+        return this->batchSampleNames_[batchSampleI]; }
+    void batchCounts(size_t batchSampleI, vector <double> &refCount,
+                     vector <double> &altCount) const;
+
  private:
-    vector <VariantLine> variants;
-    vector <VariantLine> keptVariants;
+    // Sites restored from a cache, the vcf itself is not read
+    VcfReader(const string &fileName, const string &sampleName,
+              const vector <string> &chrom,
+              const vector < vector <int> > &position);
+
+    VariantColumns variants;
     vector <size_t> legitVqslodAt;
+    bool foundLegitVqslod_;
+    double legitVqslodThreshold_;
+    VcfReadFilter filter_;
+    // Site index one past the last site of each chromosome in chrom_
+    vector <size_t> chromEnds_;
     string fileName_;
     ifstream inFile;
     igzstream inFileGz;
+    BgzfReader inFileBgzf;
+    bool isBgzf_;
+    // Indexed, bgzipped vcfs are only read over the regions
+    RegionReader inFileRegions;
+    bool useRegionIndex_;
+    size_t nThreads_;
     bool isCompressed_;
     bool isCompressed() const { return this->isCompressed_; }
     void setIsCompressed(const bool compressed) {
@@ -172,12 +258,33 @@ class VcfReader : public VariantIndex {
     string tmpLine_;
     string tmpStr_;
     bool extractPlaf_;
+    VcfFormatCache formatCache_;
+    VariantLine tmpVariant_;
+
+    // Batch related
+    bool doBatch_;
+    vector <string> headerSampleNames_;
+    vector <string> batchSampleNames_;
+    // Columns of the batch samples, in column order, and the index of the
+    // sample each column is read into
+    vector <size_t> batchColumnIndex_;
+    vector <size_t> batchSampleAtColumn_;
+    vector <int> batchRef_;
+    vector <int> batchAlt_;
 
     // Methods
     void init(string fileName);
+    void readLine();
+    void readVariantLine();
     void readVariants();
+    const vector <ExcludedInterval> * findExcludedIntervals(
+        std::string_view chrom) const;
+    bool isExcluded(std::string_view line,
+        const vector <ExcludedInterval> * excludedIntervals) const;
     void readHeader();
     void checkFeilds();
+    void initBatchSamples(const vector <string> &batchSamples);
+    void extractBatchCounts(std::string_view line);
     void findLegitSnpsGivenVQSLOD(double vqslodThreshold);
     void findLegitSnpsGivenVQSLODHalf(double vqslodThreshold);
 
@@ -0,0 +1,495 @@
+/*
+ * dEploid is used for deconvoluting Plasmodium falciparum genome from
+ * mix-infected patient sample. DEploid-vcf-lib is a submodule for
+ * reading the vcf files and reference panel.
+ *
+ * Copyright (C) 2018 University of Oxford
+ *
+ * Author: Sha (Joe) Zhu
+ *
+ * This file is part of DEploid-vcf-lib.
+ *
+ * dEploid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Compares the sites kept by VariantIndex::findWhoToBeKept and
+ * findWhoToBeKeptGivenIndex with the linear searches they replaced, over
+ * unsorted sites, overlapping excluded intervals and random inputs. Run by
+ * make check. With -benchmark N, both are timed from 10^4 sites up to N
+ * sites instead.
+ */
+
+#include <unistd.h>  // mkstemps, close, unlink
+#include <algorithm>  // find
+#include <chrono>
+#include <cstdlib>   // EXIT_SUCCESS, EXIT_FAILURE, strtoul
+#include <fstream>
+#include <iomanip>   // std::setw
+#include <iostream>  // std::cout
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "txtReader.hpp"
+#include "variantIndex.hpp"
+
+using std::endl;
+using std::string;
+using std::vector;
+
+// 0-based start and end, as in a BED line
+struct BedLine {
+    string chrom;
+    int start;
+    int end;
+};
+
+
+class TestVariantIndex {
+ public:
+    TestVariantIndex() : nFailed_(0), rg_(1) {}
+    int run();
+    int benchmark(size_t maxSites);
+
+ private:
+    size_t nFailed_;
+    std::mt19937 rg_;
+
+    void check(bool same, const string &name);
+
+    void setSites(VariantIndex &sites, const vector <string> &chrom,
+                  const vector < vector <int> > &position);
+    void compareKept(const string &name, const vector <string> &chrom,
+                     const vector < vector <int> > &position,
+                     const vector <string> &excludeChrom,
+                     const vector < vector <int> > &excludePosition);
+    void compareKeptBed(const string &name, const vector <string> &chrom,
+                        const vector < vector <int> > &position,
+                        const vector <BedLine> &bedLines);
+    void compareKeptGivenIndex(const string &name,
+                               const vector <string> &chrom,
+                               const vector < vector <int> > &position,
+                               const vector <size_t> &givenIndex);
+
+    // The implementations before the excluded intervals and flags
+    void oldFindWhoToBeKept(VariantIndex &sites,
+                            const vector <string> &excludeChrom,
+                            const vector < vector <int> > &excludePosition);
+    void oldFindWhoToBeKeptBed(VariantIndex &sites,
+                               const vector <BedLine> &bedLines);
+    void oldFindWhoToBeKeptGivenIndex(VariantIndex &sites,
+                                      const vector <size_t> &givenIndex);
+
+    vector < vector <int> > randomPositions(size_t nChrom, size_t nSites,
+                                            bool sorted);
+    void benchmarkSites(size_t nSites);
+};
+
+
+// A file name ending in suffix, removed when it goes out of scope
+class TmpFile {
+ public:
+    explicit TmpFile(const string &suffix) {
+        string pattern = "/tmp/variantIndexCheckXXXXXX" + suffix;
+        vector <char> name(pattern.begin(), pattern.end());
+        name.push_back('\0');
+        int fd = mkstemps(name.data(), suffix.size());
+        if (fd < 0) {
+            throw InvalidInputFile(pattern);
+        }
+        close(fd);
+        this->name_ = string(name.data());
+    }
+    ~TmpFile() { unlink(this->name_.c_str()); }
+    const string & name() const { return this->name_; }
+
+ private:
+    string name_;
+};
+
+
+void TestVariantIndex::check(bool same, const string &name) {
+    std::cout << (same ? "ok        " : "MISMATCH  ") << name << endl;
+    if (!same) {
+        this->nFailed_++;
+    }
+}
+
+
+void TestVariantIndex::setSites(VariantIndex &sites,
+                                const vector <string> &chrom,
+                                const vector < vector <int> > &position) {
+    sites.chrom_ = chrom;
+    sites.position_ = position;
+    sites.getIndexOfChromStarts();
+}
+
+
+void TestVariantIndex::oldFindWhoToBeKept(VariantIndex &sites,
+    const vector <string> &excludeChrom,
+    const vector < vector <int> > &excludePosition) {
+    for (size_t chromI = 0; chromI < sites.chrom_.size(); chromI++) {
+        vector < size_t > tmpindexOfPosToBeKept;
+        vector<string>::const_iterator chromIt = find(excludeChrom.begin(),
+            excludeChrom.end(), sites.chrom_[chromI]);
+        size_t hapIndex = sites.indexOfChromStarts_[chromI];
+        size_t chromIndexInExclude = std::distance(excludeChrom.begin(),
+                                                   chromIt);
+        for (size_t posI = 0; posI < sites.position_[chromI].size(); posI++) {
+            if (chromIt == excludeChrom.end() ||
+                std::find(excludePosition[chromIndexInExclude].begin(),
+                          excludePosition[chromIndexInExclude].end(),
+                          sites.position_[chromI][posI]) ==
+                    excludePosition[chromIndexInExclude].end()) {
+                sites.indexOfContentToBeKept.push_back(hapIndex);
+                tmpindexOfPosToBeKept.push_back(posI);
+            }
+            hapIndex++;
+        }
+        sites.indexOfPosToBeKept.push_back(tmpindexOfPosToBeKept);
+    }
+}
+
+
+void TestVariantIndex::oldFindWhoToBeKeptBed(VariantIndex &sites,
+    const vector <BedLine> &bedLines) {
+    for (size_t chromI = 0; chromI < sites.chrom_.size(); chromI++) {
+        vector < size_t > tmpindexOfPosToBeKept;
+        size_t hapIndex = sites.indexOfChromStarts_[chromI];
+        for (size_t posI = 0; posI < sites.position_[chromI].size(); posI++) {
+            int position = sites.position_[chromI][posI];
+            bool isExcluded = false;
+            for (const BedLine &bedLine : bedLines) {
+                if (bedLine.chrom == sites.chrom_[chromI] &&
+                    bedLine.start < position && position <= bedLine.end) {
+                    isExcluded = true;
+                }
+            }
+            if (!isExcluded) {
+                sites.indexOfContentToBeKept.push_back(hapIndex);
+                tmpindexOfPosToBeKept.push_back(posI);
+            }
+            hapIndex++;
+        }
+        sites.indexOfPosToBeKept.push_back(tmpindexOfPosToBeKept);
+    }
+}
+
+
+void TestVariantIndex::oldFindWhoToBeKeptGivenIndex(VariantIndex &sites,
+    const vector <size_t> &givenIndex) {
+    sites.indexOfContentToBeKept = givenIndex;
+    vector <string> oldChrom = sites.chrom_;
+    sites.chrom_.clear();
+    vector < vector < int > > oldposition = sites.position_;
+    sites.position_.clear();
+
+    for (size_t chromI = 0; chromI < oldChrom.size(); chromI++) {
+        size_t hapIndex = sites.indexOfChromStarts_[chromI];
+        vector <int> newTrimmedPos;
+        for (size_t posI = 0; posI < oldposition[chromI].size(); posI++) {
+            if (std::find(givenIndex.begin(), givenIndex.end(), hapIndex)
+                    != givenIndex.end()) {
+                if (newTrimmedPos.size() == 0) {
+                    sites.chrom_.push_back(oldChrom[chromI]);
+                }
+                newTrimmedPos.push_back(oldposition[chromI][posI]);
+            }
+            hapIndex++;
+        }
+        sites.position_.push_back(newTrimmedPos);
+    }
+}
+
+
+void TestVariantIndex::compareKept(const string &name,
+    const vector <string> &chrom, const vector < vector <int> > &position,
+    const vector <string> &excludeChrom,
+    const vector < vector <int> > &excludePosition) {
+    // Positions of the exclude list are sorted within each chrom
+    TmpFile excludeFile(".txt");
+    std::ofstream excludeOut(excludeFile.name());
+    excludeOut << "CHROM\tPOS\n";
+    for (size_t chromI = 0; chromI < excludeChrom.size(); chromI++) {
+        vector <int> sortedPosition = excludePosition[chromI];
+        std::sort(sortedPosition.begin(), sortedPosition.end());
+        for (int pos : sortedPosition) {
+            excludeOut << excludeChrom[chromI] << "\t" << pos << "\n";
+        }
+    }
+    excludeOut.close();
+    ExcludeMarker excludedMarkers;
+    excludedMarkers.readFromFile(excludeFile.name().c_str());
+
+    VariantIndex oldSites, newSites;
+    this->setSites(oldSites, chrom, position);
+    this->setSites(newSites, chrom, position);
+    this->oldFindWhoToBeKept(oldSites, excludeChrom, excludePosition);
+    newSites.findWhoToBeKept(&excludedMarkers);
+    this->check(
+        oldSites.indexOfContentToBeKept == newSites.indexOfContentToBeKept &&
+        oldSites.indexOfPosToBeKept == newSites.indexOfPosToBeKept, name);
+}
+
+
+void TestVariantIndex::compareKeptBed(const string &name,
+    const vector <string> &chrom, const vector < vector <int> > &position,
+    const vector <BedLine> &bedLines) {
+    TmpFile bedFile(".bed");
+    std::ofstream bedOut(bedFile.name());
+    for (const BedLine &bedLine : bedLines) {
+        bedOut << bedLine.chrom << "\t" << bedLine.start << "\t"
+               << bedLine.end << "\n";
+    }
+    bedOut.close();
+    ExcludeMarker excludedMarkers;
+    excludedMarkers.readFromFile(bedFile.name().c_str());
+
+    VariantIndex oldSites, newSites;
+    this->setSites(oldSites, chrom, position);
+    this->setSites(newSites, chrom, position);
+    this->oldFindWhoToBeKeptBed(oldSites, bedLines);
+    newSites.findWhoToBeKept(&excludedMarkers);
+    this->check(
+        oldSites.indexOfContentToBeKept == newSites.indexOfContentToBeKept &&
+        oldSites.indexOfPosToBeKept == newSites.indexOfPosToBeKept, name);
+}
+
+
+void TestVariantIndex::compareKeptGivenIndex(const string &name,
+    const vector <string> &chrom, const vector < vector <int> > &position,
+    const vector <size_t> &givenIndex) {
+    VariantIndex oldSites, newSites;
+    this->setSites(oldSites, chrom, position);
+    this->setSites(newSites, chrom, position);
+    this->oldFindWhoToBeKeptGivenIndex(oldSites, givenIndex);
+    newSites.findWhoToBeKeptGivenIndex(givenIndex);
+    this->check(
+        oldSites.indexOfContentToBeKept == newSites.indexOfContentToBeKept &&
+        oldSites.chrom_ == newSites.chrom_ &&
+        oldSites.position_ == newSites.position_, name);
+}
+
+
+vector < vector <int> > TestVariantIndex::randomPositions(size_t nChrom,
+    size_t nSites, bool sorted) {
+    std::uniform_int_distribution <int> positionDist(1, 200);
+    vector < vector <int> > position(nChrom);
+    for (size_t chromI = 0; chromI < nChrom; chromI++) {
+        for (size_t i = 0; i < nSites; i++) {
+            position[chromI].push_back(positionDist(this->rg_));
+        }
+        if (sorted) {
+            std::sort(position[chromI].begin(), position[chromI].end());
+        }
+    }
+    return position;
+}
+
+
+int TestVariantIndex::run() {
+    vector <string> chrom = {"chr1", "chr2", "chr3"};
+    vector < vector <int> > sortedPosition = {{10, 20, 30, 40, 50},
+                                              {5, 15, 25},
+                                              {100, 200, 300}};
+    vector < vector <int> > unsortedPosition = {{40, 10, 30, 20, 50},
+                                                {25, 5, 15},
+                                                {300, 100, 200}};
+    // chr3 has nothing excluded, chr4 has no sites
+    vector <string> excludeChrom = {"chr1", "chr2", "chr4"};
+    vector < vector <int> > excludePosition = {{20, 20, 40, 41}, {5, 25},
+                                               {10}};
+
+    this->compareKept("findWhoToBeKept, sorted sites", chrom,
+                      sortedPosition, excludeChrom, excludePosition);
+    this->compareKept("findWhoToBeKept, unsorted sites", chrom,
+                      unsortedPosition, excludeChrom, excludePosition);
+
+    // Nested, overlapping and adjacent intervals, out of order
+    vector <BedLine> bedLines = {{"chr1", 25, 45}, {"chr1", 9, 20},
+                                 {"chr1", 29, 35}, {"chr1", 19, 30},
+                                 {"chr2", 14, 15}, {"chr2", 15, 25},
+                                 {"chr4", 0, 1000}};
+    this->compareKeptBed("findWhoToBeKept, overlapping BED, sorted sites",
+                         chrom, sortedPosition, bedLines);
+    this->compareKeptBed("findWhoToBeKept, overlapping BED, unsorted sites",
+                         chrom, unsortedPosition, bedLines);
+
+    // Unsorted, repeated and out of range indexes
+    vector <size_t> givenIndex = {9, 0, 4, 4, 7, 100, 2};
+    this->compareKeptGivenIndex("findWhoToBeKeptGivenIndex, sorted sites",
+                                chrom, sortedPosition, givenIndex);
+    this->compareKeptGivenIndex("findWhoToBeKeptGivenIndex, unsorted sites",
+                                chrom, unsortedPosition, givenIndex);
+
+    std::uniform_int_distribution <int> positionDist(1, 200);
+    std::uniform_int_distribution <int> lengthDist(0, 30);
+    std::uniform_int_distribution <size_t> indexDist(0, 130);
+    vector <string> randomChrom = {"chr1", "chr2"};
+    size_t nRandom = 50;
+    size_t nRandomFailed = this->nFailed_;
+    for (size_t round = 0; round < nRandom; round++) {
+        bool sorted = (round % 2 == 0);
+        vector < vector <int> > position = this->randomPositions(
+            randomChrom.size(), 60, sorted);
+        this->compareKept("random exclude list, round " +
+                          std::to_string(round), randomChrom, position,
+                          randomChrom, this->randomPositions(
+                              randomChrom.size(), 40, false));
+
+        vector <BedLine> randomBedLines;
+        for (size_t i = 0; i < 20; i++) {
+            int start = positionDist(this->rg_);
+            randomBedLines.push_back(BedLine{randomChrom[i % 2], start,
+                                             start + lengthDist(this->rg_)});
+        }
+        this->compareKeptBed("random BED, round " + std::to_string(round),
+                             randomChrom, position, randomBedLines);
+
+        vector <size_t> randomIndex;
+        for (size_t i = 0; i < 50; i++) {
+            randomIndex.push_back(indexDist(this->rg_));
+        }
+        this->compareKeptGivenIndex("random given index, round " +
+                                    std::to_string(round), randomChrom,
+                                    position, randomIndex);
+    }
+
+    std::cout << this->nFailed_ << " mismatches, "
+              << this->nFailed_ - nRandomFailed << " of them in "
+              << nRandom << " random rounds" << endl;
+    return (this->nFailed_ == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// Seconds taken by f
+template <class F> static double timeIt(F f) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration <double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+
+static string formatSeconds(double seconds) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(4) << seconds;
+    return out.str();
+}
+
+
+// 14 chromosomes, as in Pf3D7, with every tenth site excluded and the other
+// sites given as the index to keep. The old searches are skipped once they
+// would compare more than 10^12 pairs.
+void TestVariantIndex::benchmarkSites(size_t nSites) {
+    size_t nChrom = 14;
+    vector <string> chrom;
+    vector < vector <int> > position(nChrom);
+    vector < vector <int> > excludePosition(nChrom);
+    TmpFile excludeFile(".txt");
+    std::ofstream excludeOut(excludeFile.name());
+    excludeOut << "CHROM\tPOS\n";
+    double nOldKeptPairs = 0;
+    for (size_t chromI = 0; chromI < nChrom; chromI++) {
+        chrom.push_back("chr" + std::to_string(chromI + 1));
+        size_t nSitesOfChrom = nSites / nChrom +
+                               ((chromI < nSites % nChrom) ? 1 : 0);
+        for (size_t i = 0; i < nSitesOfChrom; i++) {
+            position[chromI].push_back(1000 + 20 * i);
+            if (i % 10 == 0) {
+                excludePosition[chromI].push_back(position[chromI].back());
+                excludeOut << chrom.back() << "\t"
+                           << position[chromI].back() << "\n";
+            }
+        }
+        nOldKeptPairs += static_cast<double>(nSitesOfChrom) *
+                         excludePosition[chromI].size();
+    }
+    excludeOut.close();
+    ExcludeMarker excludedMarkers;
+    excludedMarkers.readFromFile(excludeFile.name().c_str());
+
+    VariantIndex newSites;
+    this->setSites(newSites, chrom, position);
+    double newKept = timeIt([&]() {
+        newSites.findWhoToBeKept(&excludedMarkers); });
+    string oldKept = "skipped";
+    if (nOldKeptPairs <= 1e12) {
+        VariantIndex oldSites;
+        this->setSites(oldSites, chrom, position);
+        oldKept = formatSeconds(timeIt([&]() {
+            this->oldFindWhoToBeKept(oldSites, chrom, excludePosition); }));
+        this->check(oldSites.indexOfContentToBeKept ==
+                        newSites.indexOfContentToBeKept &&
+                    oldSites.indexOfPosToBeKept == newSites.indexOfPosToBeKept,
+                    "findWhoToBeKept, " + std::to_string(nSites) + " sites");
+    }
+
+    vector <size_t> givenIndex = newSites.indexOfContentToBeKept;
+    VariantIndex newGiven;
+    this->setSites(newGiven, chrom, position);
+    double newKeptGivenIndex = timeIt([&]() {
+        newGiven.findWhoToBeKeptGivenIndex(givenIndex); });
+    string oldKeptGivenIndex = "skipped";
+    if (static_cast<double>(nSites) * givenIndex.size() <= 1e12) {
+        VariantIndex oldGiven;
+        this->setSites(oldGiven, chrom, position);
+        oldKeptGivenIndex = formatSeconds(timeIt([&]() {
+            this->oldFindWhoToBeKeptGivenIndex(oldGiven, givenIndex); }));
+        this->check(oldGiven.chrom_ == newGiven.chrom_ &&
+                    oldGiven.position_ == newGiven.position_,
+                    "findWhoToBeKeptGivenIndex, " + std::to_string(nSites) +
+                    " sites");
+    }
+
+    std::cout << std::setw(10) << nSites
+              << std::setw(12) << formatSeconds(newKept)
+              << std::setw(12) << oldKept
+              << std::setw(12) << formatSeconds(newKeptGivenIndex)
+              << std::setw(12) << oldKeptGivenIndex << endl;
+}
+
+
+int TestVariantIndex::benchmark(size_t maxSites) {
+    std::cout << "Seconds taken by findWhoToBeKept and "
+              << "findWhoToBeKeptGivenIndex, and by the old searches" << endl
+              << std::setw(10) << "sites" << std::setw(12) << "kept"
+              << std::setw(12) << "old kept" << std::setw(12) << "given"
+              << std::setw(12) << "old given" << endl;
+    for (size_t nSites = 10000; nSites <= maxSites; nSites *= 10) {
+        this->benchmarkSites(nSites);
+    }
+    return (this->nFailed_ == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+int main(int argc, char *argv[]) {
+    try {
+        TestVariantIndex test;
+        if (argc == 3 && string(argv[1]) == "-benchmark") {
+            return test.benchmark(strtoul(argv[2], NULL, 10));
+        } else if (argc != 1) {
+            std::cerr << "Usage: variantIndexCheck [-benchmark INT]" << endl;
+            return EXIT_FAILURE;
+        }
+        return test.run();
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -162,6 +162,10 @@ List dEploid(std::string args) {
         stop("Please use '?dEploid' for help");
     }
 
+    if ( dEploidIO.doBatch() ){
+        stop("Batch mode is only available from the command line!");
+    }
+
     ///** Throw a warning if -seed argmuent is used */
     if (dEploidIO.randomSeedWasSet()){
       Rf_warning("Ignoring seed argument. Set a seed in R.");
@@ -185,7 +189,7 @@ List dEploid(std::string args) {
         McmcMachinery ibdMcmcMachinery(&dEploidIO.plaf_,
                                        &dEploidIO.refCount_,
                                        &dEploidIO.altCount_,
-                                       dEploidIO.panel,
+                                       dEploidIO.panelToUpdate(),
                                        &dEploidIO,
                                        "DEploid-IBD",
                                        "ibd",
@@ -202,7 +206,7 @@ List dEploid(std::string args) {
     McmcMachinery mcmcMachinery(&dEploidIO.plaf_,
                                &dEploidIO.refCount_,
                                &dEploidIO.altCount_,
-                               dEploidIO.panel,
+                               dEploidIO.panelToUpdate(),
                                &dEploidIO,
                                "DEploid classic version",
                                "classic",  // brief